@@ -2,6 +2,8 @@
 #ifndef _CC_LIB_GEOM_TREE_2D_H
 #define _CC_LIB_GEOM_TREE_2D_H
 
+#include <algorithm>
+#include <cmath>
 #include <cstdio>
 #include <iostream>
 #include <memory>
@@ -10,6 +12,7 @@
 #include <vector>
 #include <tuple>
 #include <functional>
+#include <queue>
 
 #include "base/logging.h"
 
@@ -43,6 +46,13 @@ struct Tree2D {
   std::tuple<Pos, T, double>
   Closest(Pos pos) const;
 
+  // The (up to) k points closest to pos, nearest first, with their
+  // data and the distance (Euclidean). Searches the nodes in order of
+  // their distance from pos, so this only visits the nodes near the
+  // answer.
+  std::vector<std::tuple<Pos, T, double>>
+  KNearest(Pos pos, int k) const;
+
   void DebugPrint() const;
 
  private:
@@ -446,6 +456,71 @@ Tree2D<Num, T>::Closest(Pos pos) const {
 
 }
 
+template <class Num, class T>
+requires std::is_arithmetic_v<Num>
+std::vector<std::tuple<typename Tree2D<Num, T>::Pos, T, double>>
+Tree2D<Num, T>::KNearest(Pos pos, int k) const {
+  const auto &[x, y] = pos;
+  std::vector<std::tuple<Pos, T, double>> out;
+  if (k <= 0 || count == 0 || root.get() == nullptr) return out;
+
+  // Max-heap of the best k so far, by squared distance.
+  using Found = std::pair<double, const std::pair<Pos, T> *>;
+  auto FoundLess = [](const Found &a, const Found &b) {
+      return a.first < b.first;
+    };
+  std::priority_queue<Found, std::vector<Found>, decltype(FoundLess)>
+    best(FoundLess);
+
+  // Min-heap of nodes, by a lower bound on the squared distance to
+  // anything inside.
+  using Pending = std::pair<double, const Node *>;
+  auto PendingGreater = [](const Pending &a, const Pending &b) {
+      return a.first > b.first;
+    };
+  std::priority_queue<Pending, std::vector<Pending>, decltype(PendingGreater)>
+    q(PendingGreater);
+  q.emplace(0.0, root.get());
+
+  while (!q.empty()) {
+    const auto [node_sqdist, node] = q.top();
+    q.pop();
+    // Since nodes come out in order, we're done once the closest one
+    // can't improve on the kth best.
+    if ((int)best.size() == k && node_sqdist > best.top().first)
+      break;
+
+    if (const Split *split = std::get_if<Split>(node)) {
+      const double sdist =
+        split->axis_horiz ? split->axis - y : split->axis - x;
+      const double sq_dist = std::max(node_sqdist, sdist * sdist);
+      const bool lesseq = Classify(pos, split->axis_horiz, split->axis);
+      const Node *same = lesseq ? split->lesseq.get() : split->greater.get();
+      const Node *other = lesseq ? split->greater.get() : split->lesseq.get();
+      if (same != nullptr) q.emplace(node_sqdist, same);
+      if (other != nullptr) q.emplace(sq_dist, other);
+    } else {
+      for (const auto &elt : std::get<Leaf>(*node)) {
+        const double sq_dist = SqDist(pos, elt.first);
+        if ((int)best.size() < k) {
+          best.emplace(sq_dist, &elt);
+        } else if (sq_dist < best.top().first) {
+          best.pop();
+          best.emplace(sq_dist, &elt);
+        }
+      }
+    }
+  }
+
+  out.reserve(best.size());
+  while (!best.empty()) {
+    const auto &[sq_dist, elt] = best.top();
+    out.emplace_back(elt->first, elt->second, sqrt(sq_dist));
+    best.pop();
+  }
+  std::reverse(out.begin(), out.end());
+  return out;
+}
 
 #endif
 
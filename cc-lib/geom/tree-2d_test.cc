@@ -1,9 +1,15 @@
 
 #include "tree-2d.h"
 
+#include <algorithm>
+#include <cmath>
 #include <string>
+#include <utility>
+#include <vector>
 
+#include "arcfour.h"
 #include "base/logging.h"
+#include "randutil.h"
 
 static void TestInts() {
   Tree2D<int, std::string> tree;
@@ -96,9 +102,49 @@ static void TestInts() {
   CHECK(tree.Empty());
 }
 
+// KNearest agrees with sorting everything, including while removing.
+static void TestKNearest() {
+  Tree2D<int, int> tree;
+  CHECK(tree.KNearest(std::make_pair(0, 0), 3).empty());
+
+  ArcFour rc("knearest");
+  std::vector<std::pair<int, int>> points;
+  for (int i = 0; i < 2000; i++) {
+    std::pair<int, int> p = {(int)RandTo(&rc, 1000) - 500,
+                             (int)RandTo(&rc, 1000) - 500};
+    points.push_back(p);
+    tree.Insert(p, i);
+  }
+
+  for (int iter = 0; iter < 200; iter++) {
+    const std::pair<int, int> q = {(int)RandTo(&rc, 1200) - 600,
+                                   (int)RandTo(&rc, 1200) - 600};
+    const int k = 1 + RandTo(&rc, 20);
+    const auto near = tree.KNearest(q, k);
+    CHECK((int)near.size() == std::min(k, (int)tree.Size()));
+
+    std::vector<double> all;
+    tree.App([&](const std::pair<int, int> &p, int i) {
+        const double dx = p.first - q.first, dy = p.second - q.second;
+        all.push_back(sqrt(dx * dx + dy * dy));
+      });
+    std::sort(all.begin(), all.end());
+    for (int i = 0; i < (int)near.size(); i++) {
+      const auto &[p, t, d] = near[i];
+      CHECK(points[t] == p);
+      CHECK(std::abs(d - all[i]) < 1e-9) << i << ": " << d << " " << all[i];
+    }
+
+    // Remove the closest one.
+    const auto &[p, t, d] = near[0];
+    CHECK(tree.Remove(p));
+  }
+}
+
 int main(int argc, char **argv) {
 
   TestInts();
+  TestKNearest();
 
   printf("OK");
   return 0;
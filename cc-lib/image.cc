@@ -12,6 +12,7 @@
 #include <vector>
 
 #include "lines.h"
+#include "threadutil.h"
 #include "stb_image.h"
 #include "stb_image_write.h"
 #include "base/logging.h"
@@ -572,6 +573,147 @@ void ImageRGBA::BlendLine32(int x1, int y1, int x2, int y2,
   }
 }
 
+namespace {
+// Bresenham's algorithm, producing the same pixels as Line<int>, but
+// able to start at any step so that a long line can be drawn a tile
+// at a time. Step k (0 <= k <= n) is at k along the major axis (the
+// one along which the line is longer) from the start.
+struct SteppedLine {
+  explicit SteppedLine(const ImageRGBA::LineSegment32 &line) {
+    int64_t dx = (int64_t)line.x2 - line.x1;
+    int64_t dy = (int64_t)line.y2 - line.y1;
+    const int64_t stepx = dx < 0 ? -1 : 1, stepy = dy < 0 ? -1 : 1;
+    dx = std::abs(dx) * 2;
+    dy = std::abs(dy) * 2;
+    x_major = dx > dy;
+    if (x_major) {
+      major0 = line.x1; minor0 = line.y1;
+      major_step = stepx; minor_step = stepy;
+      dmajor = dx; dminor = dy;
+    } else {
+      major0 = line.y1; minor0 = line.x1;
+      major_step = stepy; minor_step = stepx;
+      dmajor = dy; dminor = dx;
+    }
+    n = dmajor / 2;
+    start_frac = dminor - n;
+  }
+
+  // The steps whose major coordinate is in [lo, hi], if any.
+  bool Range(int64_t lo, int64_t hi, int64_t *ka, int64_t *kb) const {
+    *ka = std::max(major_step > 0 ? lo - major0 : major0 - hi, int64_t{0});
+    *kb = std::min(major_step > 0 ? hi - major0 : major0 - lo, n);
+    return *ka <= *kb;
+  }
+
+  // The number of minor steps before step k. The error term stays in
+  // [dminor - dmajor, dminor), which determines it.
+  int64_t MinorSteps(int64_t k) const {
+    if (dmajor == 0) return 0;
+    const int64_t num = start_frac + (k - 1) * dminor;
+    // Floor division.
+    const int64_t q = num / dmajor - ((num % dmajor) < 0 ? 1 : 0);
+    return q + 1;
+  }
+
+  int64_t MinorAt(int64_t k) const {
+    return minor0 + minor_step * MinorSteps(k);
+  }
+
+  // Call f(x, y) for steps ka..kb.
+  template<class F>
+  void Steps(int64_t ka, int64_t kb, const F &f) const {
+    const int64_t c = ka == 0 ? 0 : MinorSteps(ka);
+    int64_t major = major0 + major_step * ka;
+    int64_t minor = minor0 + minor_step * c;
+    int64_t frac = start_frac + ka * dminor - c * dmajor;
+    for (int64_t k = ka; k <= kb; k++) {
+      if (x_major) f(major, minor);
+      else f(minor, major);
+      if (frac >= 0) {
+        minor += minor_step;
+        frac -= dmajor;
+      }
+      major += major_step;
+      frac += dminor;
+    }
+  }
+
+  bool x_major = false;
+  int64_t major0 = 0, minor0 = 0, major_step = 1, minor_step = 1;
+  int64_t dmajor = 0, dminor = 0, start_frac = 0, n = 0;
+};
+}  // namespace
+
+void ImageRGBA::BlendLines32(const std::vector<LineSegment32> &lines,
+                             int max_threads) {
+  static constexpr int TILE = 64;
+  const int tiles_wide = (width + TILE - 1) / TILE;
+  const int tiles_high = (height + TILE - 1) / TILE;
+  if (tiles_wide == 0 || tiles_high == 0) return;
+
+  // Indices of the lines that pass through each tile, in order. We
+  // go along the major axis a strip of tiles at a time; in each
+  // strip, the line spans the tiles between its minor coordinates at
+  // the strip's first and last steps.
+  std::vector<std::vector<int>> buckets(tiles_wide * tiles_high);
+  for (int i = 0; i < (int)lines.size(); i++) {
+    // Most lines in a path are short, and in a single tile.
+    const LineSegment32 &seg = lines[i];
+    const int x0 = std::max(std::min(seg.x1, seg.x2), 0);
+    const int x1 = std::min(std::max(seg.x1, seg.x2), width - 1);
+    const int y0 = std::max(std::min(seg.y1, seg.y2), 0);
+    const int y1 = std::min(std::max(seg.y1, seg.y2), height - 1);
+    if (x0 > x1 || y0 > y1) continue;
+    if (x0 / TILE == x1 / TILE && y0 / TILE == y1 / TILE) {
+      buckets[(y0 / TILE) * tiles_wide + x0 / TILE].push_back(i);
+      continue;
+    }
+
+    const SteppedLine line(seg);
+    const int64_t major_size = line.x_major ? width : height;
+    const int64_t minor_size = line.x_major ? height : width;
+    const int64_t major1 = line.major0 + line.major_step * line.n;
+    const int64_t lo = std::max(std::min(line.major0, major1), int64_t{0});
+    const int64_t hi = std::min(std::max(line.major0, major1),
+                                major_size - 1);
+    for (int64_t strip = lo / TILE; strip <= hi / TILE; strip++) {
+      int64_t ka = 0, kb = 0;
+      if (!line.Range(strip * TILE, strip * TILE + TILE - 1, &ka, &kb))
+        continue;
+      const int64_t ma = line.MinorAt(ka), mb = line.MinorAt(kb);
+      const int64_t mlo = std::max(std::min(ma, mb), int64_t{0});
+      const int64_t mhi = std::min(std::max(ma, mb), minor_size - 1);
+      for (int64_t t = mlo / TILE; t <= mhi / TILE && mlo <= mhi; t++) {
+        const int64_t tx = line.x_major ? strip : t;
+        const int64_t ty = line.x_major ? t : strip;
+        buckets[ty * tiles_wide + tx].push_back(i);
+      }
+    }
+  }
+
+  ParallelComp(buckets.size(), [&](int64_t t) {
+      const int xmin = (t % tiles_wide) * TILE;
+      const int ymin = (t / tiles_wide) * TILE;
+      const int xmax = std::min(xmin + TILE, width);
+      const int ymax = std::min(ymin + TILE, height);
+      for (int i : buckets[t]) {
+        const SteppedLine line(lines[i]);
+        const auto [r, g, b, a] = Unpack32(lines[i].color);
+        int64_t ka = 0, kb = 0;
+        const bool any = line.x_major ?
+          line.Range(xmin, xmax - 1, &ka, &kb) :
+          line.Range(ymin, ymax - 1, &ka, &kb);
+        if (!any) continue;
+        line.Steps(ka, kb, [&](int64_t x, int64_t y) {
+            if (x >= xmin && x < xmax && y >= ymin && y < ymax) {
+              BlendPixel(x, y, r, g, b, a);
+            }
+          });
+      }
+    }, max_threads);
+}
+
 void ImageRGBA::BlendThickLine32(float x1, float y1, float x2, float y2,
                                  float radius,
                                  uint32 color) {
@@ -134,6 +134,20 @@ struct ImageRGBA {
                  uint8 r, uint8 g, uint8 b, uint8 a);
   void BlendLine32(int x1, int y1, int x2, int y2, uint32 color);
 
+  // Same as calling BlendLine32 for each line in order, but faster
+  // for large numbers of lines (e.g. a path with millions of short
+  // segments). The image is divided into tiles, each line is added
+  // to the tiles that it passes through, and the tiles are
+  // rasterized in parallel, each drawing only its part of each line.
+  // Since each tile draws its lines in order, the result is exactly
+  // the same.
+  struct LineSegment32 {
+    int x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+    uint32 color = 0;
+  };
+  void BlendLines32(const std::vector<LineSegment32> &lines,
+                    int max_threads = 8);
+
   // PERF: This is slow (rasterizes the entire bounding box).
   void BlendThickLine32(float x1, float y1, float x2, float y2, float radius,
                         uint32 color);
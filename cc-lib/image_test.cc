@@ -195,6 +195,52 @@ static void TestLineEndpoints() {
   // TODO: Test other directions of lines
 }
 
+static void TestBlendLines() {
+  ArcFour rc("lines");
+  ImageRGBA one(300, 200), two(300, 200);
+  one.Clear32(0x000000FF);
+  two.Clear32(0x000000FF);
+  std::vector<ImageRGBA::LineSegment32> lines;
+  for (int i = 0; i < 5000; i++) {
+    // Some lines go off the image, and most are short, like a path.
+    const int x = (int)(rc.Byte() * 2) - 100;
+    const int y = (int)(rc.Byte()) - 30;
+    const bool is_long = (rc.Byte() & 15) == 0;
+    const int dx = is_long ? (int)rc.Byte() - 128 : (rc.Byte() & 7) - 3;
+    const int dy = is_long ? (int)rc.Byte() - 128 : (rc.Byte() & 7) - 3;
+    const uint32 color = (rc.Byte() << 24) | (rc.Byte() << 16) |
+      (rc.Byte() << 8) | 0x40 | (rc.Byte() & 0x3F);
+    lines.push_back({.x1 = x, .y1 = y, .x2 = x + dx, .y2 = y + dy,
+                     .color = color});
+    one.BlendLine32(x, y, x + dx, y + dy, color);
+  }
+  two.BlendLines32(lines);
+  CHECK(one == two);
+
+  // Long lines in every direction across many tiles, including ones
+  // that start or end far outside the image.
+  ImageRGBA three(700, 500), four(700, 500);
+  three.Clear32(0x000000FF);
+  four.Clear32(0x000000FF);
+  lines.clear();
+  for (int i = 0; i < 2000; i++) {
+    auto Coord = [&rc](int size) {
+        const int far = (rc.Byte() & 7) == 0 ? 20000 : 0;
+        return (int)(((rc.Byte() << 8) | rc.Byte()) % (size + 200)) - 100 +
+          ((rc.Byte() & 1) ? far : -far);
+      };
+    const int x1 = Coord(700), y1 = Coord(500);
+    const int x2 = Coord(700), y2 = Coord(500);
+    const uint32 color = (rc.Byte() << 24) | (rc.Byte() << 16) |
+      (rc.Byte() << 8) | 0x10 | (rc.Byte() & 0x3F);
+    lines.push_back({.x1 = x1, .y1 = y1, .x2 = x2, .y2 = y2,
+                     .color = color});
+    three.BlendLine32(x1, y1, x2, y2, color);
+  }
+  four.BlendLines32(lines);
+  CHECK(three == four);
+}
+
 static void TestFilledCircle() {
   {
     ImageRGBA img(10, 10);
@@ -362,6 +408,7 @@ int main(int argc, char **argv) {
   TestEq();
   TestScaleDown();
   TestLineEndpoints();
+  TestBlendLines();
   TestFilledCircle();
   TestCopyImage();
 
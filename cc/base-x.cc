@@ -0,0 +1,175 @@
+#include "base-x.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "ansi.h"
+#include "timer.h"
+#include "periodically.h"
+#include "base/logging.h"
+#include "base/stringprintf.h"
+#include "bignum/big.h"
+#include "bignum/big-overloads.h"
+
+#include "icfp.h"
+
+BigInt BaseXNumber(const std::vector<int> &digits, int radix, bool verbose) {
+  // The decoding code looks like this
+  // fun emit 0 _ = ""
+  //   | emit count num =
+  //      let val digit = num % RADIX
+  //          val rest = num / RADIX
+  //      in render digit ^ emit (count - 1) rest
+  //      end
+  //
+  // So the first digit becomes the lowest order digit of the
+  // number. This means we work from back to front.
+
+  Periodically status_per(1.0);
+  Timer timer;
+
+  BigInt encoded{0};
+  for (int i = digits.size() - 1; i >= 0; i--) {
+    CHECK(digits[i] >= 0 && digits[i] < radix);
+    encoded = encoded * radix + digits[i];
+
+    if (verbose && status_per.ShouldRun()) {
+      fprintf(stderr,
+              ANSI_UP "%s\n",
+              ANSI::ProgressBar(digits.size() - i, digits.size(),
+                                "Encoding",
+                                timer.Seconds()).c_str());
+    }
+  }
+  return encoded;
+}
+
+std::string BaseXDecoder(
+    int64_t count, const BigInt &encoded, int radix,
+    const std::function<std::string(const std::string &)> &render_digit) {
+  std::string zero = icfp::IntConstant(BigInt{0});
+  std::string one = icfp::IntConstant(BigInt{1});
+  const std::string radix_exp = icfp::IntConstant(BigInt(radix));
+
+  const std::string encoded_exp = icfp::IntConstant(encoded);
+
+  // y combinator
+  std::string y =
+    "Lf B$ Lx B$ vf B$ vx vx Lx B$ vf B$ vx vx";
+
+  #define EMIT "e"
+
+  // digit is num % RADIX
+  std::string digit =
+    StringPrintf("B%% vn %s", radix_exp.c_str());
+
+  std::string render = render_digit(digit);
+
+  // rest is num / RADIX
+  std::string rest =
+    StringPrintf("B/ vn %s", radix_exp.c_str());
+
+  #define APP "B!"
+
+  // render digit ^ emit (count - 1) rest
+  std::string concat =
+    StringPrintf("B. "
+                 // render digit
+                 "%s "
+                 // emit (count - 1) rest
+                 APP " " APP " v" EMIT " B- vc %s %s",
+                 render.c_str(),
+                 one.c_str(), rest.c_str());
+
+  std::string cond =
+    StringPrintf(
+        // if count = 0
+        "? B= vc %s "
+        // then ""
+        "S "
+        // else concat
+        "%s",
+        zero.c_str(),
+        concat.c_str());
+
+  // fix (fn emit => fn count => fn num => cond)
+  std::string fix =
+    StringPrintf("B$ %s L" EMIT " Lc Ln %s", y.c_str(), cond.c_str());
+
+  // And apply to the arguments.
+  return StringPrintf("B$ B$ %s %s %s",
+                      fix.c_str(),
+                      icfp::IntConstant(BigInt(count)).c_str(),
+                      encoded_exp.c_str());
+}
+
+std::string BaseXEncode(std::string_view input, bool force_pow2) {
+  // Count each char in the input. For now, we just have a
+  // flat base. But I think it would be doable to perform
+  // Huffman encoding.
+  std::unordered_map<uint8_t, int> counts;
+  for (char c : input) counts[(uint8_t)c]++;
+
+  // Bidirectional mapping.
+  std::vector<uint8_t> chars;
+  int syms[256];
+  for (int &i : syms) i = -1;
+
+  for (const auto &[c, count] : counts) {
+    if (count > 0) {
+      syms[c] = (int)chars.size();
+      chars.push_back(c);
+    }
+  }
+
+  const int orig_radix = counts.size();
+
+  // We can use any larger radix. Powers of 2 should give faster
+  // division and mod during decoding, I think/hope. The symbol
+  // table will be shorter than the radix, but we just won't index
+  // outside it.
+  int radix = orig_radix;
+  while (force_pow2 && (radix & (radix - 1)) != 0) {
+    radix++;
+  }
+
+  fprintf(stderr, "%d distinct chars. use radix %d.\n\n",
+          orig_radix, radix);
+  for (const auto &[c, count] : counts) {
+    if (count > 0) {
+      fprintf(stderr, "'%c' x %d\n", c, count);
+    }
+  }
+
+  std::vector<int> digits;
+  digits.reserve(input.size());
+  for (uint8_t c : input) {
+    CHECK(syms[c] != -1);
+    digits.push_back(syms[c]);
+  }
+  const BigInt encoded = BaseXNumber(digits, radix, true);
+
+  fprintf(stderr, "Generate constants...\n");
+
+  std::string raw_lookup;
+  for (uint8_t c : chars) raw_lookup.push_back(c);
+  std::string lookup =
+    StringPrintf("S%s", icfp::EncodeString(raw_lookup).c_str());
+
+  // The render function is just indexing into the string
+  // consisting of all the chars. It drops d and then takes 1.
+  const std::string one = icfp::IntConstant(BigInt{1});
+  std::string all = BaseXDecoder(
+      input.size(), encoded, radix, [&](const std::string &digit) {
+        return StringPrintf("BT %s BD %s %s",
+                            one.c_str(), digit.c_str(), lookup.c_str());
+      });
+
+  fprintf(stderr, "Program is %d bytes.\n", (int)all.size());
+  return all;
+}
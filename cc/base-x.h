@@ -0,0 +1,34 @@
+
+#ifndef BASE_X_H_
+#define BASE_X_H_
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "bignum/big.h"
+
+// Encoding data as one big base-X number, with an icfp program that
+// decodes it digit by digit.
+
+// The number whose base-radix digits are these, with the first digit
+// as the lowest order.
+BigInt BaseXNumber(const std::vector<int> &digits, int radix,
+                   bool verbose = false);
+
+// A program that evaluates to the concatenation of the renderings of
+// count digits of encoded in the given radix, lowest order first.
+// render_digit gets an expression for the digit, and returns one for
+// its string. The decoder uses the variables e, c, n, f and x.
+std::string BaseXDecoder(
+    int64_t count, const BigInt &encoded, int radix,
+    const std::function<std::string(const std::string &)> &render_digit);
+
+// A program that evaluates to the input, with a digit for each
+// character. force_pow2 may be necessary for large inputs, since
+// their decoder will time out doing the mods I guess?
+std::string BaseXEncode(std::string_view input, bool force_pow2);
+
+#endif
@@ -0,0 +1,780 @@
+
+// Solves efficiency puzzles that are a search for the smallest
+// integer satisfying some constraint (e.g. efficiency7-11):
+//
+//   (fix (λ self. λ n.
+//           let x1 = extract digit 1 of n
+//           ...
+//           let xk = extract digit k of n
+//           in if (constraint x1..xk) then n else self (+ n 1))) start
+//
+// A digit is (% (/ n K) B) for constants K and B; it is either
+// tested as a bit (< 0 digit) or offset (+ c digit). The constraint
+// is translated to SMT-LIB2 and given to a solver (z3) as a child
+// process, minimizing the digits lexicographically from the most
+// significant. If no solver is available, we do a parallel brute
+// force search in order of n (bit-parallel when the constraint is
+// purely boolean). Either way, the answer is checked with the
+// evaluator.
+
+#include "icfp.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <unistd.h>
+
+#include "ansi.h"
+#include "base/logging.h"
+#include "base/stringprintf.h"
+#include "periodically.h"
+#include "process-util.h"
+#include "threadutil.h"
+#include "timer.h"
+#include "util.h"
+
+using namespace icfp;
+
+static std::string PrettyVar(int64_t ii) {
+  CHECK(ii >= 0);
+  if (ii < 26) return StringPrintf("%c", 'a' + ii);
+  return StringPrintf("v%zu", (size_t)ii);
+}
+
+// One of the let-bound variables, extracted from n.
+struct Digit {
+  int64_t var = 0;
+  // If true, this is (< 0 (% (/ n K) 2)).
+  // Otherwise it is (+ offset (% (/ n K) base)).
+  bool is_bool = false;
+  BigInt weight{1};
+  int64_t base = 2;
+  int64_t offset = 0;
+};
+
+struct Search {
+  BigInt start{0};
+  int64_t self_var = 0, n_var = 0;
+  std::vector<Digit> digits;
+  std::shared_ptr<Exp> cond;
+  // The function (λ self. λ n. ...), for verification.
+  std::shared_ptr<Exp> fn;
+};
+
+static bool IsVar(const Exp *e, int64_t v) {
+  const Var *var = std::get_if<Var>(e);
+  return var != nullptr && var->v == v;
+}
+
+static std::optional<BigInt> IsInt(const Exp *e) {
+  if (const Int *i = std::get_if<Int>(e)) return {i->i};
+  return std::nullopt;
+}
+
+static const Binop *IsBinop(const Exp *e, uint8_t op) {
+  const Binop *b = std::get_if<Binop>(e);
+  if (b != nullptr && b->op == op) return b;
+  return nullptr;
+}
+
+// (% (/ n K) B)
+static std::optional<std::pair<BigInt, BigInt>> IsExtract(const Exp *e,
+                                                          int64_t n) {
+  const Binop *mod = IsBinop(e, '%');
+  if (mod == nullptr) return std::nullopt;
+  const Binop *div = IsBinop(mod->arg1.get(), '/');
+  if (div == nullptr || !IsVar(div->arg1.get(), n)) return std::nullopt;
+  auto k = IsInt(div->arg2.get());
+  auto b = IsInt(mod->arg2.get());
+  if (!k.has_value() || !b.has_value()) return std::nullopt;
+  if (k.value() <= 0 || b.value() <= 1) return std::nullopt;
+  return {std::make_pair(k.value(), b.value())};
+}
+
+static std::optional<Digit> IsDigit(int64_t var, const Exp *e, int64_t n) {
+  Digit d;
+  d.var = var;
+  if (const Binop *lt = IsBinop(e, '<')) {
+    auto zero = IsInt(lt->arg1.get());
+    auto ex = IsExtract(lt->arg2.get(), n);
+    if (!zero.has_value() || zero.value() != 0 || !ex.has_value())
+      return std::nullopt;
+    if (ex.value().second != 2) return std::nullopt;
+    d.is_bool = true;
+    d.weight = ex.value().first;
+    d.base = 2;
+    return {d};
+  }
+
+  std::optional<BigInt> offset{BigInt{0}};
+  const Exp *inner = e;
+  if (const Binop *plus = IsBinop(e, '+')) {
+    offset = IsInt(plus->arg1.get());
+    inner = plus->arg2.get();
+  }
+  auto ex = IsExtract(inner, n);
+  if (!offset.has_value() || !ex.has_value()) return std::nullopt;
+  auto bo = ex.value().second.ToInt();
+  auto oo = offset.value().ToInt();
+  if (!bo.has_value() || !oo.has_value()) return std::nullopt;
+  d.is_bool = false;
+  d.weight = ex.value().first;
+  d.base = bo.value();
+  d.offset = oo.value();
+  return {d};
+}
+
+// Recognize the search shape, or explain why not.
+static std::optional<Search> Recognize(std::shared_ptr<Exp> exp,
+                                       std::string *why) {
+  Search search;
+  const Binop *top = IsBinop(exp.get(), '$');
+  if (top == nullptr) { *why = "not an application"; return std::nullopt; }
+  auto start = IsInt(top->arg2.get());
+  if (!start.has_value()) {
+    *why = "not applied to an integer";
+    return std::nullopt;
+  }
+  search.start = start.value();
+
+  const Binop *fix = IsBinop(top->arg1.get(), '$');
+  if (fix == nullptr || !IsFixpointCombinator(fix->arg1.get())) {
+    *why = "not a fixpoint (Y combinator)";
+    return std::nullopt;
+  }
+  search.fn = fix->arg2;
+
+  const Lambda *self = std::get_if<Lambda>(fix->arg2.get());
+  const Lambda *n = self ? std::get_if<Lambda>(self->body.get()) : nullptr;
+  if (n == nullptr) {
+    *why = "fixpoint of something other than λ self. λ n. ...";
+    return std::nullopt;
+  }
+  search.self_var = self->v;
+  search.n_var = n->v;
+
+  // Let-bound digits.
+  const Exp *body = n->body.get();
+  for (;;) {
+    const Binop *let = IsBinop(body, '$');
+    if (let == nullptr) break;
+    const Lambda *lam = std::get_if<Lambda>(let->arg1.get());
+    if (lam == nullptr) break;
+    auto d = IsDigit(lam->v, let->arg2.get(), n->v);
+    if (!d.has_value()) {
+      *why = "let-bound variable " + PrettyVar(lam->v) +
+        " is not a digit of n";
+      return std::nullopt;
+    }
+    search.digits.push_back(d.value());
+    body = lam->body.get();
+  }
+
+  if (search.digits.empty()) {
+    *why = "no digits extracted from n";
+    return std::nullopt;
+  }
+
+  // if cond then n else self (+ n 1)
+  const If *iff = std::get_if<If>(body);
+  if (iff == nullptr || !IsVar(iff->t.get(), n->v)) {
+    *why = "body is not (if cond then n else ...)";
+    return std::nullopt;
+  }
+  const Binop *rec = IsBinop(iff->f.get(), '$');
+  const Binop *succ = rec ? IsBinop(rec->arg2.get(), '+') : nullptr;
+  auto IsOne = [](const Exp *e) {
+      auto o = IsInt(e);
+      return o.has_value() && o.value() == 1;
+    };
+  if (succ == nullptr || !IsVar(rec->arg1.get(), self->v) ||
+      !((IsVar(succ->arg1.get(), n->v) && IsOne(succ->arg2.get())) ||
+        (IsOne(succ->arg1.get()) && IsVar(succ->arg2.get(), n->v)))) {
+    *why = "else branch is not self (+ n 1)";
+    return std::nullopt;
+  }
+
+  search.cond = iff->cond;
+  return {search};
+}
+
+// Translate the constraint. Only the digits may appear free.
+static std::optional<std::string> ToSMT(const Search &search, const Exp *e,
+                                        std::string *why) {
+  auto Rec = [&](const std::shared_ptr<Exp> &c) {
+      return ToSMT(search, c.get(), why);
+    };
+
+  if (const Bool *b = std::get_if<Bool>(e)) {
+    return {b->b ? "true" : "false"};
+  } else if (const Int *i = std::get_if<Int>(e)) {
+    if (i->i < 0) return {"(- " + BigInt::Negate(i->i).ToString() + ")"};
+    return {i->i.ToString()};
+  } else if (const Var *v = std::get_if<Var>(e)) {
+    for (const Digit &d : search.digits) {
+      if (d.var == v->v) return {PrettyVar(v->v)};
+    }
+    *why = "constraint mentions a variable other than the digits";
+    return std::nullopt;
+  } else if (const Unop *u = std::get_if<Unop>(e)) {
+    auto a = Rec(u->arg);
+    if (!a.has_value()) return std::nullopt;
+    switch (u->op) {
+    case '!': return {"(not " + a.value() + ")"};
+    case '-': return {"(- " + a.value() + ")"};
+    default:
+      *why = StringPrintf("unsupported unop %c", u->op);
+      return std::nullopt;
+    }
+  } else if (const Binop *b = std::get_if<Binop>(e)) {
+    const char *op = nullptr;
+    switch (b->op) {
+    case '&': op = "and"; break;
+    case '|': op = "or"; break;
+    case '=': op = "="; break;
+    case '<': op = "<"; break;
+    case '>': op = ">"; break;
+    case '+': op = "+"; break;
+    case '-': op = "-"; break;
+    case '*': op = "*"; break;
+    case '/': case '%': break;
+    default:
+      *why = StringPrintf("unsupported binop %c", b->op);
+      return std::nullopt;
+    }
+    auto a1 = Rec(b->arg1);
+    if (!a1.has_value()) return std::nullopt;
+    auto a2 = Rec(b->arg2);
+    if (!a2.has_value()) return std::nullopt;
+    if (b->op == '/' || b->op == '%') {
+      // SMT's div and mod are Euclidean, but icfp truncates toward
+      // zero like C, which differs when an argument is negative (and
+      // digits have offsets, so they can be). On absolute values they
+      // agree, so fix the sign up afterwards: the quotient is negative
+      // if the signs differ, and the remainder takes the dividend's
+      // sign.
+      const char *fmt = b->op == '/' ?
+        "(let ((a! %s) (b! %s)) "
+        "(ite (= (>= a! 0) (>= b! 0)) (div (abs a!) (abs b!)) "
+        "(- (div (abs a!) (abs b!)))))" :
+        "(let ((a! %s) (b! %s)) "
+        "(ite (>= a! 0) (mod (abs a!) (abs b!)) "
+        "(- (mod (abs a!) (abs b!)))))";
+      return {StringPrintf(fmt, a1.value().c_str(), a2.value().c_str())};
+    }
+    return {StringPrintf("(%s %s %s)", op, a1.value().c_str(),
+                         a2.value().c_str())};
+  } else if (const If *i = std::get_if<If>(e)) {
+    auto c = Rec(i->cond);
+    if (!c.has_value()) return std::nullopt;
+    auto t = Rec(i->t);
+    if (!t.has_value()) return std::nullopt;
+    auto f = Rec(i->f);
+    if (!f.has_value()) return std::nullopt;
+    return {StringPrintf("(ite %s %s %s)", c.value().c_str(),
+                         t.value().c_str(), f.value().c_str())};
+  }
+
+  *why = "unsupported expression in constraint";
+  return std::nullopt;
+}
+
+// Digits from most significant to least.
+static std::vector<Digit> ByWeight(const Search &search) {
+  std::vector<Digit> digits = search.digits;
+  std::stable_sort(digits.begin(), digits.end(),
+                   [](const Digit &a, const Digit &b) {
+                     return b.weight < a.weight;
+                   });
+  return digits;
+}
+
+// The value of n as an SMT term.
+static std::string NTerm(const Search &search) {
+  std::string sum = "(+ 0";
+  for (const Digit &d : search.digits) {
+    if (d.is_bool) {
+      sum += StringPrintf(" (ite %s %s 0)", PrettyVar(d.var).c_str(),
+                          d.weight.ToString().c_str());
+    } else {
+      sum += StringPrintf(" (* %s (- %s %lld))",
+                          d.weight.ToString().c_str(),
+                          PrettyVar(d.var).c_str(),
+                          (long long)d.offset);
+    }
+  }
+  return sum + ")";
+}
+
+static std::optional<std::string> MakeSMT(const Search &search,
+                                          std::string *why) {
+  // Minimizing the digits lexicographically (below) only minimizes n
+  // if they are a mixed-radix number: weights 1, B0, B0*B1, ... with
+  // none missing. And since n is only the sum of the digits below
+  // their product, the answer has to be in that range.
+  const std::vector<Digit> digits = ByWeight(search);
+  BigInt place{1};
+  for (auto it = digits.rbegin(); it != digits.rend(); ++it) {
+    if (!(it->weight == place)) {
+      *why = StringPrintf("digits aren't a mixed radix: %s has weight %s, "
+                          "not %s", PrettyVar(it->var).c_str(),
+                          it->weight.ToString().c_str(),
+                          place.ToString().c_str());
+      return std::nullopt;
+    }
+    place = place * BigInt{it->base};
+  }
+  if (!BigInt::Less(search.start, place)) {
+    *why = "start is past the range of the digits";
+    return std::nullopt;
+  }
+
+  auto co = ToSMT(search, search.cond.get(), why);
+  if (!co.has_value()) return std::nullopt;
+
+  std::string smt = "(set-option :opt.priority lex)\n";
+  for (const Digit &d : search.digits) {
+    std::string v = PrettyVar(d.var);
+    if (d.is_bool) {
+      StringAppendF(&smt, "(declare-const %s Bool) ; %s\n",
+                    v.c_str(), d.weight.ToString().c_str());
+    } else {
+      StringAppendF(&smt, "(declare-const %s Int) ; %s\n",
+                    v.c_str(), d.weight.ToString().c_str());
+      StringAppendF(&smt, "(assert (and (>= %s %lld) (<= %s %lld)))\n",
+                    v.c_str(), (long long)d.offset,
+                    v.c_str(), (long long)(d.offset + d.base - 1));
+    }
+  }
+
+  StringAppendF(&smt, "(assert (>= %s %s))\n",
+                NTerm(search).c_str(), search.start.ToString().c_str());
+  StringAppendF(&smt, "(assert\n%s)\n", co.value().c_str());
+
+  // Minimizing n directly is slow; minimizing the digits
+  // lexicographically is the same thing, as checked above.
+  for (const Digit &d : digits) {
+    if (d.is_bool) {
+      StringAppendF(&smt, "(minimize (ite %s 1 0))\n",
+                    PrettyVar(d.var).c_str());
+    } else {
+      StringAppendF(&smt, "(minimize %s)\n", PrettyVar(d.var).c_str());
+    }
+  }
+
+  smt += "(check-sat)\n(get-value (";
+  for (int i = 0; i < (int)search.digits.size(); i++) {
+    if (i) smt += " ";
+    smt += PrettyVar(search.digits[i].var);
+  }
+  smt += "))\n";
+  return {smt};
+}
+
+// Parse the output of (get-value ...), like
+// sat
+// ((b true)
+//  (c (- 3)) ...)
+// and compute n from it.
+static std::optional<BigInt> ParseModel(const Search &search,
+                                        const std::string &out) {
+  std::string_view s(out);
+  while (!s.empty() && (s[0] == ' ' || s[0] == '\n' || s[0] == '\r'))
+    s.remove_prefix(1);
+  if (s.substr(0, 4) != "sat\n" && s.substr(0, 5) != "sat\r\n")
+    return std::nullopt;
+
+  // Tokenize, ignoring parens except for negative numbers.
+  std::vector<std::string> tokens;
+  std::string cur;
+  for (char c : s.substr(3)) {
+    if (c == '(' || c == ')' || c == ' ' || c == '\n' || c == '\r') {
+      if (!cur.empty()) tokens.push_back(std::move(cur));
+      cur.clear();
+    } else {
+      cur.push_back(c);
+    }
+  }
+  if (!cur.empty()) tokens.push_back(std::move(cur));
+
+  std::unordered_map<std::string, std::string> model;
+  for (int i = 0; i + 1 < (int)tokens.size(); i++) {
+    if (tokens[i + 1] == "-" && i + 2 < (int)tokens.size()) {
+      model[tokens[i]] = "-" + tokens[i + 2];
+      i += 2;
+    } else {
+      model[tokens[i]] = tokens[i + 1];
+      i++;
+    }
+  }
+
+  BigInt n{0};
+  for (const Digit &d : search.digits) {
+    auto it = model.find(PrettyVar(d.var));
+    if (it == model.end()) return std::nullopt;
+    if (d.is_bool) {
+      if (it->second == "true") n = n + d.weight;
+      else if (it->second != "false") return std::nullopt;
+    } else {
+      BigInt v{it->second};
+      n = n + d.weight * (v - BigInt{d.offset});
+    }
+  }
+  return {n};
+}
+
+static std::optional<BigInt> SolveWithSMT(const Search &search,
+                                          const std::string &solver,
+                                          const std::string &smt) {
+  std::string file = StringPrintf("efficiency-%lld.smt2",
+                                  (long long)getpid());
+  Util::WriteFile(file, smt);
+  std::optional<std::string> out =
+    ProcessUtil::GetOutput(StringPrintf("%s %s 2>&1", solver.c_str(),
+                                        file.c_str()));
+  std::remove(file.c_str());
+  if (!out.has_value()) return std::nullopt;
+  auto no = ParseModel(search, out.value());
+  if (!no.has_value()) {
+    fprintf(stderr, "Solver output not understood:\n%s\n",
+            out.value().c_str());
+  }
+  return no;
+}
+
+// Compiled constraint for brute force. Nodes are in postorder, so
+// each node's arguments have smaller indices.
+struct Compiled {
+  struct Node {
+    uint8_t op = 0;
+    // Argument node indices, or digit index for 'v'.
+    int a = 0, b = 0, c = 0;
+    int64_t k = 0;
+  };
+  std::vector<Node> nodes;
+  // Everything is boolean, so we can evaluate 64 candidates at once.
+  bool all_bool = true;
+
+  // For the scalar evaluator.
+  std::vector<int64_t> weight, base, offset;
+};
+
+static std::optional<int> CompileNode(const Search &search, const Exp *e,
+                                      Compiled *comp) {
+  auto Push = [comp](Compiled::Node node) {
+      comp->nodes.push_back(node);
+      return std::optional<int>((int)comp->nodes.size() - 1);
+    };
+  auto Rec = [&](const std::shared_ptr<Exp> &c) {
+      return CompileNode(search, c.get(), comp);
+    };
+
+  if (const Bool *b = std::get_if<Bool>(e)) {
+    return Push({.op = 'k', .k = b->b ? 1 : 0});
+  } else if (const Int *i = std::get_if<Int>(e)) {
+    auto io = i->i.ToInt();
+    if (!io.has_value()) return std::nullopt;
+    comp->all_bool = false;
+    return Push({.op = 'k', .k = io.value()});
+  } else if (const Var *v = std::get_if<Var>(e)) {
+    for (int d = 0; d < (int)search.digits.size(); d++) {
+      if (search.digits[d].var == v->v) {
+        if (!search.digits[d].is_bool) comp->all_bool = false;
+        return Push({.op = 'v', .a = d});
+      }
+    }
+    return std::nullopt;
+  } else if (const Unop *u = std::get_if<Unop>(e)) {
+    if (u->op != '!' && u->op != '-') return std::nullopt;
+    if (u->op == '-') comp->all_bool = false;
+    auto a = Rec(u->arg);
+    if (!a.has_value()) return std::nullopt;
+    return Push({.op = u->op == '!' ? (uint8_t)'~' : (uint8_t)'n',
+                 .a = a.value()});
+  } else if (const Binop *b = std::get_if<Binop>(e)) {
+    switch (b->op) {
+    case '&': case '|': case '=':
+      break;
+    case '<': case '>': case '+': case '-': case '*': case '/': case '%':
+      comp->all_bool = false;
+      break;
+    default:
+      return std::nullopt;
+    }
+    auto a1 = Rec(b->arg1);
+    if (!a1.has_value()) return std::nullopt;
+    auto a2 = Rec(b->arg2);
+    if (!a2.has_value()) return std::nullopt;
+    return Push({.op = b->op, .a = a1.value(), .b = a2.value()});
+  } else if (const If *i = std::get_if<If>(e)) {
+    auto c = Rec(i->cond);
+    if (!c.has_value()) return std::nullopt;
+    auto t = Rec(i->t);
+    if (!t.has_value()) return std::nullopt;
+    auto f = Rec(i->f);
+    if (!f.has_value()) return std::nullopt;
+    return Push({.op = '?', .a = c.value(), .b = t.value(), .c = f.value()});
+  }
+  return std::nullopt;
+}
+
+static std::optional<Compiled> Compile(const Search &search) {
+  Compiled comp;
+  for (const Digit &d : search.digits) {
+    auto wo = d.weight.ToInt();
+    // Brute force can't get anywhere near these anyway.
+    if (!wo.has_value()) return std::nullopt;
+    comp.weight.push_back(wo.value());
+    comp.base.push_back(d.base);
+    comp.offset.push_back(d.offset);
+    // Bit-slicing requires the digits to be actual bits.
+    if (!d.is_bool || (wo.value() & (wo.value() - 1)) != 0)
+      comp.all_bool = false;
+  }
+  if (!CompileNode(search, search.cond.get(), &comp).has_value())
+    return std::nullopt;
+  return {comp};
+}
+
+// Evaluate for a single n. Arithmetic is int64, which is fine for
+// the small digits we get out of these puzzles.
+static bool EvalScalar(const Compiled &comp, int64_t n,
+                       std::vector<int64_t> *scratch) {
+  std::vector<int64_t> &val = *scratch;
+  val.resize(comp.nodes.size());
+  for (int i = 0; i < (int)comp.nodes.size(); i++) {
+    const Compiled::Node &node = comp.nodes[i];
+    int64_t a = val[node.a], b = val[node.b];
+    switch (node.op) {
+    case 'k': val[i] = node.k; break;
+    case 'v': {
+      const int d = node.a;
+      int64_t digit = (n / comp.weight[d]) % comp.base[d];
+      // Bools are (< 0 digit).
+      val[i] = comp.offset[d] + digit;
+      break;
+    }
+    case '~': val[i] = !a; break;
+    case 'n': val[i] = -a; break;
+    case '&': val[i] = a && b; break;
+    case '|': val[i] = a || b; break;
+    case '=': val[i] = a == b; break;
+    case '<': val[i] = a < b; break;
+    case '>': val[i] = a > b; break;
+    case '+': val[i] = a + b; break;
+    case '-': val[i] = a - b; break;
+    case '*': val[i] = a * b; break;
+    case '/': val[i] = b == 0 ? 0 : a / b; break;
+    case '%': val[i] = b == 0 ? 0 : a % b; break;
+    case '?': val[i] = a ? val[node.b] : val[node.c]; break;
+    default: LOG(FATAL) << "bad op";
+    }
+  }
+  return val.back() != 0;
+}
+
+// Evaluate for the 64 values base..base+63, where base is a multiple
+// of 64. Bit j of the result is set if base+j satisfies the
+// constraint.
+static uint64_t EvalSliced(const Compiled &comp, uint64_t base,
+                           std::vector<uint64_t> *scratch) {
+  // Bit i of n, for n in base..base+63.
+  static constexpr uint64_t LOW_BITS[6] = {
+    0xAAAAAAAAAAAAAAAAULL, 0xCCCCCCCCCCCCCCCCULL, 0xF0F0F0F0F0F0F0F0ULL,
+    0xFF00FF00FF00FF00ULL, 0xFFFF0000FFFF0000ULL, 0xFFFFFFFF00000000ULL,
+  };
+
+  std::vector<uint64_t> &val = *scratch;
+  val.resize(comp.nodes.size());
+  for (int i = 0; i < (int)comp.nodes.size(); i++) {
+    const Compiled::Node &node = comp.nodes[i];
+    const uint64_t a = val[node.a], b = val[node.b];
+    switch (node.op) {
+    case 'k': val[i] = node.k ? ~uint64_t{0} : 0; break;
+    case 'v': {
+      const int bit = std::countr_zero((uint64_t)comp.weight[node.a]);
+      if (bit < 6) {
+        val[i] = LOW_BITS[bit];
+      } else {
+        val[i] = bit < 64 && ((base >> bit) & 1) ? ~uint64_t{0} : 0;
+      }
+      break;
+    }
+    case '~': val[i] = ~a; break;
+    case '&': val[i] = a & b; break;
+    case '|': val[i] = a | b; break;
+    case '=': val[i] = ~(a ^ b); break;
+    case '?': val[i] = (a & val[node.b]) | (~a & val[node.c]); break;
+    default: LOG(FATAL) << "bad op for bit slicing";
+    }
+  }
+  return val.back();
+}
+
+// Find the smallest n >= start satisfying the constraint, trying at
+// most max_n. Work is split into chunks of 64 * BLOCKS candidates
+// and farmed out in order; the first batch with a hit has the
+// answer.
+static std::optional<BigInt> BruteForce(const Search &search,
+                                        const Compiled &comp,
+                                        uint64_t max_n) {
+  auto so = search.start.ToInt();
+  if (!so.has_value() || so.value() < 0) return std::nullopt;
+  const uint64_t start = so.value();
+
+  const int threads = std::max(1, (int)std::thread::hardware_concurrency());
+  static constexpr uint64_t BLOCKS = 4096;
+  static constexpr uint64_t CHUNK = 64 * BLOCKS;
+
+  fprintf(stderr, "Brute force (%s) with %d threads...\n",
+          comp.all_bool ? "bit-parallel" : "scalar", threads);
+
+  Periodically status_per(5.0);
+  Timer timer;
+  for (uint64_t batch_start = start & ~uint64_t{63};
+       batch_start <= max_n;
+       batch_start += CHUNK * threads) {
+    std::vector<std::optional<uint64_t>> found(threads);
+    ParallelComp(threads, [&](int64_t t) {
+        const uint64_t lo = batch_start + t * CHUNK;
+        if (comp.all_bool) {
+          std::vector<uint64_t> scratch;
+          for (uint64_t block = lo; block < lo + CHUNK; block += 64) {
+            uint64_t hits = EvalSliced(comp, block, &scratch);
+            if (block < start) hits &= ~uint64_t{0} << (start - block);
+            if (hits != 0) {
+              found[t] = {block + std::countr_zero(hits)};
+              return;
+            }
+          }
+        } else {
+          std::vector<int64_t> scratch;
+          for (uint64_t n = std::max(lo, start); n < lo + CHUNK; n++) {
+            if (EvalScalar(comp, (int64_t)n, &scratch)) {
+              found[t] = {n};
+              return;
+            }
+          }
+        }
+      }, threads);
+
+    for (const auto &f : found) {
+      if (f.has_value()) return {BigInt{f.value()}};
+    }
+
+    if (status_per.ShouldRun()) {
+      fprintf(stderr, ANSI_UP "%s\n",
+              ANSI::ProgressBar(batch_start, max_n,
+                                "brute force", timer.Seconds()).c_str());
+    }
+  }
+  return std::nullopt;
+}
+
+// Run the actual function (with self replaced by something that
+// fails) on n, which should give back n.
+static bool Verify(const Search &search, const BigInt &n) {
+  auto fail = std::make_shared<Exp>(Lambda{
+      .v = search.n_var,
+      .body = std::make_shared<Exp>(String{.s = "wrong"})});
+  auto exp = std::make_shared<Exp>(Binop{
+      .op = '$',
+      .arg1 = std::make_shared<Exp>(Binop{
+          .op = '$', .arg1 = search.fn, .arg2 = fail}),
+      .arg2 = std::make_shared<Exp>(Int{.i = n})});
+
+  Evaluation evaluation;
+  Value v = evaluation.Eval(exp);
+  const Int *i = std::get_if<Int>(&v);
+  return i != nullptr && i->i == n;
+}
+
+int main(int argc, char **argv) {
+  ANSI::Init();
+
+  std::string solver = "z3";
+  bool print_smt = false;
+  uint64_t max_n = uint64_t{1} << 40;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-smt") {
+      print_smt = true;
+    } else if (arg == "-solver") {
+      CHECK(i + 1 < argc);
+      solver = argv[++i];
+    } else if (arg == "-max") {
+      CHECK(i + 1 < argc);
+      max_n = strtoull(argv[++i], nullptr, 10);
+    } else {
+      fprintf(stderr,
+              "./efficiency.exe [-smt] [-solver z3] [-max n] "
+              "< efficiencyN.icfp\n"
+              "  -smt: Just print the SMT-LIB2 problem.\n"
+              "  -solver: Command for the solver; \"\" means brute force.\n"
+              "  -max: Give up brute force after this many.\n");
+      return -1;
+    }
+  }
+
+  std::string input = ReadAllInput();
+  std::string_view input_view(input);
+  Parser parser;
+  std::shared_ptr<Exp> exp = parser.ParseLeadingExp(&input_view);
+  CHECK(input_view.empty()) << "extra stuff after expression?";
+
+  std::string why;
+  std::optional<Search> so = Recognize(exp, &why);
+  CHECK(so.has_value()) << "Not a search I recognize: " << why;
+  const Search &search = so.value();
+  fprintf(stderr, "Search from " AYELLOW("%s") " over " ACYAN("%d")
+          " digits.\n", search.start.ToString().c_str(),
+          (int)search.digits.size());
+
+  std::optional<std::string> smt = MakeSMT(search, &why);
+  if (print_smt) {
+    CHECK(smt.has_value()) << "Can't translate: " << why;
+    printf("%s", smt.value().c_str());
+    return 0;
+  }
+
+  std::optional<BigInt> answer;
+  Timer timer;
+  if (!solver.empty() && smt.has_value()) {
+    answer = SolveWithSMT(search, solver, smt.value());
+  } else if (!smt.has_value()) {
+    fprintf(stderr, "No SMT translation (%s).\n", why.c_str());
+  }
+
+  if (answer.has_value() && !Verify(search, answer.value())) {
+    fprintf(stderr, "The evaluator disagrees with the solver's answer "
+            "%s.\n", answer.value().ToString().c_str());
+    answer.reset();
+  }
+
+  if (!answer.has_value()) {
+    std::optional<Compiled> comp = Compile(search);
+    CHECK(comp.has_value()) << "Can't brute force this one either.";
+    answer = BruteForce(search, comp.value(), max_n);
+  }
+
+  CHECK(answer.has_value()) << "No solution found.";
+  CHECK(Verify(search, answer.value())) << "The evaluator disagrees "
+    "with the answer " << answer.value().ToString();
+  fprintf(stderr, "Verified in %s.\n", ANSI::Time(timer.Seconds()).c_str());
+
+  printf("%s\n", answer.value().ToString().c_str());
+  return 0;
+}
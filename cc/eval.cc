@@ -4,13 +4,46 @@
 #include <string>
 #include <string_view>
 #include <cstdio>
+#include <cstdlib>
 #include <memory>
 
 #include "base/logging.h"
+#include "graph-eval.h"
 
 using namespace icfp;
 
 int main(int argc, char **argv) {
+  bool graph = false;
+  bool memo = false;
+  bool stats = false;
+  int threads = 0;
+  int64_t max_cached_bytes = -1;
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "-graph") {
+      graph = true;
+    } else if (std::string(argv[i]) == "-memo") {
+      memo = true;
+    } else if (std::string(argv[i]) == "-threads" && i + 1 < argc) {
+      threads = atoi(argv[++i]);
+    } else if (std::string(argv[i]) == "-stats") {
+      stats = true;
+    } else if (std::string(argv[i]) == "-max-cached-bytes" && i + 1 < argc) {
+      max_cached_bytes = atoll(argv[++i]);
+    } else {
+      fprintf(stderr, "./eval.exe [-graph | -memo] [-threads n] [-stats] "
+              "[-max-cached-bytes n] < program.icfp\n"
+              "  -graph: Use the graph reduction evaluator.\n"
+              "  -memo: Memoize pure recursive integer functions.\n"
+              "  -threads: Evaluate operands in parallel with n workers.\n"
+              "  -stats: Print memory accounting when done.\n"
+              "  -max-cached-bytes: Recompute rather than cache values "
+              "bigger than this.\n");
+      return -1;
+    }
+  }
+
+  memory_counters.enabled = stats;
+
   std::string input = ReadAllInput();
   std::string_view input_view(input);
 
@@ -23,9 +56,37 @@ int main(int argc, char **argv) {
                             << (exp.get() == nullptr ? "nullptr" :
                                 PrettyExp(exp.get()));
 
+  if (graph) {
+    GraphEvaluation evaluation;
+    Value v = evaluation.Eval(exp);
+    printf("%s\n", ValueString(v).c_str());
+    fprintf(stderr, "%lld betas, %lld thunks (%lld shared)\n",
+            (long long)evaluation.betas, (long long)evaluation.thunks,
+            (long long)evaluation.thunk_hits);
+    return 0;
+  }
+
   Evaluation evaluation;
+  evaluation.max_cached_bytes = max_cached_bytes;
+  evaluation.threads = threads;
+  if (memo) {
+    int fired = 0;
+    exp = MemoizeRecursion(exp, &evaluation.next_var, &fired);
+    fprintf(stderr, "Memoized %d recursive function(s).\n", fired);
+  }
   Value v = evaluation.Eval(exp);
 
   printf("%s\n", ValueString(v).c_str());
+  if (memo) {
+    fprintf(stderr, "%lld betas, %lld memo hits, %lld misses\n",
+            (long long)evaluation.betas, (long long)evaluation.memo_hits,
+            (long long)evaluation.memo_misses);
+  }
+  if (stats) {
+    fprintf(stderr, "%lld betas, %lld uncached, %lld forks\nLive: %s\n",
+            (long long)evaluation.betas, (long long)evaluation.uncached,
+            (long long)evaluation.forks,
+            MemoryCountersString().c_str());
+  }
   return 0;
 }
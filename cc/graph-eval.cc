@@ -0,0 +1,532 @@
+
+#include "graph-eval.h"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "base/logging.h"
+#include "base/stringprintf.h"
+
+#include "icfp.h"
+
+namespace icfp {
+
+// Full laziness.
+
+namespace {
+struct Floated {
+  std::shared_ptr<Exp> exp;
+  // Free variables of exp.
+  std::unordered_set<int64_t> fvs;
+  // True if none of the free variables are bound between the
+  // lambda we're floating out of and here.
+  bool floatable = false;
+};
+}  // namespace
+
+// Things that it does not pay to share, because they are already
+// values (or just a lookup).
+static bool IsCheap(const Exp *e) {
+  if (std::holds_alternative<Bool>(*e) ||
+      std::holds_alternative<Int>(*e) ||
+      std::holds_alternative<String>(*e) ||
+      std::holds_alternative<Var>(*e) ||
+      std::holds_alternative<Lambda>(*e)) return true;
+  if (const Memo *m = std::get_if<Memo>(e)) {
+    return m->done.get() != nullptr;
+  }
+  return false;
+}
+
+static std::shared_ptr<Exp> Float(std::shared_ptr<Exp> e, int64_t *next_var);
+
+// Find the maximal free expressions of exp, where "bound" are the
+// variables bound between the lambda and here. Non-maximal ones are
+// left in place; maximal ones are replaced with fresh variables and
+// added to lets.
+static Floated Extract(
+    std::shared_ptr<Exp> exp,
+    std::vector<int64_t> *bound,
+    std::vector<std::pair<int64_t, std::shared_ptr<Exp>>> *lets,
+    int64_t *next_var) {
+
+  auto IsFloatable = [bound](const std::unordered_set<int64_t> &fvs) {
+      for (int64_t v : *bound)
+        if (fvs.contains(v)) return false;
+      return true;
+    };
+
+  // If the child is maximal (floatable but the parent isn't), float it.
+  auto Take = [lets, next_var](Floated *child) {
+      if (child->floatable && !IsCheap(child->exp.get())) {
+        const int64_t v = (*next_var)--;
+        lets->emplace_back(v, std::move(child->exp));
+        child->exp = NewExp(Var{.v = v});
+      }
+    };
+
+  const Exp *e = exp.get();
+  if (std::holds_alternative<Bool>(*e) ||
+      std::holds_alternative<Int>(*e) ||
+      std::holds_alternative<String>(*e)) {
+    return Floated{.exp = exp, .fvs = {}, .floatable = true};
+
+  } else if (const Var *var = std::get_if<Var>(e)) {
+    std::unordered_set<int64_t> fvs = {var->v};
+    bool fl = IsFloatable(fvs);
+    return Floated{.exp = exp, .fvs = std::move(fvs), .floatable = fl};
+
+  } else if (const Unop *u = std::get_if<Unop>(e)) {
+    Floated arg = Extract(u->arg, bound, lets, next_var);
+    if (arg.floatable) {
+      return Floated{.exp = exp, .fvs = std::move(arg.fvs),
+                     .floatable = true};
+    }
+    return Floated{
+      .exp = NewExp(Unop{.op = u->op, .arg = arg.exp}),
+      .fvs = std::move(arg.fvs),
+      .floatable = false};
+
+  } else if (const Binop *b = std::get_if<Binop>(e)) {
+    Floated arg1 = Extract(b->arg1, bound, lets, next_var);
+    Floated arg2 = Extract(b->arg2, bound, lets, next_var);
+    std::unordered_set<int64_t> fvs = std::move(arg1.fvs);
+    for (int64_t v : arg2.fvs) fvs.insert(v);
+    if (arg1.floatable && arg2.floatable) {
+      return Floated{.exp = exp, .fvs = std::move(fvs), .floatable = true};
+    }
+    Take(&arg1);
+    Take(&arg2);
+    return Floated{
+      .exp = NewExp(Binop{
+          .op = b->op, .arg1 = arg1.exp, .arg2 = arg2.exp}),
+      .fvs = std::move(fvs),
+      .floatable = false};
+
+  } else if (const If *i = std::get_if<If>(e)) {
+    Floated cond = Extract(i->cond, bound, lets, next_var);
+    Floated t = Extract(i->t, bound, lets, next_var);
+    Floated f = Extract(i->f, bound, lets, next_var);
+    std::unordered_set<int64_t> fvs = std::move(cond.fvs);
+    for (int64_t v : t.fvs) fvs.insert(v);
+    for (int64_t v : f.fvs) fvs.insert(v);
+    if (cond.floatable && t.floatable && f.floatable) {
+      return Floated{.exp = exp, .fvs = std::move(fvs), .floatable = true};
+    }
+    Take(&cond);
+    Take(&t);
+    Take(&f);
+    return Floated{
+      .exp = NewExp(If{
+          .cond = cond.exp, .t = t.exp, .f = f.exp}),
+      .fvs = std::move(fvs),
+      .floatable = false};
+
+  } else if (const Lambda *lam = std::get_if<Lambda>(e)) {
+    bound->push_back(lam->v);
+    Floated body = Extract(lam->body, bound, lets, next_var);
+    bound->pop_back();
+    body.fvs.erase(lam->v);
+    const bool fl = IsFloatable(body.fvs);
+    if (fl) {
+      return Floated{.exp = exp, .fvs = std::move(body.fvs),
+                     .floatable = true};
+    }
+    // The body itself can't be floatable here, since it mentions
+    // something bound outside this lambda.
+    return Floated{
+      .exp = NewExp(Lambda{.v = lam->v, .body = body.exp}),
+      .fvs = std::move(body.fvs),
+      .floatable = false};
+
+  } else if (const Memo *m = std::get_if<Memo>(e)) {
+    if (m->done.get() != nullptr) {
+      return Floated{.exp = exp, .fvs = {}, .floatable = true};
+    }
+    // Don't look inside memo cells, since they may be shared.
+    std::unordered_set<int64_t> fvs = Evaluation::FreeVars(e);
+    bool fl = IsFloatable(fvs);
+    return Floated{.exp = exp, .fvs = std::move(fvs), .floatable = fl};
+  }
+
+  LOG(FATAL) << "bug: invalid exp variant";
+  return Floated{};
+}
+
+static std::shared_ptr<Exp> Float(std::shared_ptr<Exp> e, int64_t *next_var) {
+  if (std::holds_alternative<Bool>(*e) ||
+      std::holds_alternative<Int>(*e) ||
+      std::holds_alternative<String>(*e) ||
+      std::holds_alternative<Var>(*e) ||
+      std::holds_alternative<Memo>(*e)) {
+    return e;
+
+  } else if (const Unop *u = std::get_if<Unop>(e.get())) {
+    return NewExp(Unop{
+        .op = u->op, .arg = Float(u->arg, next_var)});
+
+  } else if (const Binop *b = std::get_if<Binop>(e.get())) {
+    return NewExp(Binop{
+        .op = b->op,
+        .arg1 = Float(b->arg1, next_var),
+        .arg2 = Float(b->arg2, next_var)});
+
+  } else if (const If *i = std::get_if<If>(e.get())) {
+    return NewExp(If{
+        .cond = Float(i->cond, next_var),
+        .t = Float(i->t, next_var),
+        .f = Float(i->f, next_var)});
+
+  } else if (const Lambda *lam = std::get_if<Lambda>(e.get())) {
+    // Inside out, so that anything floated out of inner lambdas
+    // can continue floating out of this one.
+    std::shared_ptr<Exp> body = Float(lam->body, next_var);
+
+    std::vector<int64_t> bound = {lam->v};
+    std::vector<std::pair<int64_t, std::shared_ptr<Exp>>> lets;
+    Floated fl = Extract(body, &bound, &lets, next_var);
+    if (fl.floatable && !IsCheap(fl.exp.get())) {
+      // The whole body is independent of the argument.
+      const int64_t v = (*next_var)--;
+      lets.emplace_back(v, std::move(fl.exp));
+      fl.exp = NewExp(Var{.v = v});
+    }
+
+    std::shared_ptr<Exp> ret =
+      NewExp(Lambda{.v = lam->v, .body = fl.exp});
+    // The floated expressions are disjoint, so they don't refer to
+    // one another and the order doesn't matter.
+    for (auto &[v, rhs] : lets) {
+      ret = NewExp(Binop{
+          .op = '$',
+          .arg1 = NewExp(Lambda{.v = v, .body = ret}),
+          .arg2 = std::move(rhs)});
+    }
+    return ret;
+  }
+
+  LOG(FATAL) << "bug: invalid exp variant";
+  return nullptr;
+}
+
+std::shared_ptr<Exp> FullyLazy(std::shared_ptr<Exp> exp, int64_t *next_var) {
+  return Float(std::move(exp), next_var);
+}
+
+// Graph evaluation.
+
+// Compiled terms. Variables are resolved to the current argument or
+// a slot in the closure's captured environment.
+struct GraphEvaluation::Term {
+  struct Const { Value value; };
+  struct Arg { };
+  struct Capture { int idx = 0; };
+  struct Free { int64_t v = 0; };
+  struct Unop { uint8_t op = 0; const Term *arg = nullptr; };
+  struct Binop {
+    uint8_t op = 0;
+    const Term *arg1 = nullptr, *arg2 = nullptr;
+  };
+  struct If { const Term *cond = nullptr, *t = nullptr, *f = nullptr; };
+  struct Lambda {
+    // Where each captured slot comes from in the enclosing frame:
+    // -1 for its argument, otherwise the index of its capture.
+    std::vector<int> captures;
+    const Term *body = nullptr;
+    // For returning lambdas as values.
+    const icfp::Lambda *source = nullptr;
+  };
+
+  std::variant<Const, Arg, Capture, Free, Unop, Binop, If, Lambda> t;
+};
+
+using TConst = GraphEvaluation::Term::Const;
+using TArg = GraphEvaluation::Term::Arg;
+using TCapture = GraphEvaluation::Term::Capture;
+using TFree = GraphEvaluation::Term::Free;
+using TUnop = GraphEvaluation::Term::Unop;
+using TBinop = GraphEvaluation::Term::Binop;
+using TIf = GraphEvaluation::Term::If;
+using TLambda = GraphEvaluation::Term::Lambda;
+struct GraphEvaluation::Frame {
+  std::shared_ptr<const std::vector<std::shared_ptr<Thunk>>> captured;
+  std::shared_ptr<Thunk> arg;
+};
+
+struct GraphEvaluation::Closure {
+  const TLambda *lam = nullptr;
+  std::shared_ptr<const std::vector<std::shared_ptr<Thunk>>> captured;
+};
+
+// The value, and the closure if it is a lambda.
+struct GraphEvaluation::Result {
+  Value value;
+  std::shared_ptr<Closure> closure;
+};
+
+struct GraphEvaluation::Thunk {
+  // Until forced.
+  const Term *term = nullptr;
+  Frame frame;
+  // Set while being evaluated, to detect loops.
+  bool blackhole = false;
+  std::optional<Result> result;
+};
+
+// During compilation, the lambdas we're inside.
+struct GraphEvaluation::Scope {
+  // nullopt for the top level, which has no argument.
+  std::optional<int64_t> arg;
+  std::unordered_map<int64_t, int> capture_index;
+  std::vector<int> captures;
+};
+
+GraphEvaluation::GraphEvaluation() {}
+GraphEvaluation::~GraphEvaluation() {}
+
+const GraphEvaluation::Term *GraphEvaluation::NewTerm(Term t) {
+  arena.push_back(std::make_unique<Term>(std::move(t)));
+  return arena.back().get();
+}
+
+// Returns -1 for the argument of scope[depth], an index into its
+// captures, or -2 if the variable is free.
+int GraphEvaluation::Resolve(int64_t v, std::vector<Scope> *scopes,
+                             int depth) {
+  Scope *scope = &(*scopes)[depth];
+  if (scope->arg.has_value() && scope->arg.value() == v) return -1;
+  if (auto it = scope->capture_index.find(v);
+      it != scope->capture_index.end())
+    return it->second;
+  if (depth == 0) return -2;
+  const int outer = Resolve(v, scopes, depth - 1);
+  if (outer == -2) return -2;
+  // The vector may have moved during recursion.
+  scope = &(*scopes)[depth];
+  const int idx = (int)scope->captures.size();
+  scope->captures.push_back(outer);
+  scope->capture_index[v] = idx;
+  return idx;
+}
+
+const GraphEvaluation::Term *GraphEvaluation::Compile(
+    const Exp *e, std::vector<Scope> *scopes) {
+  if (const Bool *b = std::get_if<Bool>(e)) {
+    return NewTerm(Term{TConst{.value = Value(*b)}});
+
+  } else if (const Int *i = std::get_if<Int>(e)) {
+    return NewTerm(Term{TConst{.value = Value(*i)}});
+
+  } else if (const String *s = std::get_if<String>(e)) {
+    return NewTerm(Term{TConst{.value = Value(*s)}});
+
+  } else if (const Unop *u = std::get_if<Unop>(e)) {
+    return NewTerm(Term{TUnop{
+          .op = u->op, .arg = Compile(u->arg.get(), scopes)}});
+
+  } else if (const Binop *b = std::get_if<Binop>(e)) {
+    const Term *arg1 = Compile(b->arg1.get(), scopes);
+    const Term *arg2 = Compile(b->arg2.get(), scopes);
+    return NewTerm(Term{TBinop{.op = b->op, .arg1 = arg1, .arg2 = arg2}});
+
+  } else if (const If *i = std::get_if<If>(e)) {
+    const Term *cond = Compile(i->cond.get(), scopes);
+    const Term *t = Compile(i->t.get(), scopes);
+    const Term *f = Compile(i->f.get(), scopes);
+    return NewTerm(Term{TIf{.cond = cond, .t = t, .f = f}});
+
+  } else if (const Lambda *lam = std::get_if<Lambda>(e)) {
+    scopes->push_back(Scope{.arg = {lam->v}});
+    const Term *body = Compile(lam->body.get(), scopes);
+    std::vector<int> captures = std::move(scopes->back().captures);
+    scopes->pop_back();
+    return NewTerm(Term{TLambda{
+          .captures = std::move(captures),
+          .body = body,
+          .source = lam}});
+
+  } else if (const Var *var = std::get_if<Var>(e)) {
+    const int idx = Resolve(var->v, scopes, (int)scopes->size() - 1);
+    if (idx == -2) return NewTerm(Term{TFree{.v = var->v}});
+    if (idx == -1) return NewTerm(Term{TArg{}});
+    return NewTerm(Term{TCapture{.idx = idx}});
+
+  } else if (const Memo *m = std::get_if<Memo>(e)) {
+    if (m->done.get() != nullptr) {
+      if (const Lambda *lam = std::get_if<Lambda>(m->done.get())) {
+        // Terms point into the source, so keep it alive.
+        sources.push_back(NewExp(*lam));
+        return Compile(sources.back().get(), scopes);
+      }
+      return NewTerm(Term{TConst{.value = *m->done}});
+    }
+    CHECK(m->todo.get() != nullptr);
+    return Compile(m->todo.get(), scopes);
+  }
+
+  LOG(FATAL) << "bug: invalid exp variant";
+  return nullptr;
+}
+
+std::shared_ptr<GraphEvaluation::Thunk> GraphEvaluation::Delay(
+    const Term *term, const Frame &frame) {
+  // Variables are already thunks, so share them rather than adding
+  // indirection.
+  if (std::holds_alternative<TArg>(term->t)) {
+    CHECK(frame.arg.get() != nullptr);
+    return frame.arg;
+  } else if (const TCapture *c = std::get_if<TCapture>(&term->t)) {
+    return (*frame.captured)[c->idx];
+  }
+
+  thunks++;
+  auto thunk = std::make_shared<Thunk>();
+  if (const TConst *k = std::get_if<TConst>(&term->t)) {
+    thunk->result = {Result{.value = k->value, .closure = nullptr}};
+  } else {
+    thunk->term = term;
+    thunk->frame = frame;
+  }
+  return thunk;
+}
+
+GraphEvaluation::Result GraphEvaluation::Force(
+    const std::shared_ptr<Thunk> &thunk) {
+  if (thunk->result.has_value()) {
+    thunk_hits++;
+    return thunk->result.value();
+  }
+
+  if (thunk->blackhole) {
+    return Result{.value = Value(Error{.msg = "<<loop>>"})};
+  }
+
+  thunk->blackhole = true;
+  Result r = EvalTerm(thunk->term, thunk->frame);
+  thunk->blackhole = false;
+  thunk->result = {r};
+  // Drop the environment so that it can be freed.
+  thunk->term = nullptr;
+  thunk->frame = Frame{};
+  return r;
+}
+
+GraphEvaluation::Result GraphEvaluation::EvalTerm(
+    const Term *term, Frame frame) {
+  auto Err = [](std::string msg) {
+      return Result{.value = Value(Error{.msg = std::move(msg)})};
+    };
+
+  for (;;) {
+    if (const TConst *k = std::get_if<TConst>(&term->t)) {
+      return Result{.value = k->value};
+
+    } else if (std::holds_alternative<TArg>(term->t)) {
+      return Force(frame.arg);
+
+    } else if (const TCapture *c = std::get_if<TCapture>(&term->t)) {
+      return Force((*frame.captured)[c->idx]);
+
+    } else if (const TFree *f = std::get_if<TFree>(&term->t)) {
+      return Err(StringPrintf("unbound variable %lld", f->v));
+
+    } else if (const TUnop *u = std::get_if<TUnop>(&term->t)) {
+      Result arg = EvalTerm(u->arg, frame);
+      return Result{.value = StrictUnop(u->op, arg.value)};
+
+    } else if (const TBinop *b = std::get_if<TBinop>(&term->t)) {
+
+      if (b->op == '$' || b->op == '!') {
+        Result fn = EvalTerm(b->arg1, frame);
+        if (std::holds_alternative<Error>(fn.value)) return fn;
+        if (fn.closure.get() == nullptr) return Err("Expected lambda");
+
+        std::shared_ptr<Thunk> arg;
+        if (b->op == '$') {
+          arg = Delay(b->arg2, frame);
+        } else {
+          // Secret call-by-value version of application.
+          Result r = EvalTerm(b->arg2, frame);
+          if (std::holds_alternative<Error>(r.value)) return r;
+          arg = std::make_shared<Thunk>();
+          arg->result = {std::move(r)};
+        }
+
+        betas++;
+        term = fn.closure->lam->body;
+        frame = Frame{.captured = fn.closure->captured,
+                      .arg = std::move(arg)};
+        // Tail recursion.
+        continue;
+      }
+
+      // Otherwise, strict in both arguments. Like Evaluation, we
+      // evaluate left to right, and don't evaluate the second if the
+      // first is an error or has the wrong type.
+      Result arg1 = EvalTerm(b->arg1, frame);
+      if (!BinopNeedsArg2(b->op, arg1.value)) {
+        return Result{.value =
+          StrictBinop(b->op, arg1.value, Value(Bool{.b = false}))};
+      }
+      Result arg2 = EvalTerm(b->arg2, frame);
+      return Result{.value = StrictBinop(b->op, arg1.value, arg2.value)};
+
+    } else if (const TIf *i = std::get_if<TIf>(&term->t)) {
+      Result cond = EvalTerm(i->cond, frame);
+      if (const Bool *b = std::get_if<Bool>(&cond.value)) {
+        term = b->b ? i->t : i->f;
+        continue;
+      } else if (std::holds_alternative<Error>(cond.value)) {
+        return cond;
+      } else {
+        return Err("Expected bool");
+      }
+
+    } else if (const TLambda *lam = std::get_if<TLambda>(&term->t)) {
+      auto captured = std::make_shared<std::vector<std::shared_ptr<Thunk>>>();
+      captured->reserve(lam->captures.size());
+      for (int src : lam->captures) {
+        if (src == -1) {
+          captured->push_back(frame.arg);
+        } else {
+          captured->push_back((*frame.captured)[src]);
+        }
+      }
+
+      auto closure = std::make_shared<Closure>();
+      closure->lam = lam;
+      closure->captured = std::move(captured);
+      return Result{.value = Value(*lam->source),
+                    .closure = std::move(closure)};
+    }
+
+    LOG(FATAL) << "bug: invalid term";
+  }
+}
+
+Value GraphEvaluation::Eval(std::shared_ptr<Exp> exp) {
+  if (fully_lazy) {
+    exp = FullyLazy(exp, &next_var);
+  }
+  sources.push_back(exp);
+
+  std::vector<Scope> scopes;
+  scopes.push_back(Scope{.arg = std::nullopt});
+  const Term *term = Compile(exp.get(), &scopes);
+  CHECK(scopes.size() == 1 && scopes[0].captures.empty());
+
+  Frame top{
+    .captured =
+    std::make_shared<const std::vector<std::shared_ptr<Thunk>>>(),
+    .arg = nullptr,
+  };
+  return EvalTerm(term, top).value;
+}
+
+}  // namespace icfp
@@ -0,0 +1,76 @@
+#ifndef GRAPH_EVAL_H_
+#define GRAPH_EVAL_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "icfp.h"
+
+namespace icfp {
+
+// Full laziness transformation. Any maximal subexpression of a lambda
+// body that does not mention the lambda's argument (or any variable
+// bound between the lambda and the subexpression) is floated out as a
+// let (i.e. B$ (Lm ...) e) that wraps the lambda. This means the
+// subexpression is computed at most once per closure, rather than
+// once per application. Fresh variables are taken from *next_var,
+// which counts down from -1 like Evaluation::next_var; pass the
+// evaluation's counter if you plan to run the result with
+// substitution.
+std::shared_ptr<Exp> FullyLazy(std::shared_ptr<Exp> exp, int64_t *next_var);
+
+// Alternative to Evaluation: compiles the expression to a graph with
+// flat closures and shared thunks, and then evaluates it with an
+// environment machine (call-by-need). There is no substitution, so
+// applying a partially-applied function does not copy its body, and
+// the arguments it captured stay shared between all uses. Combined
+// with FullyLazy, redexes under binders are shared too.
+//
+// Same observable behavior as Evaluation for programs that produce
+// base values. A lambda result is returned as its source expression,
+// without its environment.
+struct GraphEvaluation {
+  GraphEvaluation();
+  ~GraphEvaluation();
+
+  // Number of beta redices performed.
+  int64_t betas = 0;
+  // Number of thunks created and number of times we found one
+  // already evaluated.
+  int64_t thunks = 0;
+  int64_t thunk_hits = 0;
+
+  // If true, apply FullyLazy before compiling.
+  bool fully_lazy = true;
+
+  // Evaluate to a value.
+  Value Eval(std::shared_ptr<Exp> exp);
+
+  // Internal; defined in graph-eval.cc.
+  struct Term;
+  struct Thunk;
+  struct Closure;
+  struct Frame;
+  struct Result;
+  struct Scope;
+
+ private:
+  const Term *Compile(const Exp *e, std::vector<Scope> *scopes);
+  const Term *NewTerm(Term t);
+  int Resolve(int64_t v, std::vector<Scope> *scopes, int depth);
+
+  Result EvalTerm(const Term *term, Frame frame);
+  Result Force(const std::shared_ptr<Thunk> &thunk);
+  std::shared_ptr<Thunk> Delay(const Term *term, const Frame &frame);
+
+  // Compiled terms; these live as long as the evaluation.
+  std::vector<std::unique_ptr<Term>> arena;
+  // Keep the source expressions alive, since terms point into them.
+  std::vector<std::shared_ptr<Exp>> sources;
+  int64_t next_var = -1;
+};
+
+}  // namespace icfp
+
+#endif
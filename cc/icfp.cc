@@ -2,6 +2,12 @@
 #include "icfp.h"
 
 #include <unordered_set>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <optional>
 #include <cstdint>
 #include <string>
@@ -12,6 +18,8 @@
 #include <string_view>
 #include <vector>
 
+#include <pthread.h>
+
 #include "base/logging.h"
 #include "base/stringprintf.h"
 #include "util.h"
@@ -27,6 +35,29 @@ static inline int64_t GetInt64(const BigInt &i) {
   return io.value();
 }
 
+// When any parallel evaluation is running, the fields of memo cells
+// can only be accessed with the cell's lock held. The lock is one
+// of a fixed set of stripes, chosen by address. A stripe also
+// records which evaluation has claimed (is computing) each cell.
+static std::atomic<int> parallel_evaluations = 0;
+static inline bool ParallelActive() {
+  return parallel_evaluations.load(std::memory_order_relaxed) > 0;
+}
+
+namespace {
+struct MemoStripe {
+  std::mutex m;
+  std::condition_variable cv;
+  std::unordered_map<const Memo *, const Evaluation *> claims;
+};
+}  // namespace
+
+static constexpr int NUM_MEMO_STRIPES = 64;
+static MemoStripe memo_stripes[NUM_MEMO_STRIPES];
+static MemoStripe &GetStripe(const Memo *m) {
+  return memo_stripes[((uintptr_t)m >> 4) % NUM_MEMO_STRIPES];
+}
+
 // (size includes terminating \0, unused)
 static constexpr const char DECODE_STRING[RADIX + 1] =
   "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
@@ -133,6 +164,25 @@ static void PopulateFreeVars(const Exp *e, std::unordered_set<int64_t> *fvs) {
 
     } else if (const Memo *m = std::get_if<Memo>(e)) {
 
+      if (ParallelActive()) {
+        // Same as below, but on a copy made with the lock held.
+        std::shared_ptr<std::unordered_set<int64_t>> mfvs;
+        std::shared_ptr<Exp> todo;
+        {
+          MemoStripe &stripe = GetStripe(m);
+          std::unique_lock<std::mutex> ml(stripe.m);
+          if (m->done.get() != nullptr) return;
+          mfvs = m->fvs;
+          todo = m->todo;
+        }
+        if (mfvs.get() != nullptr) {
+          for (int64_t v : *mfvs) fvs->insert(v);
+        } else {
+          PopulateFreeVars(todo.get(), fvs);
+        }
+        return;
+      }
+
       if (m->done.get() != nullptr) {
         // Values have no free variables.
       } else {
@@ -187,12 +237,12 @@ std::shared_ptr<Exp> Evaluation::SubstInternal(
 
   } else if (const Unop *u = std::get_if<Unop>(e2.get())) {
 
-    return std::make_shared<Exp>(
+    return NewExp(
         Unop{.op = u->op, .arg = Subst(e1, v, u->arg)});
 
   } else if (const Binop *b = std::get_if<Binop>(e2.get())) {
 
-    return std::make_shared<Exp>(Binop{
+    return NewExp(Binop{
         .op = b->op,
         .arg1 = Subst(e1, v, b->arg1),
         .arg2 = Subst(e1, v, b->arg2),
@@ -200,7 +250,7 @@ std::shared_ptr<Exp> Evaluation::SubstInternal(
 
   } else if (const If *i = std::get_if<If>(e2.get())) {
 
-    return std::make_shared<Exp>(If{
+    return NewExp(If{
         .cond = Subst(e1, v, i->cond),
         .t = Subst(e1, v, i->t),
         .f = Subst(e1, v, i->f),
@@ -213,22 +263,21 @@ std::shared_ptr<Exp> Evaluation::SubstInternal(
       return e2;
 
     if (simple || !fvs.contains(lam->v)) {
-      return std::make_shared<Exp>(Lambda{
+      return NewExp(Lambda{
           .v = lam->v,
           .body = Subst(e1, v, lam->body),
       });
     } else {
       // Rename target lambda so that we can't have capture.
-      const int64_t new_var = next_var;
-      next_var--;
+      const int64_t new_var = FreshVar();
       std::shared_ptr<Exp> new_var_exp =
-          std::make_shared<Exp>(Var{.v = new_var});
+          NewExp(Var{.v = new_var});
 
       // Simple substitution, since the new variable cannot incur capture.
       std::shared_ptr<Exp> body = Subst(new_var_exp, lam->v, lam->body, true);
 
       // Now do the substitution, which can no longer capture.
-      return std::make_shared<Exp>(Lambda{
+      return NewExp(Lambda{
           .v = new_var,
           .body = Subst(e1, v, body),
       });
@@ -244,6 +293,34 @@ std::shared_ptr<Exp> Evaluation::SubstInternal(
 
   } else if (Memo *m = std::get_if<Memo>(e2.get())) {
 
+    if (ParallelActive()) {
+      // Same as below, but on a copy made with the lock held.
+      MemoStripe &stripe = GetStripe(m);
+      std::shared_ptr<std::unordered_set<int64_t>> mfvs;
+      std::shared_ptr<Exp> todo;
+      {
+        std::unique_lock<std::mutex> ml(stripe.m);
+        if (m->done.get() != nullptr) return e2;
+        mfvs = m->fvs;
+        todo = m->todo;
+      }
+
+      if (mfvs.get() == nullptr) {
+        mfvs = std::make_shared<std::unordered_set<int64_t>>(
+            FreeVars(todo.get()));
+        std::unique_lock<std::mutex> ml(stripe.m);
+        if (m->done.get() == nullptr && m->fvs.get() == nullptr)
+          m->fvs = mfvs;
+      }
+
+      if (!mfvs->contains(v)) return e2;
+      return NewExp(Memo{
+          .fvs = nullptr,
+          .todo = Subst(e1, v, todo, false),
+          .done = nullptr,
+        });
+    }
+
     if (m->done.get() != nullptr) {
       // Values have no free variables.
       return e2;
@@ -262,7 +339,7 @@ std::shared_ptr<Exp> Evaluation::SubstInternal(
       if (m->fvs->contains(v)) {
         // Have to create a new memo cell, then.
         std::shared_ptr<Exp> s = Subst(e1, v, m->todo, false);
-        return std::make_shared<Exp>(Memo{
+        return NewExp(Memo{
             .fvs = nullptr,
             .todo = std::move(s),
             .done = nullptr,
@@ -280,18 +357,130 @@ std::shared_ptr<Exp> Evaluation::SubstInternal(
   return nullptr;
 }
 
+MemoryCounters memory_counters;
+
+std::string MemoryCountersString() {
+  return StringPrintf("%lld nodes, %lld memo cells, %lld cached values, "
+                      "%lld string bytes, %lld int bytes "
+                      "(peak %lld nodes, %lld bytes)",
+                      (long long)memory_counters.nodes.load(),
+                      (long long)memory_counters.memo_cells.load(),
+                      (long long)memory_counters.cached_values.load(),
+                      (long long)memory_counters.string_bytes.load(),
+                      (long long)memory_counters.int_bytes.load(),
+                      (long long)memory_counters.peak_nodes.load(),
+                      (long long)memory_counters.peak_bytes.load());
+}
+
+static int64_t IntBytes(const BigInt &i) {
+  if (i.ToInt().has_value()) return sizeof (int64_t);
+  return (int64_t)(BigInt::LogBase2(BigInt::Abs(i)) / 8.0) + 1;
+}
+
+int64_t ValueBytes(const Value &v) {
+  if (const String *s = std::get_if<String>(&v)) return s->s.size();
+  if (const Int *i = std::get_if<Int>(&v)) return IntBytes(i->i);
+  return 0;
+}
+
+namespace {
+// Allocator for allocate_shared that remembers what it was used for,
+// so that it can undo the accounting when the block is freed.
+template<class T>
+struct CountingAllocator {
+  using value_type = T;
+
+  int64_t nodes = 0, memo_cells = 0, cached_values = 0;
+  int64_t string_bytes = 0, int_bytes = 0;
+
+  CountingAllocator() {}
+  template<class U>
+  CountingAllocator(const CountingAllocator<U> &other) :
+    nodes(other.nodes), memo_cells(other.memo_cells),
+    cached_values(other.cached_values),
+    string_bytes(other.string_bytes), int_bytes(other.int_bytes) {}
+
+  void Add(int64_t sign) const {
+    memory_counters.nodes.fetch_add(sign * nodes,
+                                    std::memory_order_relaxed);
+    memory_counters.memo_cells.fetch_add(sign * memo_cells,
+                                         std::memory_order_relaxed);
+    memory_counters.cached_values.fetch_add(sign * cached_values,
+                                            std::memory_order_relaxed);
+    memory_counters.string_bytes.fetch_add(sign * string_bytes,
+                                           std::memory_order_relaxed);
+    memory_counters.int_bytes.fetch_add(sign * int_bytes,
+                                        std::memory_order_relaxed);
+    if (sign > 0) {
+      UpdatePeak(&memory_counters.peak_nodes,
+                 memory_counters.nodes.load(std::memory_order_relaxed));
+      UpdatePeak(&memory_counters.peak_bytes,
+                 memory_counters.string_bytes.load(std::memory_order_relaxed) +
+                 memory_counters.int_bytes.load(std::memory_order_relaxed));
+    }
+  }
+
+  static void UpdatePeak(std::atomic<int64_t> *peak, int64_t now) {
+    int64_t old = peak->load(std::memory_order_relaxed);
+    while (now > old &&
+           !peak->compare_exchange_weak(old, now,
+                                        std::memory_order_relaxed)) {}
+  }
+
+  T *allocate(size_t n) {
+    Add(+1);
+    return std::allocator<T>().allocate(n);
+  }
+
+  void deallocate(T *p, size_t n) {
+    Add(-1);
+    std::allocator<T>().deallocate(p, n);
+  }
+
+  template<class U>
+  bool operator ==(const CountingAllocator<U> &other) const { return true; }
+};
+}  // namespace
+
+std::shared_ptr<Exp> NewExp(Exp e) {
+  if (!memory_counters.enabled) return std::make_shared<Exp>(std::move(e));
+  CountingAllocator<Exp> alloc;
+  alloc.nodes = 1;
+  if (const String *s = std::get_if<String>(&e)) {
+    alloc.string_bytes = s->s.size();
+  } else if (const Int *i = std::get_if<Int>(&e)) {
+    alloc.int_bytes = IntBytes(i->i);
+  } else if (std::holds_alternative<Memo>(e)) {
+    alloc.memo_cells = 1;
+  }
+  return std::allocate_shared<Exp>(alloc, std::move(e));
+}
+
+std::shared_ptr<Value> NewValue(Value v) {
+  if (!memory_counters.enabled)
+    return std::make_shared<Value>(std::move(v));
+  CountingAllocator<Value> alloc;
+  alloc.cached_values = 1;
+  if (const String *s = std::get_if<String>(&v)) {
+    alloc.string_bytes = s->s.size();
+  } else if (const Int *i = std::get_if<Int>(&v)) {
+    alloc.int_bytes = IntBytes(i->i);
+  }
+  return std::allocate_shared<Value>(alloc, std::move(v));
+}
+
 std::shared_ptr<Exp> ValueToExp(const Value &v) {
   if (const Bool *b = std::get_if<Bool>(&v)) {
-    return std::make_shared<Exp>(*b);
+    return NewExp(*b);
 
   } else if (const Int *i = std::get_if<Int>(&v)) {
-    return std::make_shared<Exp>(*i);
+    return NewExp(*i);
 
   } else if (const String *s = std::get_if<String>(&v)) {
-    return std::make_shared<Exp>(*s);
+    return NewExp(*s);
 
   } else if (const Lambda *l = std::get_if<Lambda>(&v)) {
-    return std::make_shared<Exp>(*l);
+    return NewExp(*l);
 
   } else if (const Error *err = std::get_if<Error>(&v)) {
     (void)err;
@@ -303,9 +492,241 @@ std::shared_ptr<Exp> ValueToExp(const Value &v) {
   return nullptr;
 }
 
+Value StrictUnop(uint8_t op, const Value &arg) {
+  if (const Error *e = std::get_if<Error>(&arg)) {
+    (void)e;
+    return arg;
+  }
+
+  switch (op) {
+  case '-': {
+    // - Integer negation  U- I$ -> -3
+    if (const Int *i = std::get_if<Int>(&arg)) {
+      return Value(Int{.i = -i->i});
+    }
+    return Value(Error{.msg = "Expected int"});
+  }
+  case '!': {
+    // ! Boolean not U! T -> false
+    if (const Bool *b = std::get_if<Bool>(&arg)) {
+      return Value(Bool{.b = !b->b});
+    }
+    return Value(Error{.msg = "Expected bool"});
+  }
+  case '#': {
+    // # string-to-int: interpret a string as a base-94 number
+    // U# S4%34 -> 15818151
+    const String *s = std::get_if<String>(&arg);
+    if (s == nullptr) {
+      return Value(Error{.msg = "Expected string in #"});
+    }
+
+    // reencode
+    std::string enc;
+    enc.reserve(s->s.size());
+    for (uint8_t c : s->s) {
+      if (c >= 128) {
+        return Value(Error{.msg =
+            "unconvertible string (bad char) in string-to-int"});
+      } else {
+        enc.push_back(ENCODE_STRING[c]);
+      }
+    }
+
+    if (std::optional<BigInt> i = ConvertInt(enc)) {
+      return Value(Int{.i = i.value()});
+    } else {
+      return Value(Error{.msg =
+          "unconvertible string (not int) in string-to-int"});
+    }
+  }
+
+  case '$': {
+    // $ int-to-string: inverse of the above U$ I4%34 -> test
+    const Int *a = std::get_if<Int>(&arg);
+    if (a == nullptr) {
+      return Value(Error{.msg = "Expected int"});
+    }
+
+    if (a->i < 0) {
+      return Value(Error{.msg =
+          "don't know how to convert negative integers to "
+          "base-94?"});
+    }
+
+    std::string rev;
+    BigInt i = a->i;
+    while (i > 0) {
+      uint8_t digit = i % RADIX;
+      rev.push_back(DECODE_STRING[digit]);
+      i /= RADIX;
+    }
+
+    std::string s;
+    s.resize(rev.size());
+    for (int i = 0; i < (int)rev.size(); i++) {
+      s[rev.size() - 1 - i] = rev[i];
+    }
+    return Value(String{.s = s});
+  }
+
+  default:
+    return Value(Error{.msg = "Invalid unop"});
+  }
+}
+
+bool BinopNeedsArg2(uint8_t op, const Value &arg1) {
+  if (std::holds_alternative<Error>(arg1)) return false;
+  switch (op) {
+  case '+': case '-': case '*': case '/': case '%':
+  case '<': case '>': case 'T': case 'D':
+    return std::holds_alternative<Int>(arg1);
+  case '|': case '&':
+    return std::holds_alternative<Bool>(arg1);
+  case '.':
+    return std::holds_alternative<String>(arg1);
+  case '=':
+    return true;
+  default:
+    return false;
+  }
+}
+
+Value StrictBinop(uint8_t op, const Value &arg1, const Value &arg2) {
+  if (std::holds_alternative<Error>(arg1)) return arg1;
+  if (std::holds_alternative<Error>(arg2)) return arg2;
+
+  // Both args are the same base type, checked in order.
+  auto Ints = [&](const auto &f) -> Value {
+      const Int *i1 = std::get_if<Int>(&arg1);
+      const Int *i2 = std::get_if<Int>(&arg2);
+      if (i1 == nullptr || i2 == nullptr)
+        return Value(Error{.msg = "Expected int"});
+      return f(i1->i, i2->i);
+    };
+
+  auto Bools = [&](const auto &f) -> Value {
+      const Bool *b1 = std::get_if<Bool>(&arg1);
+      const Bool *b2 = std::get_if<Bool>(&arg2);
+      if (b1 == nullptr || b2 == nullptr)
+        return Value(Error{.msg = "Expected bool"});
+      return Value(Bool{.b = f(b1->b, b2->b)});
+    };
+
+  // Int and then string, for T and D.
+  auto IntString = [&](const char *what, const auto &f) -> Value {
+      const Int *i1 = std::get_if<Int>(&arg1);
+      if (i1 == nullptr) return Value(Error{.msg = "Expected int"});
+      const String *s2 = std::get_if<String>(&arg2);
+      if (s2 == nullptr)
+        return Value(Error{.msg = std::string("Expected string in ") + what});
+      const int64_t len = GetInt64(i1->i);
+      if (len < 0)
+        return Value(Error{.msg = std::string("negative length in ") + what});
+      // Corner case: length is bigger than string length
+      if (len > (int64_t)s2->s.size())
+        return Value(Error{.msg =
+            std::string("length exceeds string size in ") + what});
+      return f(len, s2->s);
+    };
+
+  switch (op) {
+  case '+':
+    return Ints([](const BigInt &a, const BigInt &b) {
+        return Value(Int{.i = a + b});
+      });
+  case '-':
+    return Ints([](const BigInt &a, const BigInt &b) {
+        return Value(Int{.i = a - b});
+      });
+  case '*':
+    return Ints([](const BigInt &a, const BigInt &b) {
+        return Value(Int{.i = a * b});
+      });
+  case '/':
+    return Ints([](const BigInt &a, const BigInt &b) {
+        if (b == 0) return Value(Error{.msg = "division by zero"});
+        return Value(Int{.i = a / b});
+      });
+  case '%':
+    return Ints([](const BigInt &a, const BigInt &b) {
+        if (b == 0) return Value(Error{.msg = "modulus by zero"});
+        return Value(Int{.i = a % b});
+      });
+  case '<':
+    return Ints([](const BigInt &a, const BigInt &b) {
+        return Value(Bool{.b = a < b});
+      });
+  case '>':
+    return Ints([](const BigInt &a, const BigInt &b) {
+        return Value(Bool{.b = a > b});
+      });
+
+  case '=': {
+    {
+      const Int *i1 = std::get_if<Int>(&arg1);
+      const Int *i2 = std::get_if<Int>(&arg2);
+      if (i1 != nullptr && i2 != nullptr) {
+        return Value(Bool{.b = i1->i == i2->i});
+      }
+    }
+
+    {
+      const Bool *b1 = std::get_if<Bool>(&arg1);
+      const Bool *b2 = std::get_if<Bool>(&arg2);
+      if (b1 != nullptr && b2 != nullptr) {
+        return Value(Bool{.b = b1->b == b2->b});
+      }
+    }
+
+    {
+      const String *s1 = std::get_if<String>(&arg1);
+      const String *s2 = std::get_if<String>(&arg2);
+      if (s1 != nullptr && s2 != nullptr) {
+        return Value(Bool{.b = s1->s == s2->s});
+      }
+    }
+
+    return Value(
+        Error{.msg = "binop = needs two args of the same base type"});
+  }
+
+  case '|':
+    return Bools([](bool a, bool b) { return a || b; });
+  case '&':
+    return Bools([](bool a, bool b) { return a && b; });
+
+  case '.': {
+    const String *s1 = std::get_if<String>(&arg1);
+    if (s1 == nullptr) return Value(Error{.msg = "Expected string in .lhs"});
+    const String *s2 = std::get_if<String>(&arg2);
+    if (s2 == nullptr) return Value(Error{.msg = "Expected string in .rhs"});
+    return Value(String{.s = s1->s + s2->s});
+  }
+
+  case 'T':
+    return IntString("T", [](int64_t len, const std::string &s) {
+        return Value(String{.s = s.substr(0, len)});
+      });
+
+  case 'D':
+    return IntString("D", [](int64_t len, const std::string &s) {
+        return Value(String{.s = s.substr(len, std::string::npos)});
+      });
+
+  default:
+    return Value(Error{.msg = "Invalid binop"});
+  }
+}
+
 // Evaluate to a value.
 Value Evaluation::Eval(std::shared_ptr<Exp> exp) {
+  if (threads > 0 && par == nullptr)
+    return EvalWithPool(std::move(exp));
+
   for (;;) {
+    if (cancel != nullptr && cancel->load(std::memory_order_relaxed))
+      return Value(Error{.msg = "cancelled"});
 
     if (const Bool *b = std::get_if<Bool>(exp.get())) {
       return Value(*b);
@@ -318,76 +739,14 @@ Value Evaluation::Eval(std::shared_ptr<Exp> exp) {
 
     } else if (const Unop *u = std::get_if<Unop>(exp.get())) {
 
-      switch (u->op) {
-      case '-': {
-        // - Integer negation  U- I$ -> -3
-        return EvalToInt(u->arg,
-                         [&](Int arg) { return Value(Int{.i = -arg.i}); });
-      }
-      case '!': {
-        // ! Boolean not U! T -> false
-        return EvalToBool(u->arg,
-                          [&](Bool arg) { return Value(Bool{.b = !arg.b}); });
-      }
-      case '#': {
-        // # string-to-int: interpret a string as a base-94 number
-        // U# S4%34 -> 15818151
-        return EvalToString("#",
-            u->arg, [&](String arg) {
-              // reencode
-              std::string enc;
-              enc.reserve(arg.s.size());
-              for (uint8_t c : arg.s) {
-                if (c >= 128) {
-                  return Value(Error{.msg =
-                      "unconvertible string (bad char) in string-to-int"});
-                } else {
-                  enc.push_back(ENCODE_STRING[c]);
-                }
-              }
-
-              if (std::optional<BigInt> i = ConvertInt(enc)) {
-                return Value(Int{.i = i.value()});
-              } else {
-                return Value(Error{.msg =
-                    "unconvertible string (not int) in string-to-int"});
-              }
-            });
-      }
-
-      case '$': {
-        // $ int-to-string: inverse of the above U$ I4%34 -> test
-        return EvalToInt(
-            u->arg, [&](Int arg) {
-              if (arg.i < 0) {
-                return Value(Error{.msg =
-                    "don't know how to convert negative integers to "
-                    "base-94?"});
-              }
-
-              std::string rev;
-              BigInt i = arg.i;
-              while (i > 0) {
-                uint8_t digit = i % RADIX;
-                rev.push_back(DECODE_STRING[digit]);
-                i /= RADIX;
-              }
-
-              std::string s;
-              s.resize(rev.size());
-              for (int i = 0; i < (int)rev.size(); i++) {
-                s[rev.size() - 1 - i] = rev[i];
-              }
-              return Value(String{.s = s});
-            });
-      }
-
-      default:
-        return Value(Error{.msg = "Invalid unop"});
-      }
+      // All unops are strict.
+      return StrictUnop(u->op, Eval(u->arg));
 
     } else if (const Binop *b = std::get_if<Binop>(exp.get())) {
 
+      if (par != nullptr && ShouldFork(b))
+        return ForkBinop(b);
+
       switch (b->op) {
       case '$': {
         // $ Apply term x to y (see Lambda abstractions)
@@ -399,6 +758,8 @@ Value Evaluation::Eval(std::shared_ptr<Exp> exp) {
         Value arg1 = Eval(b->arg1);
         if (const Lambda *lam = std::get_if<Lambda>(&arg1)) {
           betas++;
+          if (max_betas >= 0 && betas > max_betas)
+            return Value(Error{.msg = "Too many betas"});
 
           // Memoize arg2, so that if it is evaluated multiple
           // times, we only pay once.
@@ -409,13 +770,12 @@ Value Evaluation::Eval(std::shared_ptr<Exp> exp) {
             arg = b->arg2;
 
           } else {
-            arg = std::make_shared<Exp>(Memo{
+            arg = NewExp(Memo{
                 .fvs = nullptr,
                 .todo = b->arg2,
                 .done = nullptr});
           }
 
-          // TODO: Check limits
           exp = Subst(std::move(arg), lam->v, lam->body);
           // Tail recursion.
           continue;
@@ -441,7 +801,8 @@ Value Evaluation::Eval(std::shared_ptr<Exp> exp) {
           }
 
           betas++;
-          // TODO: Check limits
+          if (max_betas >= 0 && betas > max_betas)
+            return Value(Error{.msg = "Too many betas"});
           exp = Subst(ValueToExp(arg2), lam->v, lam->body);
           // Tail recursion.
           continue;
@@ -455,206 +816,70 @@ Value Evaluation::Eval(std::shared_ptr<Exp> exp) {
         }
       }
 
-      case '+': {
-        // + Integer addition  B+ I# I$ -> 5
-
-        return EvalToInt(
-            b->arg1, [&](Int arg1) {
-              return EvalToInt(b->arg2, [&](Int arg2) {
-                  return Value(Int{.i = arg1.i + arg2.i});
-                });
-            });
-      }
-
-      case '-': {
-        // - Integer subtraction B- I$ I# -> 1
-
-        return EvalToInt(
-            b->arg1, [&](Int arg1) {
-              return EvalToInt(b->arg2, [&](Int arg2) {
-                  return Value(Int{.i = arg1.i - arg2.i});
-                });
-            });
-      }
-
-      case '*': {
-        // * Integer multiplication  B* I$ I# -> 6
-
-        return EvalToInt(
-            b->arg1, [&](Int arg1) {
-              return EvalToInt(b->arg2, [&](Int arg2) {
-                  return Value(Int{.i = arg1.i * arg2.i});
-                });
-            });
-      }
-
-      case '/': {
-        // / Integer division (truncated towards zero) B/ U- I( I# -> -3
-
-        return EvalToInt(
-            b->arg1, [&](Int arg1) {
-              return EvalToInt(b->arg2, [&](Int arg2) {
-                  if (arg2.i == 0) {
-                    return Value(Error{.msg = "division by zero"});
-                  } else {
-                    // This should be what they want (c truncation), but
-                    // worth checking
-                    return Value(Int{.i = arg1.i / arg2.i});
-                  }
-                });
-            });
-      }
-
-      case '%': {
-        // % Integer modulo  B% U- I( I# -> -1
-
-        return EvalToInt(
-            b->arg1, [&](Int arg1) {
-              return EvalToInt(b->arg2, [&](Int arg2) {
-                  if (arg2.i == 0) {
-                    return Value(Error{.msg = "modulus by zero"});
-                  } else {
-                    // This should be what they want (c truncation), but
-                    // worth checking
-                    return Value(Int{.i = arg1.i % arg2.i});
-                  }
-                });
-            });
-      }
-
-      case '<': {
-        // < Integer comparison  B< I$ I# -> false
-
-        return EvalToInt(
-            b->arg1, [&](Int arg1) {
-              return EvalToInt(b->arg2, [&](Int arg2) {
-                  return Value(Bool{.b = arg1.i < arg2.i});
-                });
-            });
-      }
-
-      case '>': {
-        // > Integer comparison  B> I$ I# -> true
-
-        return EvalToInt(
-            b->arg1, [&](Int arg1) {
-              return EvalToInt(b->arg2, [&](Int arg2) {
-                  return Value(Bool{.b = arg1.i > arg2.i});
-                });
-            });
-      }
-
-      case '=': {
-        // = Equality comparison, works for int, bool and string.
-        // B= I$ I# -> false
-
-        // Ugh, needs to be polymorphic.
-        // TODO: Corner case: What if we compare values of different type?
-        Value arg1 = Eval(b->arg1);
-        if (const Error *e1 = std::get_if<Error>(&arg1)) return *e1;
-        Value arg2 = Eval(b->arg2);
-        if (const Error *e2 = std::get_if<Error>(&arg2)) return *e2;
-
-        {
-          const Int *i1 = std::get_if<Int>(&arg1);
-          const Int *i2 = std::get_if<Int>(&arg2);
-          if (i1 != nullptr && i2 != nullptr) {
-            return Value(Bool{.b = i1->i == i2->i});
-          }
+      case '~': {
+        // Secret memoizing fixpoint. B~ f x is (fix f) x, with the
+        // result cached by the value of x. Only sound if f is closed
+        // and pure, which MemoizeRecursion checks.
+        std::shared_ptr<Exp> fn = b->arg1;
+        if (!std::holds_alternative<Memo>(*fn)) {
+          // Then it has no stable identity, but we can still
+          // memoize the recursive calls below this one.
+          fn = NewExp(Memo{
+              .fvs = nullptr,
+              .todo = fn,
+              .done = nullptr});
         }
 
-        {
-          const Bool *b1 = std::get_if<Bool>(&arg1);
-          const Bool *b2 = std::get_if<Bool>(&arg2);
-          if (b1 != nullptr && b2 != nullptr) {
-            return Value(Bool{.b = b1->b == b2->b});
-          }
+        Value arg2 = Eval(b->arg2);
+        if (const Error *e = std::get_if<Error>(&arg2)) {
+          (void)e;
+          return arg2;
         }
 
-        {
-          const String *s1 = std::get_if<String>(&arg1);
-          const String *s2 = std::get_if<String>(&arg2);
-          if (s1 != nullptr && s2 != nullptr) {
-            return Value(Bool{.b = s1->s == s2->s});
+        const Int *key = std::get_if<Int>(&arg2);
+        if (key != nullptr) {
+          FixTable &table = fix_tables[fn.get()];
+          if (table.fn.get() == nullptr) table.fn = fn;
+          auto it = table.results.find(key->i);
+          if (it != table.results.end()) {
+            memo_hits++;
+            return it->second;
           }
         }
-
-        return Value(
-            Error{.msg = "binop = needs two args of the same base type"});
+        memo_misses++;
+
+        // self = λm. B~ f m
+        const int64_t m = FreshVar();
+        std::shared_ptr<Exp> self = NewExp(Lambda{
+            .v = m,
+            .body = NewExp(Binop{
+                .op = '~',
+                .arg1 = fn,
+                .arg2 = NewExp(Var{.v = m})})});
+
+        Value res = Eval(NewExp(Binop{
+            .op = '$',
+            .arg1 = NewExp(Binop{
+                .op = '$', .arg1 = fn, .arg2 = self}),
+            .arg2 = ValueToExp(arg2)}));
+
+        // (The reference above may have been invalidated by
+        // insertions during the recursive call.)
+        if (key != nullptr && (cancel == nullptr || !cancel->load()))
+          fix_tables[fn.get()].results[key->i] = res;
+        return res;
       }
 
-      case '|': {
-        // | Boolean or  B| T F -> true
-
-        return EvalToBool(
-            b->arg1, [&](Bool arg1) {
-              return EvalToBool(b->arg2, [&](Bool arg2) {
-                  return Value(Bool{.b = arg1.b || arg2.b});
-                });
-            });
+      default: {
+        // The rest are strict in both arguments, evaluated left to
+        // right. The second argument isn't evaluated at all if the
+        // first already determines the result (it might not
+        // terminate).
+        Value arg1 = Eval(b->arg1);
+        if (!BinopNeedsArg2(b->op, arg1))
+          return StrictBinop(b->op, arg1, Value(Bool{.b = false}));
+        return StrictBinop(b->op, arg1, Eval(b->arg2));
       }
-
-      case '&':
-        // & Boolean and B& T F -> false
-        return EvalToBool(
-            b->arg1, [&](Bool arg1) {
-              return EvalToBool(b->arg2, [&](Bool arg2) {
-                  return Value(Bool{.b = arg1.b && arg2.b});
-                });
-            });
-
-      case '.':
-        // . String concatenation  B. S4% S34 -> "test"
-        return EvalToString(
-            ".lhs", b->arg1, [&](String arg1) {
-                return EvalToString(
-                    ".rhs", b->arg2, [&](String arg2) {
-                        return Value(String{.s = arg1.s + arg2.s});
-                      });
-              });
-
-      case 'T':
-        // T Take first x chars of string y  BT I$ S4%34 -> "tes"
-        return EvalToInt(b->arg1, [&](Int arg1) {
-            return EvalToString("T", b->arg2, [&](String arg2) {
-                const int64_t len = GetInt64(arg1.i);
-
-                if (len < 0) {
-                  return Value(Error{.msg = "negative length in T"});
-                } else {
-                  // Corner case: length is bigger than string length
-                  if (len > (int64_t)arg2.s.size()) {
-                    return Value(Error{.msg =
-                        "length exceeds string size in T"});
-                  } else {
-                    return Value(String{.s = arg2.s.substr(0, len)});
-                  }
-                }
-              });
-          });
-
-      case 'D':
-        // D Drop first x chars of string y  BD I$ S4%34 -> "t"
-        return EvalToInt(b->arg1, [&](Int arg1) {
-            return EvalToString("D", b->arg2, [&](String arg2) {
-                const int64_t len = GetInt64(arg1.i);
-                if (len < 0) {
-                  return Value(Error{.msg = "negative length in D"});
-                } else {
-                  // Corner case: length is bigger than string length
-                  if (len > (int64_t)arg2.s.size()) {
-                    return Value(Error{.msg =
-                        "length exceeds string size in D"});
-                  } else {
-                    return Value(String{.s =
-                        arg2.s.substr(len, std::string::npos)});
-                  }
-                }
-              });
-          });
-
-      default:
-        return Value(Error{.msg = "Invalid binop"});
       }
 
     } else if (const If *i = std::get_if<If>(exp.get())) {
@@ -699,17 +924,7 @@ Value Evaluation::Eval(std::shared_ptr<Exp> exp) {
 
     } else if (Memo *m = std::get_if<Memo>(exp.get())) {
 
-      if (m->done.get() == nullptr) {
-        CHECK(m->todo.get() != nullptr);
-
-        m->done = std::make_shared<Value>(Eval(m->todo));
-        m->todo = nullptr;
-        m->fvs = nullptr;
-      }
-
-      CHECK(m->done.get() != nullptr);
-
-      return *m->done;
+      return ForceMemo(m);
 
     } else {
       CHECK(exp != nullptr);
@@ -724,6 +939,301 @@ Value Evaluation::Eval(std::shared_ptr<Exp> exp) {
 
 }
 
+Value Evaluation::ForceMemo(Memo *m) {
+  auto Cancelled = [this]() {
+      return cancel != nullptr && cancel->load(std::memory_order_relaxed);
+    };
+
+  if (!ParallelActive()) {
+    if (m->done.get() == nullptr) {
+      CHECK(m->todo.get() != nullptr);
+
+      Value v = Eval(m->todo);
+      if ((max_cached_bytes >= 0 && ValueBytes(v) > max_cached_bytes) ||
+          Cancelled()) {
+        // Leave the cell unforced.
+        if (!Cancelled()) uncached++;
+        return v;
+      }
+
+      m->done = NewValue(std::move(v));
+      m->todo = nullptr;
+      m->fvs = nullptr;
+    }
+
+    CHECK(m->done.get() != nullptr);
+
+    return *m->done;
+  }
+
+  // Claim protocol. Only one evaluation computes the cell at a time;
+  // others wait for it to be done (or abandoned, if the one computing
+  // it was a cancelled speculation).
+  MemoStripe &stripe = GetStripe(m);
+  std::shared_ptr<Exp> todo;
+  {
+    std::unique_lock<std::mutex> ml(stripe.m);
+    for (;;) {
+      if (m->done.get() != nullptr) return *m->done;
+      auto it = stripe.claims.find(m);
+      if (it == stripe.claims.end()) break;
+      // Blackhole: We need the value to compute the value.
+      if (it->second == this) return Value(Error{.msg = "<<loop>>"});
+      if (Cancelled()) return Value(Error{.msg = "cancelled"});
+      // Timeout so that we notice cancellation.
+      stripe.cv.wait_for(ml, std::chrono::milliseconds(10));
+    }
+    CHECK(m->todo.get() != nullptr);
+    stripe.claims[m] = this;
+    todo = m->todo;
+  }
+
+  Value v = Eval(todo);
+
+  {
+    std::unique_lock<std::mutex> ml(stripe.m);
+    stripe.claims.erase(m);
+    if (Cancelled()) {
+      // Not a real answer; leave it for someone else.
+    } else if (max_cached_bytes >= 0 && ValueBytes(v) > max_cached_bytes) {
+      uncached++;
+    } else {
+      m->done = NewValue(v);
+      m->todo = nullptr;
+      m->fvs = nullptr;
+    }
+  }
+  stripe.cv.notify_all();
+  return v;
+}
+
+// Speculative parallel evaluation. Tasks are forked onto a queue
+// that worker threads take from in order. When the forking
+// evaluation needs the result, it runs the task itself if no worker
+// has started it yet, and otherwise waits for it.
+struct Evaluation::ParallelState {
+  struct Task {
+    std::shared_ptr<Exp> exp;
+    int64_t max_cached_bytes = -1;
+    std::atomic<bool> cancel = false;
+
+    std::mutex m;
+    std::condition_variable cv;
+    enum State { PENDING, RUNNING, DONE };
+    State state = PENDING;
+
+    // Once DONE.
+    Value result;
+    int64_t betas = 0, memo_hits = 0, memo_misses = 0, uncached = 0;
+    int64_t forks = 0;
+  };
+
+  ParallelState(int threads, int64_t next_var) :
+    next_var(next_var), max_tasks(threads * 4) {
+    parallel_evaluations++;
+    // Evaluation recurses deeply, so workers need big stacks, like
+    // the main thread gets from the linker flags.
+    pthread_attr_t attr;
+    CHECK(0 == pthread_attr_init(&attr));
+    CHECK(0 == pthread_attr_setstacksize(&attr, size_t{1} << 30));
+    for (int i = 0; i < threads; i++) {
+      pthread_t t;
+      CHECK(0 == pthread_create(&t, &attr, &ParallelState::Worker, this));
+      workers.push_back(t);
+    }
+    pthread_attr_destroy(&attr);
+  }
+
+  ~ParallelState() {
+    {
+      std::unique_lock<std::mutex> ml(m);
+      stop = true;
+    }
+    cv.notify_all();
+    for (pthread_t t : workers) pthread_join(t, nullptr);
+    parallel_evaluations--;
+  }
+
+  static void *Worker(void *arg) {
+    ParallelState *self = (ParallelState *)arg;
+    for (;;) {
+      std::shared_ptr<Task> task;
+      {
+        std::unique_lock<std::mutex> ml(self->m);
+        self->cv.wait(ml, [self]() {
+            return self->stop || !self->queue.empty();
+          });
+        if (self->stop) return nullptr;
+        task = std::move(self->queue.front());
+        self->queue.pop_front();
+      }
+      self->Run(task.get());
+    }
+  }
+
+  std::shared_ptr<Task> Spawn(std::shared_ptr<Exp> exp,
+                              int64_t max_cached_bytes) {
+    std::shared_ptr<Task> task = std::make_shared<Task>();
+    task->exp = std::move(exp);
+    task->max_cached_bytes = max_cached_bytes;
+    outstanding++;
+    {
+      std::unique_lock<std::mutex> ml(m);
+      queue.push_back(task);
+    }
+    cv.notify_one();
+    return task;
+  }
+
+  // Run the task on this thread, unless someone already has.
+  void Run(Task *task) {
+    {
+      std::unique_lock<std::mutex> ml(task->m);
+      if (task->state != Task::PENDING) return;
+      task->state = Task::RUNNING;
+    }
+
+    Evaluation eval;
+    eval.par = this;
+    eval.cancel = &task->cancel;
+    eval.max_cached_bytes = task->max_cached_bytes;
+    Value v = eval.Eval(task->exp);
+
+    {
+      std::unique_lock<std::mutex> ml(task->m);
+      task->result = std::move(v);
+      task->betas = eval.betas;
+      task->memo_hits = eval.memo_hits;
+      task->memo_misses = eval.memo_misses;
+      task->uncached = eval.uncached;
+      task->forks = eval.forks;
+      task->state = Task::DONE;
+    }
+    task->cv.notify_all();
+    outstanding--;
+  }
+
+  std::atomic<int64_t> next_var;
+  const int max_tasks;
+  std::atomic<int> outstanding = 0;
+
+  // Profile of past forks, by binop, so that we stop forking for
+  // operators whose operands turn out to be cheap.
+  std::atomic<int64_t> fork_count[256] = {};
+  std::atomic<int64_t> fork_betas[256] = {};
+
+  std::mutex m;
+  std::condition_variable cv;
+  std::deque<std::shared_ptr<Task>> queue;
+  bool stop = false;
+  std::vector<pthread_t> workers;
+};
+
+int64_t Evaluation::FreshVar() {
+  if (par != nullptr) return par->next_var.fetch_sub(1);
+  return next_var--;
+}
+
+Value Evaluation::EvalWithPool(std::shared_ptr<Exp> exp) {
+  Value v;
+  {
+    ParallelState state(threads, next_var);
+    par = &state;
+    v = Eval(std::move(exp));
+    next_var = state.next_var.load();
+    par = nullptr;
+  }
+  return v;
+}
+
+// Could evaluating this take a while? Must be conservative, since
+// forking costs much more than a beta reduction.
+static bool MaybeExpensive(const Exp *e, int *budget) {
+  if (--*budget < 0) return true;
+  if (const Unop *u = std::get_if<Unop>(e)) {
+    return MaybeExpensive(u->arg.get(), budget);
+  } else if (const Binop *b = std::get_if<Binop>(e)) {
+    if (b->op == '$' || b->op == '!' || b->op == '~') return true;
+    return MaybeExpensive(b->arg1.get(), budget) ||
+      MaybeExpensive(b->arg2.get(), budget);
+  } else if (const If *i = std::get_if<If>(e)) {
+    return MaybeExpensive(i->cond.get(), budget) ||
+      MaybeExpensive(i->t.get(), budget) ||
+      MaybeExpensive(i->f.get(), budget);
+  } else if (const Memo *m = std::get_if<Memo>(e)) {
+    MemoStripe &stripe = GetStripe(m);
+    std::unique_lock<std::mutex> ml(stripe.m);
+    return m->done.get() == nullptr;
+  }
+  // Constants, variables, lambdas.
+  return false;
+}
+
+bool Evaluation::ShouldFork(const Binop *b) {
+  switch (b->op) {
+  case '+': case '-': case '*': case '/': case '%':
+  case '<': case '>': case '=': case '|': case '&':
+    break;
+  default:
+    return false;
+  }
+
+  if (par->outstanding.load(std::memory_order_relaxed) >= par->max_tasks)
+    return false;
+
+  // If forks of this operator have been cheap on average, only
+  // take the occasional sample.
+  static constexpr int64_t MIN_SAMPLES = 32;
+  static constexpr int64_t MIN_AVERAGE_BETAS = 256;
+  const int64_t count = par->fork_count[b->op].load();
+  if (count >= MIN_SAMPLES &&
+      par->fork_betas[b->op].load() < count * MIN_AVERAGE_BETAS &&
+      count % 64 != 0)
+    return false;
+
+  int budget1 = 32, budget2 = 32;
+  return MaybeExpensive(b->arg1.get(), &budget1) &&
+    MaybeExpensive(b->arg2.get(), &budget2);
+}
+
+Value Evaluation::ForkBinop(const Binop *b) {
+  forks++;
+  std::shared_ptr<ParallelState::Task> task =
+    par->Spawn(b->arg2, max_cached_bytes);
+
+  Value arg1 = Eval(b->arg1);
+
+  // The sequential evaluator doesn't evaluate the second argument
+  // if the first is an error or has the wrong type, so neither can
+  // we (it might not terminate).
+  const bool need2 = BinopNeedsArg2(b->op, arg1);
+  if (!need2) task->cancel = true;
+
+  par->Run(task.get());
+  {
+    std::unique_lock<std::mutex> ml(task->m);
+    task->cv.wait(ml, [&task]() {
+        return task->state == ParallelState::Task::DONE;
+      });
+  }
+
+  betas += task->betas;
+  memo_hits += task->memo_hits;
+  memo_misses += task->memo_misses;
+  uncached += task->uncached;
+  forks += task->forks;
+
+  if (!need2) {
+    // Any non-error value gives the same result as the sequential
+    // evaluator here.
+    return StrictBinop(b->op, arg1, Value(Bool{.b = false}));
+  }
+
+  par->fork_count[b->op]++;
+  par->fork_betas[b->op] += task->betas;
+  return StrictBinop(b->op, arg1, task->result);
+}
+
 Parser::Parser() {
 
 }
@@ -765,16 +1275,16 @@ std::shared_ptr<Exp> Parser::ParseLeadingExp(std::string_view *s) {
   switch (ind) {
   case 'T':
     CHECK(body.empty()) << "expected empty body for boolean";
-    return std::make_shared<Exp>(Bool{.b = true});
+    return NewExp(Bool{.b = true});
   case 'F':
     CHECK(body.empty()) << "expected empty body for boolean";
-    return std::make_shared<Exp>(Bool{.b = false});
+    return NewExp(Bool{.b = false});
 
   case 'I': {
     CHECK(!body.empty()) << "expected non-empty body for integer";
 
     BigInt val = ParseInt(body);
-    return std::make_shared<Exp>(Int{.i = val});
+    return NewExp(Int{.i = val});
   }
 
   case 'S': {
@@ -783,7 +1293,7 @@ std::shared_ptr<Exp> Parser::ParseLeadingExp(std::string_view *s) {
       CHECK(c >= 33 && c <= 126) << "Bad char in string body";
       translated.push_back(DECODE_STRING[c - 33]);
     }
-    return std::make_shared<Exp>(String{.s = std::move(translated)});
+    return NewExp(String{.s = std::move(translated)});
   }
 
   case 'U': {
@@ -792,7 +1302,7 @@ std::shared_ptr<Exp> Parser::ParseLeadingExp(std::string_view *s) {
     Unop unop;
     unop.op = body[0];
     unop.arg = ParseLeadingExp(s);
-    return std::make_shared<Exp>(std::move(unop));
+    return NewExp(std::move(unop));
   }
 
   case 'B': {
@@ -802,7 +1312,7 @@ std::shared_ptr<Exp> Parser::ParseLeadingExp(std::string_view *s) {
     binop.op = body[0];
     binop.arg1 = ParseLeadingExp(s);
     binop.arg2 = ParseLeadingExp(s);
-    return std::make_shared<Exp>(std::move(binop));
+    return NewExp(std::move(binop));
   }
 
   case '?': {
@@ -811,19 +1321,19 @@ std::shared_ptr<Exp> Parser::ParseLeadingExp(std::string_view *s) {
     iff.cond = ParseLeadingExp(s);
     iff.t = ParseLeadingExp(s);
     iff.f = ParseLeadingExp(s);
-    return std::make_shared<Exp>(std::move(iff));
+    return NewExp(std::move(iff));
   }
 
   case 'L': {
     Lambda lam;
     lam.v = MapVar(ParseInt(body));
     lam.body = ParseLeadingExp(s);
-    return std::make_shared<Exp>(std::move(lam));
+    return NewExp(std::move(lam));
   }
 
   case 'v': {
     int64_t i = MapVar(ParseInt(body));
-    return std::make_shared<Exp>(Var{.v = i});
+    return NewExp(Var{.v = i});
   }
 
   default:
@@ -831,6 +1341,73 @@ std::shared_ptr<Exp> Parser::ParseLeadingExp(std::string_view *s) {
   }
 }
 
+// Checks everything that ParseLeadingExp would CHECK, one token at a
+// time, by counting how many expressions are still expected.
+static bool CheckTokens(std::string_view s, std::string *error) {
+  auto Fail = [error](std::string msg) {
+      if (error != nullptr) *error = std::move(msg);
+      return false;
+    };
+
+  int64_t need = 1;
+  while (!s.empty()) {
+    const size_t len = std::min(s.find(' '), s.size());
+    std::string_view token = s.substr(0, len);
+    s.remove_prefix(len);
+    while (!s.empty() && s[0] == ' ') s.remove_prefix(1);
+    if (token.empty()) continue;
+
+    if (need == 0) return Fail("extra input after the expression");
+    const char ind = token[0];
+    std::string_view body = token.substr(1);
+    for (char c : body) {
+      if (c < 33 || c > 126)
+        return Fail(StringPrintf("bad char %d in body", (int)c));
+    }
+
+    int args = 0;
+    switch (ind) {
+    case 'T':
+    case 'F':
+      if (!body.empty()) return Fail("expected empty body for boolean");
+      break;
+    case 'I':
+      if (body.empty())
+        return Fail("expected non-empty body for integer");
+      break;
+    case 'S':
+    case 'v':
+      break;
+    case 'U':
+    case 'B':
+      if (body.size() != 1)
+        return Fail(StringPrintf("op body should be one char. got: [%s]",
+                                 std::string(body).c_str()));
+      args = ind == 'U' ? 1 : 2;
+      break;
+    case '?':
+      if (!body.empty()) return Fail("if should have empty body");
+      args = 3;
+      break;
+    case 'L':
+      args = 1;
+      break;
+    default:
+      return Fail(StringPrintf("invalid indicator '%c'", ind));
+    }
+    need += args - 1;
+  }
+
+  if (need > 0) return Fail("expected expression but got eos");
+  return true;
+}
+
+std::shared_ptr<Exp> Parser::ParseProgram(std::string_view s,
+                                          std::string *error) {
+  if (!CheckTokens(s, error)) return nullptr;
+  return ParseLeadingExp(&s);
+}
+
 std::string IntConstant(const BigInt &i) {
   CHECK(i >= 0) <<
     "only non-negative integers can be represented as constants";
@@ -991,8 +1568,206 @@ std::string PrettyExp(const Exp *exp) {
 }
 
 
-// Secret ops?
-// ~: might be alias for B$, or maybe it is memoizing?
+static bool IsVar(const Exp *e, int64_t v) {
+  const Var *var = std::get_if<Var>(e);
+  return var != nullptr && var->v == v;
+}
+
+// λx. f (x x)
+static bool IsSelfApp(const Exp *e, int64_t f) {
+  const Lambda *lam = std::get_if<Lambda>(e);
+  if (lam == nullptr || lam->v == f) return false;
+  const Binop *app = std::get_if<Binop>(lam->body.get());
+  if (app == nullptr || app->op != '$' || !IsVar(app->arg1.get(), f))
+    return false;
+  const Binop *xx = std::get_if<Binop>(app->arg2.get());
+  return xx != nullptr && xx->op == '$' &&
+    IsVar(xx->arg1.get(), lam->v) &&
+    IsVar(xx->arg2.get(), lam->v);
+}
+
+bool IsFixpointCombinator(const Exp *e) {
+  const Lambda *lam = std::get_if<Lambda>(e);
+  if (lam == nullptr) return false;
+  const Binop *app = std::get_if<Binop>(lam->body.get());
+  return app != nullptr && app->op == '$' &&
+    IsSelfApp(app->arg1.get(), lam->v) &&
+    IsSelfApp(app->arg2.get(), lam->v);
+}
+
+// Is e pure integer code, where the only free variables are those
+// in scope, and self only appears as the function in an application?
+static bool IsPureIntCode(const Exp *e, int64_t self,
+                          std::vector<int64_t> *scope) {
+  if (std::holds_alternative<Bool>(*e) ||
+      std::holds_alternative<Int>(*e)) {
+    return true;
+
+  } else if (const Var *v = std::get_if<Var>(e)) {
+    for (int64_t s : *scope)
+      if (s == v->v) return true;
+    return false;
+
+  } else if (const Unop *u = std::get_if<Unop>(e)) {
+    if (u->op != '-' && u->op != '!') return false;
+    return IsPureIntCode(u->arg.get(), self, scope);
+
+  } else if (const Binop *b = std::get_if<Binop>(e)) {
+    switch (b->op) {
+    case '$':
+    case '!':
+      // Recursive call.
+      if (IsVar(b->arg1.get(), self))
+        return IsPureIntCode(b->arg2.get(), self, scope);
+
+      // Let.
+      if (const Lambda *lam = std::get_if<Lambda>(b->arg1.get())) {
+        if (lam->v == self ||
+            !IsPureIntCode(b->arg2.get(), self, scope))
+          return false;
+        scope->push_back(lam->v);
+        bool ok = IsPureIntCode(lam->body.get(), self, scope);
+        scope->pop_back();
+        return ok;
+      }
+      return false;
+
+    case '+': case '-': case '*': case '/': case '%':
+    case '<': case '>': case '=': case '|': case '&':
+      return IsPureIntCode(b->arg1.get(), self, scope) &&
+        IsPureIntCode(b->arg2.get(), self, scope);
+
+    default:
+      return false;
+    }
+
+  } else if (const If *i = std::get_if<If>(e)) {
+    return IsPureIntCode(i->cond.get(), self, scope) &&
+      IsPureIntCode(i->t.get(), self, scope) &&
+      IsPureIntCode(i->f.get(), self, scope);
+  }
+
+  // Strings, lambdas other than lets, memo cells.
+  return false;
+}
+
+// Does evaluating pure integer code e always force the argument
+// before it makes a self call or produces a result (including an
+// error)? Then evaluating the argument eagerly, as the memoizing
+// fixpoint does, doesn't change what the program means. Conservative.
+// bindings gives each variable in scope (innermost last) and whether
+// forcing it forces the argument first.
+static bool ForcesArgFirst(const Exp *e,
+                           std::vector<std::pair<int64_t, bool>> *bindings) {
+  if (const Var *v = std::get_if<Var>(e)) {
+    for (int i = (int)bindings->size() - 1; i >= 0; i--)
+      if ((*bindings)[i].first == v->v) return (*bindings)[i].second;
+    return false;
+
+  } else if (const Unop *u = std::get_if<Unop>(e)) {
+    return ForcesArgFirst(u->arg.get(), bindings);
+
+  } else if (const Binop *b = std::get_if<Binop>(e)) {
+    if (b->op == '$' || b->op == '!') {
+      const Lambda *lam = std::get_if<Lambda>(b->arg1.get());
+      // A self call.
+      if (lam == nullptr) return false;
+      const bool arg_forces = ForcesArgFirst(b->arg2.get(), bindings);
+      // A strict let evaluates its argument first.
+      if (b->op == '!') return arg_forces;
+      // A lazy one forces it when the body forces the variable.
+      bindings->emplace_back(lam->v, arg_forces);
+      const bool ok = ForcesArgFirst(lam->body.get(), bindings);
+      bindings->pop_back();
+      return ok;
+    }
+
+    // Strict operators evaluate the first argument first. The second
+    // is only reached if the first can't be an error or the wrong
+    // type, which we only know for constants.
+    if (ForcesArgFirst(b->arg1.get(), bindings)) return true;
+    const bool safe1 =
+      (std::holds_alternative<Int>(*b->arg1) &&
+       b->op != '|' && b->op != '&') ||
+      (std::holds_alternative<Bool>(*b->arg1) &&
+       (b->op == '|' || b->op == '&' || b->op == '='));
+    return safe1 && ForcesArgFirst(b->arg2.get(), bindings);
+
+  } else if (const If *i = std::get_if<If>(e)) {
+    return ForcesArgFirst(i->cond.get(), bindings);
+  }
+
+  // Constants.
+  return false;
+}
+
+// λself. λn. body, with pure integer code for the body that always
+// forces n first.
+static bool IsPureIntRecursion(const Exp *e) {
+  const Lambda *self = std::get_if<Lambda>(e);
+  if (self == nullptr) return false;
+  const Lambda *n = std::get_if<Lambda>(self->body.get());
+  if (n == nullptr || n->v == self->v) return false;
+  std::vector<int64_t> scope = {n->v};
+  if (!IsPureIntCode(n->body.get(), self->v, &scope)) return false;
+  std::vector<std::pair<int64_t, bool>> bindings = {{n->v, true}};
+  return ForcesArgFirst(n->body.get(), &bindings);
+}
+
+static std::shared_ptr<Exp> MemoizeRec(std::shared_ptr<Exp> exp,
+                                       int64_t *next_var, int *fired) {
+  auto Rec = [&](const std::shared_ptr<Exp> &e) {
+      return MemoizeRec(e, next_var, fired);
+    };
+
+  if (const Unop *u = std::get_if<Unop>(exp.get())) {
+    return NewExp(Unop{.op = u->op, .arg = Rec(u->arg)});
+
+  } else if (const Binop *b = std::get_if<Binop>(exp.get())) {
+    if (b->op == '$' && IsFixpointCombinator(b->arg1.get()) &&
+        IsPureIntRecursion(b->arg2.get())) {
+      (*fired)++;
+      // The body can't contain further fixpoints (there are no
+      // lambdas other than lets), so there's no need to recurse.
+      // Wrapping the function in an evaluated memo cell gives it
+      // an identity that survives substitution.
+      std::shared_ptr<Exp> fn = NewExp(Memo{
+          .fvs = nullptr,
+          .todo = nullptr,
+          .done = NewValue(
+              std::get<Lambda>(*b->arg2))});
+      const int64_t m = *next_var;
+      (*next_var)--;
+      return NewExp(Lambda{
+          .v = m,
+          .body = NewExp(Binop{
+              .op = '~',
+              .arg1 = fn,
+              .arg2 = NewExp(Var{.v = m})})});
+    }
+    return NewExp(Binop{
+        .op = b->op, .arg1 = Rec(b->arg1), .arg2 = Rec(b->arg2)});
+
+  } else if (const If *i = std::get_if<If>(exp.get())) {
+    return NewExp(If{
+        .cond = Rec(i->cond), .t = Rec(i->t), .f = Rec(i->f)});
+
+  } else if (const Lambda *lam = std::get_if<Lambda>(exp.get())) {
+    return NewExp(Lambda{.v = lam->v, .body = Rec(lam->body)});
+  }
+
+  // Constants, variables, memo cells.
+  return exp;
+}
+
+std::shared_ptr<Exp> MemoizeRecursion(std::shared_ptr<Exp> exp,
+                                      int64_t *next_var,
+                                      int *fired) {
+  int count = 0;
+  std::shared_ptr<Exp> ret = MemoizeRec(std::move(exp), next_var, &count);
+  if (fired != nullptr) *fired = count;
+  return ret;
+}
 
 std::string ReadAllInput() {
   std::string input;
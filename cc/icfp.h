@@ -2,6 +2,7 @@
 #ifndef ICFP_H_
 #define ICFP_H_
 
+#include <atomic>
 #include <cstdint>
 #include <string>
 #include <unordered_map>
@@ -23,6 +24,9 @@ static constexpr int RADIX = 94;
 
 // Returns e.g. I! for 0.
 std::string IntConstant(const BigInt &i);
+inline std::string IntConstant(std::integral auto i) {
+  return IntConstant(BigInt(i));
+}
 // Without leading S.
 std::string EncodeString(std::string_view s);
 uint8_t DecodeChar(uint8_t c);
@@ -114,6 +118,13 @@ binops, represented as the raw byte
 T Take first x chars of string y  BT I$ S4%34 -> "tes"
 D Drop first x chars of string y  BD I$ S4%34 -> "t"
 $ Apply term x to y (see Lambda abstractions)
+
+Secret binops (not part of the official language):
+
+! Call-by-value application.
+~ Memoizing fixpoint: B~ f x is (fix f) x, where f is a closed pure
+  function λself. λn. ..., and results are cached by the value of x
+  (when it is an integer). Produced by MemoizeRecursion.
 */
 
 struct Binop {
@@ -140,9 +151,49 @@ struct Var {
 std::string ValueString(const Value &v);
 std::string PrettyExp(const Exp *e);
 
+// Primitive operators applied to already-evaluated arguments, for
+// evaluators that don't go through Evaluation::Eval. Errors in the
+// arguments are propagated (left first). Not for the application
+// operators $ and !, or for If.
+Value StrictUnop(uint8_t op, const Value &arg);
+Value StrictBinop(uint8_t op, const Value &arg1, const Value &arg2);
+// False if StrictBinop's result doesn't depend on the second
+// argument, because the first is an error or has the wrong type. The
+// second argument must not be evaluated then, since it might not
+// terminate.
+bool BinopNeedsArg2(uint8_t op, const Value &arg1);
+
 struct Evaluation {
   // Number of beta redices performed.
   int64_t betas = 0;
+  // If non-negative, beta reductions past this many evaluate to an
+  // error instead, so that a program that runs forever still returns.
+  // Operands forked to other threads don't count toward it.
+  int64_t max_betas = -1;
+  // Number of applications of memoizing fixpoints (~) that were
+  // answered from the table, or that had to be computed.
+  int64_t memo_hits = 0;
+  int64_t memo_misses = 0;
+
+  // If non-negative, forced values with payloads larger than this
+  // are not cached in memo cells. The cell keeps its expression, and
+  // we recompute the value every time it's needed, trading time for
+  // memory.
+  int64_t max_cached_bytes = -1;
+  // Number of times we declined to cache because of the above.
+  int64_t uncached = 0;
+
+  // If positive, use this many worker threads to speculatively
+  // evaluate the second operand of strict binops (+, *, =, etc.) in
+  // parallel with the first, when both look expensive. Memo cells are
+  // then forced with a claim protocol, so that a cell being computed
+  // by one thread is waited for (not recomputed) by others, and a
+  // thread that needs a cell it is already computing gets a <<loop>>
+  // error. Results are the same as the sequential evaluator, except
+  // that such loops are reported instead of running forever.
+  int threads = 0;
+  // Number of operands evaluated as parallel tasks.
+  int64_t forks = 0;
   // We use negative variable names for fresh ones, since they
   // cannot be written in the source language.
   int64_t next_var = -1;
@@ -195,19 +246,98 @@ struct Evaluation {
 
   static std::unordered_set<int64_t> FreeVars(const Exp *e);
 
+  // Internal; defined in icfp.cc.
+  struct ParallelState;
+
  private:
   void EnsureFreeVars(Memo *m);
 
+  int64_t FreshVar();
+  Value ForceMemo(Memo *m);
+  Value EvalWithPool(std::shared_ptr<Exp> exp);
+  bool ShouldFork(const Binop *b);
+  Value ForkBinop(const Binop *b);
+
+  // Set during parallel evaluation, shared by the evaluations of all
+  // the tasks.
+  ParallelState *par = nullptr;
+  // If set, we are a speculative task and should give up when this
+  // becomes true.
+  const std::atomic<bool> *cancel = nullptr;
+
   std::shared_ptr<Exp> SubstInternal(
       const std::unordered_set<int64_t> &fvs,
       std::shared_ptr<Exp> e1,
       int64_t v,
       std::shared_ptr<Exp> e2,
       bool simple);
+
+  // For the ~ operator. Tables are keyed by the identity of the
+  // function's memo cell, which is preserved by substitution since
+  // it is closed. We keep the cell alive so that the address can't
+  // be reused.
+  struct FixTable {
+    std::shared_ptr<Exp> fn;
+    std::unordered_map<BigInt, Value> results;
+  };
+  std::unordered_map<const Exp *, FixTable> fix_tables;
 };
 
 std::shared_ptr<Exp> ValueToExp(const Value &v);
 
+// Memory accounting, for the whole process. Counts the live
+// expression nodes (from the parser and evaluator) and the values
+// cached in memo cells, along with the bytes in the strings and
+// integers they hold. Values on the C++ stack are not included.
+// Off by default, since it costs several atomic operations per
+// allocation.
+struct MemoryCounters {
+  // Only allocations made while this is on are counted (and
+  // uncounted when they are freed). Set it before parsing, and not
+  // while other threads are allocating.
+  bool enabled = false;
+
+  std::atomic<int64_t> nodes = 0;
+  // Live memo cells, whether forced or not.
+  std::atomic<int64_t> memo_cells = 0;
+  // Forced values held by memo cells.
+  std::atomic<int64_t> cached_values = 0;
+  // Payload bytes (approximate for integers).
+  std::atomic<int64_t> string_bytes = 0;
+  std::atomic<int64_t> int_bytes = 0;
+
+  // High water marks.
+  std::atomic<int64_t> peak_nodes = 0;
+  std::atomic<int64_t> peak_bytes = 0;
+};
+extern MemoryCounters memory_counters;
+std::string MemoryCountersString();
+
+// Approximate size of the string or integer payload of a value.
+int64_t ValueBytes(const Value &v);
+
+// Allocate with accounting. Always use these instead of make_shared.
+std::shared_ptr<Exp> NewExp(Exp e);
+std::shared_ptr<Value> NewValue(Value v);
+
+// Is this the Y combinator λf. (λx. f (x x)) (λx. f (x x))?
+bool IsFixpointCombinator(const Exp *e);
+
+// Finds recursive functions (Y applied to λself. λn. body) where the
+// body is pure integer code: constants, arithmetic, comparisons, if,
+// lets, n, and calls self e. These are closed, so their results only
+// depend on the argument value, and we rewrite them to use the
+// memoizing fixpoint ~. Since ~ evaluates the argument eagerly, the
+// body must also be strict in n: it forces n before any self call or
+// result (e.g. in the condition of an outer if). Exponential
+// recursions like the naive fibonacci become linear. Fresh variables
+// are taken from *next_var (see FullyLazy). Only Evaluation
+// understands the result. Returns the number of functions rewritten
+// in *fired, if non-null.
+std::shared_ptr<Exp> MemoizeRecursion(std::shared_ptr<Exp> exp,
+                                      int64_t *next_var,
+                                      int *fired = nullptr);
+
 struct Parser {
   Parser();
 
@@ -221,6 +351,12 @@ struct Parser {
   // of the string view.
   std::shared_ptr<Exp> ParseLeadingExp(std::string_view *s);
 
+  // Parses a whole program, which must be exactly one expression.
+  // Unlike ParseLeadingExp, this returns nullptr (and sets *error, if
+  // non-null) for malformed input instead of aborting.
+  std::shared_ptr<Exp> ParseProgram(std::string_view s,
+                                    std::string *error = nullptr);
+
   int64_t MapVar(const BigInt &b);
 };
 
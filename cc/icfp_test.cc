@@ -4,8 +4,12 @@
 #include <string>
 #include <string_view>
 #include <variant>
+#include <vector>
 
 #include "icfp.h"
+#include "graph-eval.h"
+#include "base-x.h"
+#include "spaceship-encoding.h"
 
 #include "ansi.h"
 #include "base/logging.h"
@@ -26,6 +30,16 @@ static Value Evaluate(std::string_view s) {
   return evaluation.Eval(exp);
 }
 
+static Value GraphEvaluate(std::string_view s) {
+  Parser parser;
+  std::shared_ptr<Exp> exp = parser.ParseLeadingExp(&s);
+  CHECK(s.empty());
+  CHECK(exp.get());
+
+  GraphEvaluation evaluation;
+  return evaluation.Eval(exp);
+}
+
 static void TestInt() {
 
   for (std::string s : {"0", "1", "93", "94", "95",
@@ -47,12 +61,242 @@ static void TestInt() {
 static void LanguageTest() {
   constexpr const char *test = R"(? B= B$ B$ B$ B$ L$ L$ L$ L# v$ I" I# I$ I% I$ ? B= B$ L$ v$ I+ I+ ? B= BD I$ S4%34 S4 ? B= BT I$ S4%34 S4%3 ? B= B. S4% S34 S4%34 ? U! B& T F ? B& T T ? U! B| F F ? B| F T ? B< U- I$ U- I# ? B> I$ I# ? B= U- I" B% U- I$ I# ? B= I" B% I( I$ ? B= U- I" B/ U- I$ I# ? B= I# B/ I( I$ ? B= I' B* I# I$ ? B= I$ B+ I" I# ? B= U$ I4%34 S4%34 ? B= U# S4%34 I4%34 ? U! F ? B= U- I$ B- I# I& ? B= I$ B- I& I# ? B= S4%34 S4%34 ? B= F F ? B= I$ I$ ? T B. B. SM%,&k#(%#+}IEj}3%.$}z3/,6%},!.'5!'%y4%34} U$ B+ I# B* I$> I1~s:U@ Sz}4/}#,!)-}0/).43}&/2})4 S)&})3}./4}#/22%#4 S").!29}q})3}./4}#/22%#4 S").!29}q})3}./4}#/22%#4 S").!29}q})3}./4}#/22%#4 S").!29}k})3}./4}#/22%#4 S5.!29}k})3}./4}#/22%#4 S5.!29}_})3}./4}#/22%#4 S5.!29}a})3}./4}#/22%#4 S5.!29}b})3}./4}#/22%#4 S").!29}i})3}./4}#/22%#4 S").!29}h})3}./4}#/22%#4 S").!29}m})3}./4}#/22%#4 S").!29}m})3}./4}#/22%#4 S").!29}c})3}./4}#/22%#4 S").!29}c})3}./4}#/22%#4 S").!29}r})3}./4}#/22%#4 S").!29}p})3}./4}#/22%#4 S").!29}{})3}./4}#/22%#4 S").!29}{})3}./4}#/22%#4 S").!29}d})3}./4}#/22%#4 S").!29}d})3}./4}#/22%#4 S").!29}l})3}./4}#/22%#4 S").!29}N})3}./4}#/22%#4 S").!29}>})3}./4}#/22%#4 S!00,)#!4)/.})3}./4}#/22%#4 S!00,)#!4)/.})3}./4}#/22%#4)";
 
-  Value v = Evaluate(test);
-  const String *s = std::get_if<String>(&v);
-  CHECK(s != nullptr) << ValueString(v);
-  CHECK(s->s ==
-        "Self-check OK, send `solve language_test 4w3s0m3` "
-        "to claim points for it") << "Got:\n" << s->s;
+  for (const Value &v : {Evaluate(test), GraphEvaluate(test)}) {
+    const String *s = std::get_if<String>(&v);
+    CHECK(s != nullptr) << ValueString(v);
+    CHECK(s->s ==
+          "Self-check OK, send `solve language_test 4w3s0m3` "
+          "to claim points for it") << "Got:\n" << s->s;
+  }
+}
+
+static void TestGraph() {
+  // Each crash test again, with the graph evaluator.
+  constexpr const char *crash4 = R"(B. S3/,6%},!-"$!-!.VV} B! B! B$ Lf B$ Lx B$ vf B$ vx vx Lx B$ vf B$ vx vx Lc LL Ld ? B= vL S S B! L0 B! Lb B. B! vb F B! B! vc BD I" vL B! vb T ? B= v0 Sk L! ? v! B+ vd I$ S ? B= v0 Si L! ? v! B+ vd I" S ? B= v0 S@ L! ? v! vd B$ Ls B$ B$ Lf B$ Lx B$ vf B$ vx vx Lx B$ vf B$ vx vx Lr Ln ? B= vn I" vs B. vs B! vr B- vn I" I" BT I" BD B% vd I% SL>FO L! ? v! vd S BT I" vL B! B! B! Lf B$ Lf B$ Lx B$ vf B$ vx vx Lx B$ vf B$ vx vx Li Ln Le ? B= vn I! ve B! vf B! B! vi B- vn I" ve B$ Lf B$ Lx B$ vf B$ vx vx Lx B$ vf B$ vx vx LR Ls ? B= vs S S B. B! L0 ? B= v0 S; Si<@k;@;k@<i ? B= v0 S< Sk;@i<@<i@;k v0 BT I" vs B! vR BD I" vs I' S; I!)";
+  {
+    Value v = GraphEvaluate(crash4);
+    const String *s = std::get_if<String>(&v);
+    CHECK(s != nullptr) << ValueString(v);
+    CHECK(s->s.find("solve lambdaman11 RDLDDRURDRUULURRDRURRDLDRDLLULDDDRURRDL")
+          == 0) << "Got:\n" << s->s;
+  }
+
+  // Shadowing, and a variable captured through several lambdas.
+  {
+    Value v = GraphEvaluate("B$ B$ B$ La Lb La B+ va vb I# I$ I%");
+    const Int *i = std::get_if<Int>(&v);
+    CHECK(i != nullptr) << ValueString(v);
+    CHECK(i->i == 7) << i->i.ToString();
+  }
+
+  // Unbound variables are errors, not crashes.
+  {
+    Value v = GraphEvaluate("B+ I# vz");
+    CHECK(std::holds_alternative<Error>(v)) << ValueString(v);
+  }
+
+  // If the first argument of a strict binop has the wrong type, the
+  // second isn't evaluated (here it doesn't terminate). Both
+  // evaluators give the same error.
+  {
+    const std::string omega = "B$ Lx B$ vx vx Lx B$ vx vx";
+    for (std::string op : {"+", "<", "&", ".", "T", "D"}) {
+      const std::string bad = op == "&" || op == "." ? "I#" : "T";
+      const std::string prog = "B" + op + " " + bad + " " + omega;
+      Value v = Evaluate(prog);
+      Value g = GraphEvaluate(prog);
+      const Error *e = std::get_if<Error>(&v);
+      const Error *ge = std::get_if<Error>(&g);
+      CHECK(e != nullptr) << prog << ": " << ValueString(v);
+      CHECK(ge != nullptr) << prog << ": " << ValueString(g);
+      CHECK(e->msg == ge->msg) << e->msg << " vs " << ge->msg;
+    }
+  }
+
+  // g y = y + E, where E is an expensive countdown that doesn't
+  // depend on y. We call g three times. With full laziness, E is
+  // shared between the calls.
+  constexpr const char *shared =
+    "B$ Lg B+ B$ vg I! B+ B$ vg I\" B$ vg I# "
+    "Ly B+ vy B$ B$ Lf B$ Lx B$ vf B$ vx vx Lx B$ vf B$ vx vx "
+    "Lz La ? B= va I! I( B$ vz B- va I\" I\"'";
+
+  Parser parser;
+  std::string_view sv(shared);
+  std::shared_ptr<Exp> exp = parser.ParseLeadingExp(&sv);
+  CHECK(sv.empty());
+
+  Evaluation subst;
+  Value sv1 = subst.Eval(exp);
+
+  GraphEvaluation graph;
+  Value gv = graph.Eval(exp);
+
+  GraphEvaluation strict_graph;
+  strict_graph.fully_lazy = false;
+  Value sgv = strict_graph.Eval(exp);
+
+  for (const Value &v : {sv1, gv, sgv}) {
+    const Int *i = std::get_if<Int>(&v);
+    CHECK(i != nullptr) << ValueString(v);
+    CHECK(i->i == 3 * 7 + 3) << i->i.ToString();
+  }
+
+  // Full laziness on the substitution evaluator should help too.
+  Evaluation lazy_subst;
+  Value lv = lazy_subst.Eval(FullyLazy(exp, &lazy_subst.next_var));
+  CHECK(std::get<Int>(lv).i == 3 * 7 + 3);
+
+  CHECK(graph.betas * 2 < subst.betas) << graph.betas << " vs " <<
+    subst.betas;
+  CHECK(lazy_subst.betas * 2 < subst.betas) << lazy_subst.betas << " vs " <<
+    subst.betas;
+  CHECK(graph.betas < strict_graph.betas);
+}
+
+static void TestMemoizeRecursion() {
+  // Naive fibonacci of 25, as in efficiency4.
+  constexpr const char *fib =
+    "B$ B$ Lf B$ Lx B$ vf B$ vx vx Lx B$ vf B$ vx vx "
+    "Lc Ld ? B< vd I# I\" B+ B$ vc B- vd I\" B$ vc B- vd I# I:";
+
+  Parser parser;
+  std::string_view sv(fib);
+  std::shared_ptr<Exp> exp = parser.ParseLeadingExp(&sv);
+  CHECK(sv.empty());
+
+  Evaluation plain;
+  Value pv = plain.Eval(exp);
+
+  Evaluation memo;
+  int fired = 0;
+  Value mv = memo.Eval(MemoizeRecursion(exp, &memo.next_var, &fired));
+  CHECK(fired == 1) << fired;
+
+  for (const Value &v : {pv, mv}) {
+    const Int *i = std::get_if<Int>(&v);
+    CHECK(i != nullptr) << ValueString(v);
+    CHECK(i->i == 121393) << i->i.ToString();
+  }
+
+  // Each argument 0..25 is computed once.
+  CHECK(memo.memo_misses == 26) << memo.memo_misses;
+  CHECK(memo.betas * 100 < plain.betas) << memo.betas << " vs " <<
+    plain.betas;
+
+  // Functions that aren't pure integer code are left alone, such as
+  // this one that takes a string.
+  constexpr const char *str =
+    "B$ B$ Lf B$ Lx B$ vf B$ vx vx Lx B$ vf B$ vx vx "
+    "Lc Ld ? B= vd S vd B$ vc BD I\" vd S4%34";
+  std::string_view ssv(str);
+  std::shared_ptr<Exp> sexp = parser.ParseLeadingExp(&ssv);
+  CHECK(ssv.empty());
+  Evaluation sev;
+  (void)MemoizeRecursion(sexp, &sev.next_var, &fired);
+  CHECK(fired == 0);
+
+  // The memoizing fixpoint evaluates its argument eagerly, so a
+  // function that doesn't always use its argument is left alone.
+  // Here the argument is an error (and then a loop) that the lazy
+  // program never looks at.
+  for (const char *arg : {"B/ I\" I!", "B$ Lx B$ vx vx Lx B$ vx vx"}) {
+    const std::string lazy =
+      std::string("B$ B$ Lf B$ Lx B$ vf B$ vx vx Lx B$ vf B$ vx vx "
+                  "Lc Ld ? T I$ B+ vd B$ vc vd ") + arg;
+    std::string_view lsv(lazy);
+    std::shared_ptr<Exp> lexp = parser.ParseLeadingExp(&lsv);
+    CHECK(lsv.empty());
+    Evaluation lev;
+    Value lv = lev.Eval(MemoizeRecursion(lexp, &lev.next_var, &fired));
+    CHECK(fired == 0);
+    const Int *li = std::get_if<Int>(&lv);
+    CHECK(li != nullptr && li->i == 3) << ValueString(lv);
+  }
+}
+
+static void TestMemoryAccounting() {
+  memory_counters.enabled = true;
+  const int64_t nodes_before = memory_counters.nodes.load();
+  {
+    // x is a big string that is used twice.
+    constexpr const char *twice =
+      "B$ Lx B. vx vx B$ B$ Lf B$ Lx B$ vf B$ vx vx Lx B$ vf B$ vx vx "
+      "Lr Ln ? B= vn I! S B. S4%34 B$ vr B- vn I\" I+";
+
+    Parser parser;
+    std::string_view sv(twice);
+    std::shared_ptr<Exp> exp = parser.ParseLeadingExp(&sv);
+    CHECK(sv.empty());
+    CHECK(memory_counters.nodes.load() > nodes_before);
+
+    Evaluation cached;
+    Value cv = cached.Eval(exp);
+    CHECK(cached.uncached == 0);
+
+    Evaluation recompute;
+    recompute.max_cached_bytes = 8;
+    Value rv = recompute.Eval(exp);
+    CHECK(recompute.uncached > 0);
+    CHECK(recompute.betas > cached.betas);
+
+    for (const Value &v : {cv, rv}) {
+      const String *s = std::get_if<String>(&v);
+      CHECK(s != nullptr) << ValueString(v);
+      CHECK(s->s.size() == 4 * 10 * 2) << s->s;
+    }
+  }
+  // Everything was freed.
+  CHECK(memory_counters.nodes.load() == nodes_before) <<
+    MemoryCountersString();
+  memory_counters.enabled = false;
+
+  // When it's off, nothing is counted.
+  {
+    std::shared_ptr<Exp> e = NewExp(Int{.i = BigInt{7}});
+    CHECK(memory_counters.nodes.load() == nodes_before);
+  }
+}
+
+static void TestParallel() {
+  // Naive fibonacci of 18, which has lots of independent + operands.
+  constexpr const char *fib =
+    "B$ B$ Lf B$ Lx B$ vf B$ vx vx Lx B$ vf B$ vx vx "
+    "Lc Ld ? B< vd I# I\" B+ B$ vc B- vd I\" B$ vc B- vd I# I3";
+
+  auto Run = [](std::string_view s, int threads, int64_t *forks) {
+      Parser parser;
+      std::shared_ptr<Exp> exp = parser.ParseLeadingExp(&s);
+      CHECK(s.empty());
+      Evaluation evaluation;
+      evaluation.threads = threads;
+      Value v = evaluation.Eval(exp);
+      if (forks != nullptr) *forks = evaluation.forks;
+      return v;
+    };
+
+  int64_t forks = 0;
+  Value v = Run(fib, 4, &forks);
+  const Int *i = std::get_if<Int>(&v);
+  CHECK(i != nullptr) << ValueString(v);
+  CHECK(i->i == 4181) << i->i.ToString();
+  CHECK(forks > 0);
+
+  // The first operand is not an int, so the second (which loops
+  // forever) must not be needed.
+  constexpr const char *loop =
+    "B+ B$ Lx vx S4%34 "
+    "B$ B$ Lf B$ Lx B$ vf B$ vx vx Lx B$ vf B$ vx vx Lf Ln B$ vf vn I!";
+  Value lv = Run(loop, 4, &forks);
+  const Error *e = std::get_if<Error>(&lv);
+  CHECK(e != nullptr) << ValueString(lv);
+  CHECK(e->msg == "Expected int") << e->msg;
+
+  // Same answer as the sequential evaluator on real programs.
+  constexpr const char *david = R"(B. S3/,6%},!-"$!-!.Y} B$ B$ B$ Lf B$ Lx B$ vf B$ vx vx Lx B$ vf B$ vx vx LS Ln Lr ? B= vn I'E S B. B$ Lx ? B= I! vx SO ? B= I" vx S> ? B= I# vx SF SL B% B/ vr I.gg~B I% B$ B$ vS B+ vn I" B% B+ B* vr I#!Dd I-}c|. IX""|J I! I!)";
+  Value dv = Run(david, 4, nullptr);
+  Value sv = Run(david, 0, nullptr);
+  CHECK(ValueString(dv) == ValueString(sv)) << ValueString(dv);
 }
 
 static void Bench() {
@@ -109,6 +353,61 @@ static void Crash4() {
     << "Got:\n" << s->s;
 }
 
+// The generated decoders reproduce their input exactly.
+static void TestEncoders() {
+  auto EvalString = [](const std::string &program) {
+      Value v = Evaluate(program);
+      const String *s = std::get_if<String>(&v);
+      CHECK(s != nullptr) << ValueString(v);
+      return s->s;
+    };
+
+  for (bool pow2 : {false, true}) {
+    const std::string input = "solve lambdaman4 LLLDURRRUDRRRRDDDUULLL";
+    CHECK(EvalString(BaseXEncode(input, pow2)) == input);
+  }
+
+  const std::string moves = "1235555555559" "5" "7896555" "44";
+  const std::string prefix = "solve spaceship7 ";
+  CHECK(SpaceshipTokens("65552", 2) ==
+        (std::vector<int>{4, 9, 8, 1}));
+  for (int max_run : {1, 2, 8, 30}) {
+    for (int chunk_size : {1, 3, 65536}) {
+      CHECK(EvalString(EncodeSpaceship(prefix, moves, max_run, chunk_size)) ==
+            prefix + moves) << max_run << " " << chunk_size;
+    }
+  }
+  CHECK(EvalString(EncodeSpaceship("", "", 1)).empty());
+
+  CHECK(BestMaxRun("12346789", false) == 1);
+  CHECK(BestMaxRun(std::string(1000, '5'), false) > 1);
+  const int pow2_run = BestMaxRun(moves + std::string(100, '5'), true);
+  CHECK(((8 + pow2_run) & (7 + pow2_run)) == 0) << pow2_run;
+}
+
+// Malformed programs are rejected rather than aborting, and the beta
+// limit stops programs that run forever.
+static void TestParseProgram() {
+  Parser parser;
+  CHECK(parser.ParseProgram("B+ I# I$").get() != nullptr);
+  for (const char *bad : {"", "X1", "B+ I#", "I# I$", "B++ I# I$",
+                          "TF", "I", "? T I# I$ I%"}) {
+    std::string error;
+    CHECK(parser.ParseProgram(bad, &error).get() == nullptr) << bad;
+    CHECK(!error.empty()) << bad;
+  }
+
+  // (λx. x x) (λx. x x)
+  std::shared_ptr<Exp> omega =
+    parser.ParseProgram("B$ L! B$ v! v! L! B$ v! v!");
+  CHECK(omega.get() != nullptr);
+  Evaluation evaluation;
+  evaluation.max_betas = 1000;
+  Value v = evaluation.Eval(omega);
+  CHECK(std::holds_alternative<Error>(v)) << ValueString(v);
+  CHECK(evaluation.betas > 1000);
+}
+
 int main(int argc, char **argv) {
   ANSI::Init();
 
@@ -120,6 +419,14 @@ int main(int argc, char **argv) {
 
   TestInt();
   LanguageTest();
+  TestEncoders();
+  TestParseProgram();
+
+  TestGraph();
+
+  TestMemoizeRecursion();
+  TestMemoryAccounting();
+  TestParallel();
 
   Bench();
 
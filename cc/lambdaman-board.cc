@@ -0,0 +1,710 @@
+#include "lambdaman-board.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "base/logging.h"
+#include "base/stringprintf.h"
+#include "util.h"
+#include "mapped-file.h"
+#include "image.h"
+#include "color-util.h"
+#include "arcfour.h"
+#include "randutil.h"
+
+#define JITTER 1
+
+static constexpr ColorUtil::Gradient RAINBOW{
+  GradRGB(0.0f, 0x440000),
+  GradRGB(0.2f, 0x7700BB),
+  GradRGB(0.3f, 0xFF0000),
+  GradRGB(0.4f, 0xFFFF00),
+  GradRGB(0.5f, 0xFFFFFF),
+  GradRGB(0.7f, 0x00FF33),
+  GradRGB(1.0f, 0x0000FF),
+};
+
+void Board::SaveImage(const std::string &filename, int scale,
+                      const std::string &sol) {
+  MoveReader reader(sol);
+  SaveImage(filename, scale, &reader);
+}
+
+void Board::SaveImage(const std::string &filename, int scale,
+                      MoveReader *reader) {
+  ImageRGBA img(width * scale, height * scale);
+  img.Clear32(0x111122FF);
+
+  #if JITTER
+  ArcFour rc("jitter");
+  auto Jitter = [&rc, scale]() {
+      return RandTo(&rc, scale - 2) - ((scale - 1) / 2);
+    };
+  #else
+  auto Jitter = []() { return 0; }
+  #endif
+
+  // Play the solution first, which gives the final board and the
+  // length of the (simple) path.
+  const int startx = lx, starty = ly;
+  const int64_t path_length = Play(reader);
+
+  // Draw board first.
+
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      uint8_t val = At(x, y);
+      switch (val) {
+      case ' ':
+        break;
+      case '#':
+      case '@': {
+        uint32_t color = val == '#' ? 0xAAAAAAFF : 0xDDDDDDFF;
+        img.BlendBox32(x * scale + 1, y * scale + 1, scale - 2, scale - 2,
+                       color, {color & 0xFFFFFF99});
+        if (scale - 4 > 0) {
+          img.BlendRect32(x * scale + 2, y * scale + 2, scale - 4, scale - 4,
+                          color);
+        }
+        break;
+      }
+      case '.':
+        img.BlendFilledCircleAA32((x + 0.5f) * scale,
+                                  (y + 0.5f) * scale,
+                                  scale * 0.3f, 0xAAAA22FF);
+        break;
+      default:
+        img.BlendBox32(x * scale, y * scale, scale, scale, 0xFF0000FF,
+                       0xFF0000FF);
+        break;
+      }
+    }
+  }
+
+  img.BlendBox32(lx * scale + 1, ly * scale + 1, scale - 2, scale - 2,
+                 0xFF00FFFF, {0xFF00FFAA});
+  if (scale - 4 > 0) {
+    img.BlendRect32(lx * scale + 2, ly * scale + 2, scale - 4, scale - 4,
+                    0xFF00FFFF);
+  }
+
+  // Now draw path, streaming the moves again. Walls are still walls
+  // (perhaps now marked '@'), so we can tell which moves moved.
+  // There can be millions of segments, so draw them in big batches.
+  static constexpr size_t BATCH = 1 << 20;
+  std::vector<ImageRGBA::LineSegment32> lines;
+  reader->Rewind();
+  double denom = path_length;
+  int64_t i = 0;
+  int cx = startx, cy = starty;
+  int ox = cx * scale + (scale / 2);
+  int oy = cy * scale + (scale / 2);
+  for (char c; reader->Next(&c); /* in loop */) {
+    int dx = 0, dy = 0;
+    switch (c) {
+    case 'U': dy = -1; break;
+    case 'L': dx = -1; break;
+    case 'D': dy = +1; break;
+    case 'R': dx = +1; break;
+    default:
+      LOG(FATAL) << "Bad solution char " << c;
+    }
+
+    const uint8_t val = At(cx + dx, cy + dy);
+    if (val == '#' || val == '@') continue;
+
+    // current color in gradient
+    uint32_t color = ColorUtil::LinearGradient32(RAINBOW, i / denom);
+    i++;
+
+    // draw a line
+    // TODO: jitter?
+    cx += dx;
+    cy += dy;
+
+    int nx = cx * scale + (scale / 2) + Jitter();
+    int ny = cy * scale + (scale / 2) + Jitter();
+    lines.push_back({.x1 = ox, .y1 = oy, .x2 = nx, .y2 = ny,
+                     .color = color & 0xFFFFFF99});
+    ox = nx;
+    oy = ny;
+
+    if (lines.size() == BATCH) {
+      img.BlendLines32(lines);
+      lines.clear();
+    }
+  }
+  img.BlendLines32(lines);
+
+  img.Save(filename);
+}
+
+void Board::SaveHeatmap(const std::string &filename, int scale,
+                        const std::string &sol) {
+  MoveReader reader(sol);
+  SaveHeatmap(filename, scale, &reader);
+}
+
+void Board::SaveHeatmap(const std::string &filename, int scale,
+                        MoveReader *reader) {
+  // Visits per cell, following the moves that actually moved.
+  std::vector<uint32_t> visits(cells.size(), 0);
+  visits[ly * width + lx]++;
+  for (char c; reader->Next(&c); /* in loop */) {
+    const int ox = lx, oy = ly;
+    Play(std::string_view(&c, 1));
+    if (lx != ox || ly != oy) visits[ly * width + lx]++;
+  }
+
+  int x = 0, y = 0;
+  uint32_t max_visits = 1;
+  for (uint32_t v : visits) max_visits = std::max(max_visits, v);
+  const double denom = std::log(1.0 + max_visits);
+
+  ImageRGBA img(width * scale, height * scale);
+  for (y = 0; y < height; y++) {
+    for (x = 0; x < width; x++) {
+      const int idx = y * width + x;
+      uint32_t color = 0x111122FF;
+      if (cells[idx] == '#' || cells[idx] == '@') {
+        color = 0x444444FF;
+      } else if (cells[idx] == '.') {
+        // Missed dots are the most important thing to see.
+        color = 0xFF00FFFF;
+      } else if (visits[idx] > 0) {
+        color = ColorUtil::LinearGradient32(
+            RAINBOW, std::log(1.0 + visits[idx]) / denom);
+      }
+      img.BlendRect32(x * scale, y * scale, scale, scale, color);
+    }
+  }
+  img.Save(filename);
+}
+
+// Keys for the Zobrist hash. Rather than storing random tables, we
+// hash the cell index, which is just as good for this purpose.
+static inline uint64_t ZobristKey(uint64_t x) {
+  // splitmix64 finalizer.
+  x += 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+static inline uint64_t PosKey(int idx) { return ZobristKey(idx * 2); }
+static inline uint64_t DotKey(int idx) { return ZobristKey(idx * 2 + 1); }
+
+uint64_t Board::ComputeHash() const {
+  uint64_t h = PosKey(ly * width + lx);
+  for (int i = 0; i < (int)cells.size(); i++)
+    if (cells[i] == '.') h ^= DotKey(i);
+  return h;
+}
+
+void Board::Undo(const Checkpoint &checkpoint) {
+  CHECK(checkpoint.log_size <= undo_log.size());
+  while (undo_log.size() > checkpoint.log_size) {
+    const auto &[idx, old] = undo_log.back();
+    cells[idx] = old;
+    undo_log.pop_back();
+  }
+  lx = checkpoint.lx;
+  ly = checkpoint.ly;
+  dots = checkpoint.dots;
+  hash = checkpoint.hash;
+}
+
+std::string Board::Play(std::string_view s) {
+  auto Set = [this](int idx, uint8_t v) {
+      if (record_undo) undo_log.emplace_back(idx, cells[idx]);
+      cells[idx] = v;
+    };
+
+  std::string out;
+  for (char c : s) {
+    int dx = 0, dy = 0;
+
+    switch (c) {
+    case 'U': dx = 0;  dy = -1; break;
+    case 'D': dx = 0;  dy = +1; break;
+    case 'L': dx = -1; dy = 0; break;
+    case 'R': dx = +1; dy = 0; break;
+    default: LOG(FATAL) << "Bad solution char " << c;
+    }
+
+    uint8_t val = At(lx + dx, ly + dy);
+    if (val == '#' || val == '@') {
+      if (val == '#') Set((ly + dy) * width + lx + dx, '@');
+      // Lambda man stays still. (And don't copy it to output!)
+    } else {
+      out.push_back(c);
+      hash ^= PosKey(ly * width + lx);
+      lx += dx;
+      ly += dy;
+      const int idx = ly * width + lx;
+      hash ^= PosKey(idx);
+      if (val == '.') {
+        dots--;
+        hash ^= DotKey(idx);
+        Set(idx, ' ');
+      }
+    }
+  }
+  return out;
+}
+
+int64_t Board::Play(MoveReader *reader) {
+  int64_t moved = 0;
+  for (char c; reader->Next(&c); /* in loop */) {
+    const int ox = lx, oy = ly;
+    Play(std::string_view(&c, 1));
+    if (lx != ox || ly != oy) moved++;
+  }
+  return moved;
+}
+
+MoveReader::MoveReader(std::string_view s) : mem(s) {
+  Rewind();
+}
+
+MoveReader::MoveReader(FILE *file, size_t chunk_size) :
+  file(file), buffer(chunk_size) {
+  Rewind();
+}
+
+std::unique_ptr<MoveReader> MoveReader::OpenFile(const std::string &filename,
+                                                 size_t chunk_size) {
+  FILE *file = fopen(filename.c_str(), "rb");
+  CHECK(file != nullptr) << "Couldn't open " << filename;
+  if (fseek(file, 0, SEEK_SET) == 0)
+    return std::unique_ptr<MoveReader>(new MoveReader(file, chunk_size));
+
+  // Can't rewind, so keep the whole thing.
+  std::string contents;
+  std::vector<char> chunk(chunk_size);
+  for (;;) {
+    const size_t n = fread(chunk.data(), 1, chunk.size(), file);
+    if (n == 0) break;
+    contents.append(chunk.data(), n);
+  }
+  fclose(file);
+  std::unique_ptr<MoveReader> reader(new MoveReader(std::string_view()));
+  reader->owned = std::move(contents);
+  reader->mem = reader->owned;
+  reader->Rewind();
+  return reader;
+}
+
+MoveReader::~MoveReader() {
+  if (file != nullptr) fclose(file);
+}
+
+bool MoveReader::Fill() {
+  if (file == nullptr) return false;
+  len = fread(buffer.data(), 1, buffer.size(), file);
+  pos = 0;
+  return len > 0;
+}
+
+void MoveReader::Rewind() {
+  if (file != nullptr) {
+    CHECK(0 == fseek(file, 0, SEEK_SET));
+    data = buffer.data();
+    pos = len = 0;
+  } else {
+    data = mem.data();
+    pos = 0;
+    len = mem.size();
+  }
+  SkipMarker();
+}
+
+void MoveReader::SkipMarker() {
+  // Moves never contain lowercase letters, so if the first one is
+  // 's', this is "solve lambdamanN", which is two words.
+  char c = 0;
+  if (!Next(&c)) return;
+  if (c != 's') {
+    pos--;
+    return;
+  }
+  for (int words = 0; words < 2; words++) {
+    // Rest of the word.
+    while (pos < len || Fill()) {
+      const char ch = data[pos++];
+      if (ch == ' ' || ch == '\n' || ch == '\r' || ch == '\t') break;
+    }
+    // Next moves Next() past the whitespace; but the second word's
+    // first character must not be consumed as a move.
+    if (words == 0) {
+      char first = 0;
+      if (!Next(&first)) return;
+    }
+  }
+}
+
+// Cell value for each character of the puzzle format, or 0 if it's
+// not allowed. 'L' is an empty cell (we note the position separately).
+static constexpr std::array<uint8_t, 256> CELL_OF_CHAR = [] {
+    std::array<uint8_t, 256> table = {};
+    table['#'] = '#';
+    table['.'] = '.';
+    table['L'] = ' ';
+    return table;
+  }();
+
+static inline bool IsBlank(char c) {
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Split the file into its rows, with surrounding whitespace removed
+// and blank lines skipped (like Util::NormalizeLines). The views
+// point into data.
+static std::vector<std::string_view> GridLines(std::string_view data) {
+  std::vector<std::string_view> lines;
+  const char *p = data.data();
+  const char *end = p + data.size();
+  while (p < end) {
+    const char *nl = (const char *)memchr(p, '\n', end - p);
+    const char *line_end = nl == nullptr ? end : nl;
+    const char *b = p, *e = line_end;
+    while (b < e && IsBlank(*b)) b++;
+    while (e > b && IsBlank(e[-1])) e--;
+    if (b < e) lines.emplace_back(b, e - b);
+    p = line_end + 1;
+  }
+  CHECK(!lines.empty()) << "Empty board";
+  for (std::string_view line : lines) {
+    CHECK(line.size() == lines[0].size()) << "Want lines that "
+      "are all the same length";
+  }
+  return lines;
+}
+
+[[noreturn]]
+static void BadChar(uint8_t c) {
+  LOG(FATAL) << "Unknown character in input: "
+             << StringPrintf("'%c' 0x%02x", c, c);
+  abort();
+}
+
+Board FromFile(const std::string &filename) {
+  const MappedFile file(filename);
+  const std::vector<std::string_view> lines = GridLines(file.View());
+
+  Board board;
+  board.height = 2 + (int)lines.size();
+  board.width = 2 + (int)lines[0].size();
+  board.cells.resize(board.width * board.height, '#');
+
+  // We place the board at (1,1) so that it can be surrounded by
+  // walls.
+  for (int y = 0; y < (int)lines.size(); y++) {
+    const uint8_t *src = (const uint8_t *)lines[y].data();
+    uint8_t *dst = &board.cells[(y + 1) * board.width + 1];
+    uint8_t all = 0xFF;
+    for (size_t x = 0; x < lines[y].size(); x++) {
+      const uint8_t v = CELL_OF_CHAR[src[x]];
+      all &= v;
+      dst[x] = v;
+    }
+    // Rare cases (bad characters and the start) are found afterwards,
+    // so that the loop above is branch-free.
+    if (all == 0 || memchr(src, 'L', lines[y].size()) != nullptr) {
+      for (size_t x = 0; x < lines[y].size(); x++) {
+        if (CELL_OF_CHAR[src[x]] == 0) BadChar(src[x]);
+        if (src[x] == 'L') {
+          board.lx = x + 1;
+          board.ly = y + 1;
+        }
+      }
+    }
+    board.dots += std::count(dst, dst + lines[y].size(), '.');
+  }
+
+  board.hash = board.ComputeHash();
+
+  fprintf(stderr, "Lambda man at %d,%d. %d dots.\n",
+          board.lx, board.ly, board.dots);
+
+  return board;
+}
+
+std::vector<uint16_t> DistanceField(const Board &board, int x, int y) {
+  std::vector<uint16_t> dist(board.cells.size(), UNREACHABLE);
+  // Cell indices; each is pushed at most once.
+  std::vector<int> queue;
+  queue.reserve(board.cells.size());
+  const int start = y * board.width + x;
+  dist[start] = 0;
+  queue.push_back(start);
+  // The board is surrounded by walls, so neighbors are always in
+  // bounds.
+  const int delta[4] = {-board.width, 1, board.width, -1};
+  for (size_t head = 0; head < queue.size(); head++) {
+    const int c = queue[head];
+    const uint16_t nd = dist[c] + 1;
+    for (int d : delta) {
+      const int n = c + d;
+      const uint8_t v = board.cells[n];
+      if (v == '#' || v == '@' || dist[n] != UNREACHABLE) continue;
+      dist[n] = nd;
+      queue.push_back(n);
+    }
+  }
+  return dist;
+}
+
+BitBoard::BitBoard(const Board &board) : width(board.width),
+                                         height(board.height) {
+  words_per_row = (width + 63) / 64;
+  stride = words_per_row * 64;
+  walls.resize(words_per_row * height, 0);
+  dots.resize(words_per_row * height, 0);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      const int p = y * stride + x;
+      const uint64_t bit = uint64_t{1} << (p & 63);
+      switch (board.At(x, y)) {
+      case '#':
+      case '@':
+        walls[p >> 6] |= bit;
+        break;
+      case '.':
+        dots[p >> 6] |= bit;
+        break;
+      default:
+        break;
+      }
+    }
+    // Padding at the end of the row counts as wall, although we
+    // can never reach it, since the board is surrounded by walls.
+    for (int x = width; x < stride; x++) {
+      const int p = y * stride + x;
+      walls[p >> 6] |= uint64_t{1} << (p & 63);
+    }
+  }
+  pos = board.ly * stride + board.lx;
+}
+
+BitBoard BitBoard::Load(const std::string &filename) {
+  const MappedFile file(filename);
+  const std::vector<std::string_view> lines = GridLines(file.View());
+
+  BitBoard bb;
+  bb.width = 2 + (int)lines[0].size();
+  bb.height = 2 + (int)lines.size();
+  bb.words_per_row = (bb.width + 63) / 64;
+  bb.stride = bb.words_per_row * 64;
+  // Everything starts as wall, which takes care of the border and
+  // the padding at the end of each row.
+  bb.walls.resize(bb.words_per_row * bb.height, ~uint64_t{0});
+  bb.dots.resize(bb.words_per_row * bb.height, 0);
+  for (int y = 0; y < (int)lines.size(); y++) {
+    const uint8_t *src = (const uint8_t *)lines[y].data();
+    const int row = (y + 1) * bb.stride + 1;
+    for (int x = 0; x < (int)lines[y].size(); x++) {
+      const uint8_t v = CELL_OF_CHAR[src[x]];
+      if (v == 0) BadChar(src[x]);
+      const int p = row + x;
+      const uint64_t bit = uint64_t{1} << (p & 63);
+      if (v != '#') bb.walls[p >> 6] &= ~bit;
+      if (v == '.') bb.dots[p >> 6] |= bit;
+      if (src[x] == 'L') bb.pos = p;
+    }
+  }
+  return bb;
+}
+
+// Serialized format: the magic "LMB1", then width, height, lx, ly as
+// little-endian uint32, then the walls and dots as bitsets over the
+// cells in Board order, each padded to a whole number of uint64 words.
+static constexpr char BOARD_MAGIC[4] = {'L', 'M', 'B', '1'};
+
+std::string SerializeBoard(const Board &board) {
+  const size_t num = board.cells.size();
+  const size_t words = (num + 63) / 64;
+  std::vector<uint64_t> walls(words, 0), dots(words, 0);
+  for (size_t i = 0; i < num; i++) {
+    const uint8_t c = board.cells[i];
+    const uint64_t bit = uint64_t{1} << (i & 63);
+    if (c == '#' || c == '@') walls[i >> 6] |= bit;
+    else if (c == '.') dots[i >> 6] |= bit;
+  }
+
+  std::string out(BOARD_MAGIC, sizeof (BOARD_MAGIC));
+  for (int v : {board.width, board.height, board.lx, board.ly}) {
+    const uint32_t u = v;
+    for (int b = 0; b < 4; b++) out.push_back((char)((u >> (8 * b)) & 0xFF));
+  }
+  static_assert(std::endian::native == std::endian::little);
+  out.append((const char *)walls.data(), words * sizeof (uint64_t));
+  out.append((const char *)dots.data(), words * sizeof (uint64_t));
+  return out;
+}
+
+Board DeserializeBoard(std::string_view *data) {
+  constexpr size_t HEADER = sizeof (BOARD_MAGIC) + 4 * 4;
+  CHECK(data->size() >= HEADER &&
+        memcmp(data->data(), BOARD_MAGIC, sizeof (BOARD_MAGIC)) == 0) <<
+    "Not a serialized board";
+  const uint8_t *p = (const uint8_t *)data->data() + sizeof (BOARD_MAGIC);
+  auto U32 = [&p]() {
+      const uint32_t u = p[0] | (p[1] << 8) | (p[2] << 16) |
+        ((uint32_t)p[3] << 24);
+      p += 4;
+      return (int)u;
+    };
+
+  Board board;
+  board.width = U32();
+  board.height = U32();
+  board.lx = U32();
+  board.ly = U32();
+  CHECK(board.width > 0 && board.height > 0 &&
+        board.lx >= 0 && board.lx < board.width &&
+        board.ly >= 0 && board.ly < board.height) << "Bad board header";
+
+  const size_t num = (size_t)board.width * board.height;
+  const size_t words = (num + 63) / 64;
+  const size_t bytes = words * sizeof (uint64_t);
+  CHECK(data->size() >= HEADER + 2 * bytes) << "Truncated board";
+  std::vector<uint64_t> walls(words), dots(words);
+  memcpy(walls.data(), data->data() + HEADER, bytes);
+  memcpy(dots.data(), data->data() + HEADER + bytes, bytes);
+  data->remove_prefix(HEADER + 2 * bytes);
+
+  board.cells.resize(num);
+  for (size_t i = 0; i < num; i++) {
+    const uint64_t bit = uint64_t{1} << (i & 63);
+    board.cells[i] = (walls[i >> 6] & bit) ? '#' :
+      (dots[i >> 6] & bit) ? '.' : ' ';
+  }
+  for (uint64_t w : dots) board.dots += std::popcount(w);
+  board.hash = board.ComputeHash();
+  return board;
+}
+
+std::vector<Board> LoadBoards(const std::string &filename) {
+  const MappedFile file(filename);
+  std::string_view data = file.View();
+  std::vector<Board> boards;
+  while (!data.empty()) boards.push_back(DeserializeBoard(&data));
+  return boards;
+}
+
+std::vector<uint8_t> BitBoard::DecodeDirs(std::string_view s) {
+  std::vector<uint8_t> dirs;
+  dirs.reserve(s.size());
+  for (char c : s) {
+    switch (c) {
+    case 'U': dirs.push_back(UP); break;
+    case 'R': dirs.push_back(RIGHT); break;
+    case 'D': dirs.push_back(DOWN); break;
+    case 'L': dirs.push_back(LEFT); break;
+    default: LOG(FATAL) << "Bad solution char " << c;
+    }
+  }
+  return dirs;
+}
+
+std::string BitBoard::EncodeDirs(const std::vector<uint8_t> &dirs) {
+  std::string s;
+  s.reserve(dirs.size());
+  for (uint8_t d : dirs) {
+    if (d < NONE) s.push_back("URDL"[d]);
+  }
+  return s;
+}
+
+int BitBoard::DotsRemaining() const {
+  int count = 0;
+  for (uint64_t w : dots) count += std::popcount(w);
+  return count;
+}
+
+int BitBoard::Play(const uint8_t *dirs, size_t n) {
+  // Indexed by the low three bits of the direction, so that garbage
+  // doesn't read out of bounds.
+  const int delta[8] = {-stride, 1, stride, -1, 0, 0, 0, 0};
+  const uint64_t *w = walls.data();
+  uint64_t *d = dots.data();
+  int p = pos;
+  for (size_t i = 0; i < n; i++) {
+    const int np = p + delta[dirs[i] & 7];
+    const bool wall = (w[np >> 6] >> (np & 63)) & 1;
+    p = wall ? p : np;
+    d[p >> 6] &= ~(uint64_t{1} << (p & 63));
+  }
+  pos = p;
+  return DotsRemaining();
+}
+
+void BitBoard::PlayBatch(const uint8_t *const *paths, int num, size_t n,
+                         int *remaining) const {
+  int done = 0;
+
+#ifdef __AVX2__
+  static constexpr int LANES = 8;
+  // The gathers read 32-bit words.
+  const int *walls32 = (const int *)walls.data();
+  const int delta[8] = {-stride, 1, stride, -1, 0, 0, 0, 0};
+  const __m256i delta_v = _mm256_loadu_si256((const __m256i *)delta);
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i thirty_one = _mm256_set1_epi32(31);
+  const __m256i seven = _mm256_set1_epi32(7);
+
+  std::vector<uint64_t> lane_dots[LANES];
+  for (; done + LANES <= num; done += LANES) {
+    for (int l = 0; l < LANES; l++) lane_dots[l] = dots;
+    const uint8_t *const *p8 = paths + done;
+
+    __m256i p = _mm256_set1_epi32(pos);
+    alignas(32) int lane_pos[LANES];
+    for (size_t i = 0; i < n; i++) {
+      __m256i dir = _mm256_setr_epi32(p8[0][i], p8[1][i], p8[2][i],
+                                       p8[3][i], p8[4][i], p8[5][i],
+                                       p8[6][i], p8[7][i]);
+      __m256i np = _mm256_add_epi32(
+          p, _mm256_permutevar8x32_epi32(delta_v,
+                                         _mm256_and_si256(dir, seven)));
+      __m256i word = _mm256_i32gather_epi32(
+          walls32, _mm256_srli_epi32(np, 5), 4);
+      __m256i wall = _mm256_and_si256(
+          _mm256_srlv_epi32(word, _mm256_and_si256(np, thirty_one)), one);
+      // wall is 0 or 1; blend on the mask -wall.
+      p = _mm256_blendv_epi8(np, p, _mm256_sub_epi32(_mm256_setzero_si256(),
+                                                     wall));
+
+      // Eating is per-lane, since each path has its own dots.
+      _mm256_store_si256((__m256i *)lane_pos, p);
+      for (int l = 0; l < LANES; l++) {
+        const int q = lane_pos[l];
+        lane_dots[l][q >> 6] &= ~(uint64_t{1} << (q & 63));
+      }
+    }
+
+    for (int l = 0; l < LANES; l++) {
+      int count = 0;
+      for (uint64_t w : lane_dots[l]) count += std::popcount(w);
+      remaining[done + l] = count;
+    }
+  }
+#endif
+
+  for (; done < num; done++) {
+    BitBoard copy = *this;
+    remaining[done] = copy.Play(paths[done], n);
+  }
+}
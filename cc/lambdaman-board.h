@@ -0,0 +1,233 @@
+
+#ifndef LAMBDAMAN_BOARD_H_
+#define LAMBDAMAN_BOARD_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "base/logging.h"
+
+// Reads moves incrementally, from a file in fixed-size chunks or
+// from a string in memory (like the output of an Evaluation), so
+// that huge solutions never need to be copied. Whitespace is skipped,
+// and so is a leading "solve lambdamanN" marker.
+struct MoveReader {
+  // The string must outlive the reader.
+  explicit MoveReader(std::string_view s);
+  // Aborts if the file can't be opened. A file that can't be rewound
+  // (a pipe, like /dev/stdin) is read into memory instead.
+  static std::unique_ptr<MoveReader> OpenFile(const std::string &filename,
+                                              size_t chunk_size = 1 << 16);
+  ~MoveReader();
+
+  MoveReader(const MoveReader &) = delete;
+  MoveReader &operator =(const MoveReader &) = delete;
+
+  // Gets the next move character, or returns false at the end.
+  bool Next(char *c) {
+    for (;;) {
+      if (pos == len && !Fill()) return false;
+      const char ch = data[pos++];
+      if (ch == ' ' || ch == '\n' || ch == '\r' || ch == '\t') continue;
+      *c = ch;
+      return true;
+    }
+  }
+
+  // Start over from the beginning.
+  void Rewind();
+
+ private:
+  MoveReader(FILE *file, size_t chunk_size);
+  bool Fill();
+  void SkipMarker();
+  FILE *file = nullptr;
+  std::vector<char> buffer;
+  const char *data = nullptr;
+  size_t pos = 0, len = 0;
+  // For in-memory readers.
+  std::string_view mem;
+  // Backing for mem, if we read it from a pipe.
+  std::string owned;
+};
+
+struct Board {
+  int width = 0;
+  int height = 0;
+  int dots = 0;
+  // '.' = pac-dot
+  // ' ' = empty
+  // '#' = wall, never touched
+  // '@' = wall that you collided with
+  std::vector<uint8_t> cells;
+  uint8_t &At(int x, int y) {
+    CHECK(x >= 0 && x < width &&
+          y >= 0 && y < height);
+    return cells[y * width + x];
+  }
+
+  uint8_t At(int x, int y) const {
+    CHECK(x >= 0 && x < width &&
+          y >= 0 && y < height);
+    return cells[y * width + x];
+  }
+
+  int lx = 0, ly = 0;
+
+  // Zobrist hash of lambda man's position and the set of remaining
+  // dots, kept up to date by Play. Boards reached by different paths
+  // from the same start have the same hash when they are in the same
+  // state.
+  uint64_t hash = 0;
+  // Recompute the hash from scratch.
+  uint64_t ComputeHash() const;
+
+  // When set, Play logs the cells that it changes so that a search
+  // can revert a segment of moves with Undo, in time proportional to
+  // the segment's length, rather than copying the board.
+  bool record_undo = false;
+  struct Checkpoint {
+    size_t log_size = 0;
+    int lx = 0, ly = 0, dots = 0;
+    uint64_t hash = 0;
+  };
+  Checkpoint Mark() const {
+    return Checkpoint{.log_size = undo_log.size(), .lx = lx, .ly = ly,
+                      .dots = dots, .hash = hash};
+  }
+  // Restore the board to its state at the checkpoint, which must
+  // have been taken while recording (and not already undone).
+  void Undo(const Checkpoint &checkpoint);
+  // Cell index and its previous value.
+  std::vector<std::pair<int, uint8_t>> undo_log;
+
+  // Save image of the board state after the solution, including the path
+  // drawn by the solution.
+  void SaveImage(const std::string &filename, int scale = 7,
+                 const std::string &sol = "");
+  // Same, streaming the solution (in two passes) so that memory
+  // doesn't depend on its length.
+  void SaveImage(const std::string &filename, int scale,
+                 MoveReader *reader);
+
+  // Save a heatmap of how many times the solution visits each cell,
+  // with scale x scale pixels per cell. Dots that it misses are
+  // magenta. This is linear in the size of the board plus the length
+  // of the solution.
+  void SaveHeatmap(const std::string &filename, int scale,
+                   const std::string &sol);
+  void SaveHeatmap(const std::string &filename, int scale,
+                   MoveReader *reader);
+
+  // Play the moves (UDLR), updating the board. Returns the moves
+  // that actually moved lambda man (i.e. without the ones into walls).
+  std::string Play(std::string_view s);
+  // Play all the moves from the reader. Returns the number that
+  // actually moved lambda man, without storing them.
+  int64_t Play(MoveReader *reader);
+};
+
+// Loads the puzzle format (# . L), surrounding it with walls so
+// that the board is two cells bigger in each dimension. The file is
+// mapped and scanned in place, without copying it into lines.
+Board FromFile(const std::string &filename);
+
+// Compact binary form of the board, for tools that load many boards
+// or snapshots: the walls and dots as bitsets, plus lambda man's
+// position. Walls that were bumped into ('@') come back as '#'.
+std::string SerializeBoard(const Board &board);
+// Reads one board from the front of the data and advances past it,
+// so that serialized boards can simply be concatenated. Aborts on
+// malformed input.
+Board DeserializeBoard(std::string_view *data);
+// All the boards in a file of concatenated SerializeBoard output.
+std::vector<Board> LoadBoards(const std::string &filename);
+
+// Breadth-first distances (in moves) from (x, y) to every cell, one
+// uint16 per cell, indexed like Board::cells. Walls and cells that
+// can't be reached are UNREACHABLE.
+inline constexpr uint16_t UNREACHABLE = 0xFFFF;
+std::vector<uint16_t> DistanceField(const Board &board, int x, int y);
+
+// For search. Same board, but walls and dots are packed into bitsets,
+// one or more 64-bit words per row. Since the board is surrounded by
+// walls, moving never needs bounds checks.
+struct BitBoard {
+  explicit BitBoard(const Board &board);
+  // Loads the puzzle format directly into the bitsets, without
+  // building a Board first. Same result as BitBoard(FromFile(f)).
+  static BitBoard Load(const std::string &filename);
+
+  // Directions for the decoded move streams. NONE is for padding
+  // paths to the same length in PlayBatch; it doesn't move.
+  enum Dir : uint8_t { UP = 0, RIGHT = 1, DOWN = 2, LEFT = 3, NONE = 4 };
+  // Decode a string of UDLR.
+  static std::vector<uint8_t> DecodeDirs(std::string_view s);
+  static std::string EncodeDirs(const std::vector<uint8_t> &dirs);
+
+  int width = 0, height = 0;
+  // Number of words per row. Positions are bit indices y * stride + x,
+  // with stride = words_per_row * 64.
+  int words_per_row = 0;
+  int stride = 0;
+  std::vector<uint64_t> walls;
+  std::vector<uint64_t> dots;
+
+  // Lambda man's position, as a bit index.
+  int pos = 0;
+
+  int X() const { return pos % stride; }
+  int Y() const { return pos / stride; }
+  bool IsWall(int p) const { return (walls[p >> 6] >> (p & 63)) & 1; }
+  bool IsDot(int p) const { return (dots[p >> 6] >> (p & 63)) & 1; }
+
+  // Offset of the position for each Dir.
+  int Delta(uint8_t d) const {
+    switch (d) {
+    case UP: return -stride;
+    case RIGHT: return 1;
+    case DOWN: return stride;
+    case LEFT: return -1;
+    default: return 0;
+    }
+  }
+
+  // Make one move. Returns 1 if we ate a dot, otherwise 0.
+  int Step(uint8_t d) {
+    const int np = pos + Delta(d);
+    if (!IsWall(np)) pos = np;
+    uint64_t &w = dots[pos >> 6];
+    const uint64_t bit = uint64_t{1} << (pos & 63);
+    const int ate = (w & bit) ? 1 : 0;
+    w &= ~bit;
+    return ate;
+  }
+
+  // Play the decoded moves, eating dots. Returns the number of dots
+  // remaining.
+  int Play(const uint8_t *dirs, size_t n);
+  int Play(const std::vector<uint8_t> &dirs) {
+    return Play(dirs.data(), dirs.size());
+  }
+
+  // Counts with popcount.
+  int DotsRemaining() const;
+
+  // Simulate num independent paths, each n moves long, starting from
+  // this board's current state (which is not modified). Writes the
+  // number of dots remaining after each path to remaining[i]. Uses
+  // AVX2 for the movement of eight paths at a time when available.
+  void PlayBatch(const uint8_t *const *paths, int num, size_t n,
+                 int *remaining) const;
+
+ private:
+  BitBoard() = default;
+};
+
+#endif
@@ -0,0 +1,476 @@
+#include "lambdaman-board.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/logging.h"
+#include "base/stringprintf.h"
+#include "arcfour.h"
+#include "lambdaman-graph.h"
+#include "randutil.h"
+#include "util.h"
+
+// Run from the cc directory.
+static std::string PuzzleFile(int n) {
+  return StringPrintf("../puzzles/lambdaman/lambdaman%d.txt", n);
+}
+
+static std::string SolutionMoves(int n) {
+  std::string soln = Util::ReadFile(
+      StringPrintf("../solutions/lambdaman/lambdaman%d.txt", n));
+  CHECK(soln.find("solve lambdaman") == 0);
+  (void)Util::chop(soln);
+  (void)Util::chop(soln);
+  return Util::NormalizeWhitespace(soln);
+}
+
+// The bitboard agrees with the board on the saved solutions.
+static void TestSolutions() {
+  for (int n : {2, 3, 5, 7, 9, 20}) {
+    Board board = FromFile(PuzzleFile(n));
+    BitBoard bitboard(board);
+    CHECK(bitboard.DotsRemaining() == board.dots);
+    CHECK(bitboard.X() == board.lx && bitboard.Y() == board.ly);
+
+    const std::string moves = SolutionMoves(n);
+    board.Play(moves);
+    const int remaining = bitboard.Play(BitBoard::DecodeDirs(moves));
+    CHECK(remaining == board.dots) << n << ": " << remaining << " vs "
+                                   << board.dots;
+    CHECK(remaining == 0) << n;
+    CHECK(bitboard.X() == board.lx && bitboard.Y() == board.ly) << n;
+  }
+}
+
+// Random walks, including into walls.
+static void TestRandom() {
+  ArcFour rc("bitboard");
+  for (int n : {1, 4, 11, 21}) {
+    const Board start = FromFile(PuzzleFile(n));
+    const BitBoard bitstart(start);
+
+    // Not a multiple of eight, so that we also test the tail.
+    constexpr int NUM = 19;
+    constexpr int LEN = 5000;
+    std::vector<std::vector<uint8_t>> paths(NUM);
+    std::vector<const uint8_t *> ptrs;
+    for (auto &path : paths) {
+      for (int i = 0; i < LEN; i++) path.push_back(RandTo(&rc, 4));
+      ptrs.push_back(path.data());
+    }
+
+    std::vector<int> remaining(NUM, -1);
+    bitstart.PlayBatch(ptrs.data(), NUM, LEN, remaining.data());
+
+    for (int i = 0; i < NUM; i++) {
+      Board board = start;
+      board.Play(BitBoard::EncodeDirs(paths[i]));
+
+      BitBoard bitboard = bitstart;
+      CHECK(bitboard.Play(paths[i]) == board.dots);
+      CHECK(bitboard.X() == board.lx && bitboard.Y() == board.ly);
+      CHECK(remaining[i] == board.dots) << n << " path " << i << ": " <<
+        remaining[i] << " vs " << board.dots;
+    }
+  }
+}
+
+// Applying and undoing random segments restores the board, and the
+// incremental hash agrees with the one computed from scratch.
+static void TestUndo() {
+  ArcFour rc("undo");
+  for (int n : {4, 11}) {
+    Board board = FromFile(PuzzleFile(n));
+    const Board start = board;
+    board.record_undo = true;
+
+    auto RandomMoves = [&rc](int len) {
+        std::string s;
+        for (int i = 0; i < len; i++) s.push_back("UDLR"[RandTo(&rc, 4)]);
+        return s;
+      };
+
+    std::vector<Board::Checkpoint> marks;
+    std::vector<Board> copies;
+    for (int i = 0; i < 20; i++) {
+      marks.push_back(board.Mark());
+      copies.push_back(board);
+      board.Play(RandomMoves(1 + RandTo(&rc, 300)));
+      CHECK(board.hash == board.ComputeHash()) << n << " " << i;
+    }
+
+    // Undo in reverse order, sometimes several at once.
+    while (!marks.empty()) {
+      const int k = std::min((int)marks.size(), 1 + (int)RandTo(&rc, 3));
+      marks.resize(marks.size() - (k - 1));
+      copies.resize(copies.size() - (k - 1));
+      board.Undo(marks.back());
+      CHECK(board.cells == copies.back().cells);
+      CHECK(board.dots == copies.back().dots);
+      CHECK(board.lx == copies.back().lx && board.ly == copies.back().ly);
+      CHECK(board.hash == copies.back().hash);
+      marks.pop_back();
+      copies.pop_back();
+    }
+    CHECK(board.cells == start.cells);
+    CHECK(board.undo_log.empty());
+
+    // Transposition: the same state reached two ways has the same
+    // hash, and a different state (almost surely) doesn't.
+    Board a = start, b = start;
+    a.Play("RRLL");
+    CHECK(a.hash != start.hash || a.dots == start.dots);
+    b.Play("RRLLRL");
+    CHECK(a.hash == b.hash);
+  }
+}
+
+// Reading in small chunks from the file (with the marker) gives the
+// same moves as the string, and the board plays the same.
+static void TestMoveReader() {
+  for (int n : {5, 9, 21}) {
+    const std::string moves = SolutionMoves(n);
+    for (size_t chunk : {1, 7, 4096}) {
+      std::unique_ptr<MoveReader> reader = MoveReader::OpenFile(
+          StringPrintf("../solutions/lambdaman/lambdaman%d.txt", n), chunk);
+      for (int pass = 0; pass < 2; pass++) {
+        std::string got;
+        for (char c; reader->Next(&c); /* in loop */) got.push_back(c);
+        CHECK(got == moves) << n << " " << chunk << " " << pass;
+        reader->Rewind();
+      }
+    }
+
+    const std::string with_marker =
+      StringPrintf("solve lambdaman%d \n", n) + moves + "\n";
+    MoveReader mem(with_marker);
+    Board board = FromFile(PuzzleFile(n));
+    Board expected = board;
+    const std::string simple = expected.Play(moves);
+    CHECK(board.Play(&mem) == (int64_t)simple.size());
+    CHECK(board.cells == expected.cells);
+    CHECK(board.dots == 0);
+
+    // Without the marker.
+    MoveReader bare(moves);
+    std::string got;
+    for (char c; bare.Next(&c); /* in loop */) got.push_back(c);
+    CHECK(got == moves);
+  }
+}
+
+// Whitespace and line endings don't matter, the bit-packed loader
+// agrees with the board, and boards survive serialization.
+static void TestLoad() {
+  const std::string tmp = "lambdaman-board-test-tmp.txt";
+  CHECK(Util::WriteFile(tmp, "\r\n  #.L. \r\n\n\t..#.\r\n"));
+  const Board small = FromFile(tmp);
+  CHECK(small.width == 6 && small.height == 4);
+  CHECK(small.lx == 3 && small.ly == 1);
+  CHECK(small.dots == 5);
+  const std::string expected =
+    "######"
+    "##. .#"
+    "#..#.#"
+    "######";
+  CHECK(std::string(small.cells.begin(), small.cells.end()) == expected);
+
+  std::string all;
+  std::vector<Board> boards;
+  ArcFour rc("load");
+  for (int n = 1; n <= 21; n++) {
+    Board board = FromFile(PuzzleFile(n));
+    const BitBoard loaded = BitBoard::Load(PuzzleFile(n));
+    const BitBoard converted(board);
+    CHECK(loaded.width == converted.width &&
+          loaded.height == converted.height &&
+          loaded.pos == converted.pos &&
+          loaded.walls == converted.walls &&
+          loaded.dots == converted.dots) << n;
+
+    // Bump into some walls, which serialize as plain walls.
+    std::string moves;
+    for (int i = 0; i < 500; i++) moves.push_back("UDLR"[RandTo(&rc, 4)]);
+    board.Play(moves);
+    for (uint8_t &c : board.cells) if (c == '@') c = '#';
+    boards.push_back(board);
+    all += SerializeBoard(board);
+  }
+
+  CHECK(Util::WriteFile(tmp, all));
+  const std::vector<Board> got = LoadBoards(tmp);
+  CHECK(got.size() == boards.size());
+  for (int i = 0; i < (int)got.size(); i++) {
+    CHECK(got[i].width == boards[i].width &&
+          got[i].height == boards[i].height) << i;
+    CHECK(got[i].lx == boards[i].lx && got[i].ly == boards[i].ly) << i;
+    CHECK(got[i].dots == boards[i].dots) << i;
+    CHECK(got[i].cells == boards[i].cells) << i;
+    CHECK(got[i].hash == boards[i].hash) << i;
+  }
+  std::remove(tmp.c_str());
+}
+
+// The cells reachable from start through open cells, not going
+// through the removed cell (if any).
+static std::vector<int> Reach(const MazeGraph &g, int start, int removed) {
+  std::vector<bool> seen(g.open.size(), false);
+  std::vector<int> queue = {start};
+  seen[start] = true;
+  for (size_t head = 0; head < queue.size(); head++) {
+    for (int d : g.delta) {
+      const int n = queue[head] + d;
+      if (g.open[n] && !seen[n] && n != removed) {
+        seen[n] = true;
+        queue.push_back(n);
+      }
+    }
+  }
+  return queue;
+}
+
+// Checks the analysis against the definitions, by brute force where
+// that's simple.
+static void CheckMazeGraph(const Board &board, const MazeGraph &g,
+                           const std::string &what) {
+  const int num = (int)board.cells.size();
+  auto Adjacent = [&g](int a, int b) {
+      for (int d : g.delta) if (a + d == b) return true;
+      return false;
+    };
+
+  // Corridors are chains of adjacent cells between junctions, and
+  // together they use every edge of the grid exactly once (so none
+  // is found twice) and every degree-two cell exactly once.
+  int edges = 0;
+  for (int i = 0; i < num; i++)
+    if (g.open[i])
+      for (int d : g.delta) edges += g.open[i + d] ? 1 : 0;
+  edges /= 2;
+  std::vector<int> covered(num, 0);
+  int corridor_edges = 0;
+  for (const MazeGraph::Corridor &c : g.corridors) {
+    if (c.a == c.b && g.degree[c.a] == 2) {
+      // A ring.
+      CHECK(!c.cells.empty()) << what;
+      covered[c.a]++;
+    } else {
+      CHECK(g.degree[c.a] != 2 && g.degree[c.b] != 2) << what;
+    }
+    int prev = c.a;
+    for (int cell : c.cells) {
+      CHECK(g.degree[cell] == 2) << what;
+      CHECK(Adjacent(prev, cell)) << what;
+      covered[cell]++;
+      prev = cell;
+    }
+    CHECK(Adjacent(prev, c.b)) << what;
+    corridor_edges += (int)c.cells.size() + 1;
+  }
+  CHECK(corridor_edges == edges) << what << ": " << corridor_edges
+                                 << " vs " << edges;
+  for (int i = 0; i < num; i++) {
+    if (g.open[i] && g.degree[i] == 2) {
+      CHECK(covered[i] == 1) << what;
+    }
+  }
+
+  // The 2-core, by removing cells with fewer than two neighbors until
+  // there are none.
+  std::vector<bool> core = g.open;
+  for (bool changed = true; changed; /* in loop */) {
+    changed = false;
+    for (int i = 0; i < num; i++) {
+      if (!core[i]) continue;
+      int n = 0;
+      for (int d : g.delta) n += core[i + d] ? 1 : 0;
+      if (n < 2) {
+        core[i] = false;
+        changed = true;
+      }
+    }
+  }
+  CHECK(core == g.in_core) << what;
+
+  // A reachable cell is an articulation point exactly when removing
+  // it disconnects the others.
+  const int root = board.ly * board.width + board.lx;
+  const std::vector<int> from_root = Reach(g, root, -1);
+  const int reachable = (int)from_root.size();
+  std::vector<bool> is_reachable(num, false);
+  for (int i : from_root) is_reachable[i] = true;
+  for (int i = 0; i < num; i++) {
+    if (!is_reachable[i]) {
+      CHECK(!g.articulation[i]) << what;
+      continue;
+    }
+    int other = -1;
+    for (int d : g.delta) if (g.open[i + d]) other = i + d;
+    const bool cut = other >= 0 &&
+      (int)Reach(g, other, i).size() < reachable - 1;
+    CHECK(cut == g.articulation[i]) << what << ": cell " << i;
+  }
+
+  // Blocks: each edge among reachable cells is in exactly one, and
+  // two blocks only meet at an articulation point. A block of more
+  // than two cells stays connected without any one of its cells.
+  std::vector<int> block_edges(num * 4, 0);
+  std::vector<int> blocks_of(num, 0);
+  std::vector<int> in_block(num, -1);
+  for (int b = 0; b < (int)g.blocks.size(); b++) {
+    const std::vector<int> &block = g.blocks[b];
+    CHECK(std::is_sorted(block.begin(), block.end())) << what;
+    for (int cell : block) {
+      CHECK(is_reachable[cell]) << what;
+      blocks_of[cell]++;
+      in_block[cell] = b;
+    }
+    for (int cell : block)
+      for (int d = 0; d < 4; d++)
+        if (in_block[cell + g.delta[d]] == b) block_edges[cell * 4 + d]++;
+
+    for (int removed : block) {
+      if (block.size() <= 2) break;
+      const int start = block[0] == removed ? block[1] : block[0];
+      std::vector<int> queue = {start};
+      std::vector<bool> seen(num, false);
+      seen[start] = true;
+      for (size_t head = 0; head < queue.size(); head++) {
+        for (int d : g.delta) {
+          const int n = queue[head] + d;
+          if (in_block[n] == b && n != removed && !seen[n]) {
+            seen[n] = true;
+            queue.push_back(n);
+          }
+        }
+      }
+      CHECK(queue.size() == block.size() - 1) << what;
+    }
+  }
+  for (int i = 0; i < num; i++) {
+    if (!is_reachable[i]) continue;
+    CHECK(blocks_of[i] >= 1) << what;
+    if (blocks_of[i] > 1) {
+      CHECK(g.articulation[i]) << what;
+    }
+    for (int d = 0; d < 4; d++) {
+      if (g.open[i + g.delta[d]]) {
+        CHECK(block_edges[i * 4 + d] == 1) << what << ": cell " << i;
+      }
+    }
+  }
+}
+
+static MazeGraph GraphOf(const std::string &text, Board *board) {
+  const std::string tmp = "lambdaman-board-test-tmp.txt";
+  CHECK(Util::WriteFile(tmp, text));
+  *board = FromFile(tmp);
+  std::remove(tmp.c_str());
+  return MazeGraph(*board);
+}
+
+// Small boards where we know the answers, then the definitions on
+// the real puzzles.
+static void TestMazeGraph() {
+  Board board;
+  auto Cell = [&board](int x, int y) {
+      // Skip the border.
+      return (y + 1) * board.width + x + 1;
+    };
+  auto Count = [](const std::vector<bool> &v) {
+      return (int)std::count(v.begin(), v.end(), true);
+    };
+
+  {
+    // A ring: one corridor from a cell to itself, all in the core
+    // and in one block.
+    const MazeGraph g = GraphOf("L...\n.##.\n....\n", &board);
+    CheckMazeGraph(board, g, "ring");
+    CHECK(g.junctions.empty());
+    CHECK(g.dead_ends.empty());
+    CHECK(g.corridors.size() == 1);
+    CHECK(g.corridors[0].a == g.corridors[0].b);
+    CHECK(g.corridors[0].cells.size() == 9);
+    CHECK(Count(g.in_core) == 10);
+    CHECK(g.blocks.size() == 1 && g.blocks[0].size() == 10);
+    CHECK(Count(g.articulation) == 0);
+  }
+
+  {
+    // A tree: three arms off the start, each found from both ends
+    // but kept once. Every edge is its own block.
+    const MazeGraph g = GraphOf("...L...\n###.###\n###.###\n", &board);
+    CheckMazeGraph(board, g, "tree");
+    CHECK(g.junctions.size() == 4);
+    CHECK(g.dead_ends.size() == 3);
+    CHECK(g.corridors.size() == 3);
+    for (const MazeGraph::Corridor &c : g.corridors) {
+      CHECK(c.a == Cell(3, 0) || c.b == Cell(3, 0));
+      const int end = c.a == Cell(3, 0) ? c.b : c.a;
+      if (end == Cell(3, 2)) {
+        CHECK(c.cells == std::vector<int>{Cell(3, 1)});
+      } else {
+        CHECK(end == Cell(0, 0) || end == Cell(6, 0));
+        CHECK(c.cells.size() == 2);
+      }
+    }
+    CHECK(Count(g.in_core) == 0);
+    CHECK(g.blocks.size() == 8);
+    for (const auto &block : g.blocks) CHECK(block.size() == 2);
+    CHECK(Count(g.articulation) == 6);
+    CHECK(g.articulation[Cell(3, 0)]);
+    CHECK(!g.articulation[Cell(0, 0)]);
+  }
+
+  {
+    // Two rooms joined through one cell.
+    const MazeGraph g = GraphOf("...#...\n.L.....\n...#...\n", &board);
+    CheckMazeGraph(board, g, "rooms");
+    CHECK(g.dead_ends.empty());
+    CHECK(Count(g.in_core) == 19);
+    CHECK(Count(g.articulation) == 3);
+    CHECK(g.articulation[Cell(2, 1)] && g.articulation[Cell(3, 1)] &&
+          g.articulation[Cell(4, 1)]);
+    std::vector<size_t> sizes;
+    for (const auto &block : g.blocks) sizes.push_back(block.size());
+    std::sort(sizes.begin(), sizes.end());
+    CHECK((sizes == std::vector<size_t>{2, 2, 9, 9}));
+    // The joining cell is a corridor between the two rooms.
+    int joins = 0;
+    for (const MazeGraph::Corridor &c : g.corridors)
+      if (c.cells == std::vector<int>{Cell(3, 1)}) joins++;
+    CHECK(joins == 1);
+  }
+
+  {
+    // Walled off cells aren't in any block.
+    const MazeGraph g = GraphOf("L.#..\n", &board);
+    CheckMazeGraph(board, g, "split");
+    CHECK(g.blocks.size() == 1 && g.blocks[0].size() == 2);
+  }
+
+  // The brute force is quadratic, so skip the biggest puzzles
+  // (18 to 21).
+  for (int n = 1; n <= 21; n++) {
+    const Board puzzle = FromFile(PuzzleFile(n));
+    if (puzzle.cells.size() > 15000) continue;
+    CheckMazeGraph(puzzle, MazeGraph(puzzle), StringPrintf("puzzle %d", n));
+  }
+}
+
+int main(int argc, char **argv) {
+
+  TestSolutions();
+  TestRandom();
+  TestUndo();
+  TestMoveReader();
+  TestLoad();
+  TestMazeGraph();
+
+  printf("OK");
+  return 0;
+}
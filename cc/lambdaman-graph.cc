@@ -0,0 +1,168 @@
+#include "lambdaman-graph.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/logging.h"
+#include "base/stringprintf.h"
+#include "lambdaman-board.h"
+
+MazeGraph::MazeGraph(const Board &board) : width(board.width) {
+  const int num = (int)board.cells.size();
+  delta[0] = -width;
+  delta[1] = 1;
+  delta[2] = width;
+  delta[3] = -1;
+
+  open.resize(num, false);
+  for (int i = 0; i < num; i++)
+    open[i] = board.cells[i] != '#' && board.cells[i] != '@';
+
+  // The board is surrounded by walls, so neighbors of open cells are
+  // always in bounds.
+  degree.resize(num, 0);
+  for (int i = 0; i < num; i++) {
+    if (!open[i]) continue;
+    for (int d : delta) degree[i] += open[i + d] ? 1 : 0;
+    if (degree[i] == 1) dead_ends.push_back(i);
+    if (degree[i] != 2) junctions.push_back(i);
+  }
+
+  // Corridors. Walk from each junction in each direction; each
+  // corridor is found from both ends, so keep it from one.
+  std::vector<bool> in_corridor(num, false);
+  auto Walk = [&](int from, int first) {
+      Corridor c{.a = from};
+      int prev = from, cur = first;
+      while (degree[cur] == 2 && cur != from) {
+        c.cells.push_back(cur);
+        in_corridor[cur] = true;
+        int next = -1;
+        for (int d : delta)
+          if (open[cur + d] && cur + d != prev) next = cur + d;
+        // A two-cell loop would have no next cell other than prev.
+        if (next < 0) break;
+        prev = cur;
+        cur = next;
+      }
+      c.b = cur;
+      return c;
+    };
+  for (int j : junctions) {
+    for (int d : delta) {
+      if (!open[j + d]) continue;
+      Corridor c = Walk(j, j + d);
+      // From the other end, we'd see the cells reversed.
+      const int first = c.cells.empty() ? c.b : c.cells.front();
+      const int last = c.cells.empty() ? c.a : c.cells.back();
+      if (std::make_pair(c.a, first) <= std::make_pair(c.b, last))
+        corridors.push_back(std::move(c));
+    }
+  }
+  // Rings of degree-two cells with no junctions.
+  for (int i = 0; i < num; i++) {
+    if (open[i] && degree[i] == 2 && !in_corridor[i]) {
+      in_corridor[i] = true;
+      for (int d : delta) {
+        if (open[i + d]) {
+          Corridor c = Walk(i, i + d);
+          c.b = i;
+          corridors.push_back(std::move(c));
+          break;
+        }
+      }
+    }
+  }
+
+  // 2-core by peeling.
+  in_core = open;
+  {
+    std::vector<int> deg = degree;
+    std::vector<int> queue;
+    for (int i = 0; i < num; i++)
+      if (open[i] && deg[i] <= 1) queue.push_back(i);
+    for (size_t head = 0; head < queue.size(); head++) {
+      const int c = queue[head];
+      if (!in_core[c]) continue;
+      in_core[c] = false;
+      for (int d : delta) {
+        const int n = c + d;
+        if (in_core[n] && --deg[n] <= 1) queue.push_back(n);
+      }
+    }
+  }
+
+  // Biconnected components with Tarjan's algorithm, iteratively since
+  // a maze can be very deep.
+  articulation.resize(num, false);
+  std::vector<int> disc(num, -1), low(num, 0), parent(num, -1);
+  std::vector<uint8_t> next_dir(num, 0);
+  std::vector<std::pair<int, int>> edges;
+  std::vector<int> stack;
+  int time = 0;
+
+  const int root = board.ly * width + board.lx;
+  disc[root] = low[root] = time++;
+  stack.push_back(root);
+  int root_children = 0;
+  while (!stack.empty()) {
+    const int v = stack.back();
+    if (next_dir[v] < 4) {
+      const int w = v + delta[next_dir[v]++];
+      if (!open[w]) continue;
+      if (disc[w] < 0) {
+        parent[w] = v;
+        if (v == root) root_children++;
+        edges.emplace_back(v, w);
+        disc[w] = low[w] = time++;
+        stack.push_back(w);
+      } else if (w != parent[v] && disc[w] < disc[v]) {
+        low[v] = std::min(low[v], disc[w]);
+        edges.emplace_back(v, w);
+      }
+      continue;
+    }
+
+    stack.pop_back();
+    const int p = parent[v];
+    if (p < 0) continue;
+    low[p] = std::min(low[p], low[v]);
+    if (low[v] >= disc[p]) {
+      if (p != root) articulation[p] = true;
+      std::vector<int> block;
+      for (;;) {
+        CHECK(!edges.empty());
+        const auto [a, b] = edges.back();
+        edges.pop_back();
+        block.push_back(a);
+        block.push_back(b);
+        if (a == p && b == v) break;
+      }
+      std::sort(block.begin(), block.end());
+      block.erase(std::unique(block.begin(), block.end()), block.end());
+      blocks.push_back(std::move(block));
+    }
+  }
+  if (root_children > 1) articulation[root] = true;
+  if (blocks.empty()) blocks.push_back({root});
+}
+
+std::string MazeGraph::Summary() const {
+  int cells = 0, core = 0, arts = 0;
+  for (int i = 0; i < (int)open.size(); i++) {
+    if (open[i]) cells++;
+    if (in_core[i]) core++;
+    if (articulation[i]) arts++;
+  }
+  size_t biggest = 0;
+  for (const auto &b : blocks) biggest = std::max(biggest, b.size());
+  return StringPrintf("%d open cells. Corridor graph: %d junctions, "
+                      "%d corridors. %d dead ends; %d cells in the 2-core. "
+                      "%d blocks (biggest %d cells), %d articulation points.",
+                      cells, (int)junctions.size(), (int)corridors.size(),
+                      (int)dead_ends.size(), core, (int)blocks.size(),
+                      (int)biggest, arts);
+}
@@ -0,0 +1,51 @@
+
+#ifndef LAMBDAMAN_GRAPH_H_
+#define LAMBDAMAN_GRAPH_H_
+
+#include <string>
+#include <vector>
+
+#include "lambdaman-board.h"
+
+// Structure of the board as a graph of its open cells, for dividing
+// up big mazes. Cells are indexed like Board::cells.
+struct MazeGraph {
+  explicit MazeGraph(const Board &board);
+
+  int width = 0;
+  std::vector<bool> open;
+  // Number of open neighbors of each cell.
+  std::vector<int> degree;
+
+  // Offsets of the four neighbors, in the order URDL.
+  int delta[4] = {};
+
+  // Corridor graph: cells with degree other than two are junctions
+  // (or dead ends), and each maximal chain of degree-two cells between
+  // them is contracted into a corridor. A loop with no junctions at
+  // all is a corridor from one of its cells to itself.
+  struct Corridor {
+    int a = 0, b = 0;
+    // The degree-two cells in between, in order from a.
+    std::vector<int> cells;
+  };
+  std::vector<int> junctions;
+  std::vector<Corridor> corridors;
+
+  // Cells with exactly one open neighbor.
+  std::vector<int> dead_ends;
+  // Cells that are left after repeatedly removing dead ends (the
+  // 2-core). Everything else hangs off it in trees.
+  std::vector<bool> in_core;
+
+  // Biconnected components, as sets of cells, and the articulation
+  // points that join them. Only includes cells reachable from the
+  // start. Components with a single cell (an isolated start) are
+  // included, so that every reachable cell is in some block.
+  std::vector<std::vector<int>> blocks;
+  std::vector<bool> articulation;
+
+  std::string Summary() const;
+};
+
+#endif
@@ -0,0 +1,428 @@
+
+// Searches for a small lambdaman program, rather than a short path.
+// Plans are sequences of structured operations: literal moves,
+// "repeat this block k times" (which includes running until we hit
+// a wall, and serpentine sweeps like Solve21's strafe-fill), and
+// square spirals. The cost of a plan is the exact size of the icfp
+// program that it emits, and we do beam search over plans, expanding
+// the beam in parallel and simulating on a BitBoard. The best complete
+// plan is checked by evaluating the program and playing the result on
+// the Board.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "ansi.h"
+#include "base/logging.h"
+#include "base/stringprintf.h"
+#include "bignum/big.h"
+#include "icfp.h"
+#include "lambdaman-board.h"
+#include "threadutil.h"
+#include "timer.h"
+#include "util.h"
+#include "verify-solution.h"
+
+using namespace icfp;
+
+static constexpr char DIR_CHARS[4] = {'U', 'R', 'D', 'L'};
+
+struct Op {
+  enum Kind { MOVES, REPEAT, SPIRAL };
+  Kind kind = MOVES;
+  // For MOVES, the moves. For SPIRAL, the four directions that it
+  // turns through.
+  std::string moves;
+  // For REPEAT, the number of times. For SPIRAL, the number of loops.
+  int64_t count = 0;
+  // For REPEAT.
+  std::vector<Op> body;
+};
+
+// The moves that the operation makes (including ones into walls).
+static std::string Expand(const Op &op) {
+  switch (op.kind) {
+  case Op::MOVES:
+    return op.moves;
+  case Op::REPEAT: {
+    std::string block;
+    for (const Op &o : op.body) block += Expand(o);
+    std::string out;
+    out.reserve(block.size() * op.count);
+    for (int64_t i = 0; i < op.count; i++) out += block;
+    return out;
+  }
+  case Op::SPIRAL: {
+    std::string out;
+    for (int64_t i = 0; i < op.count; i++) {
+      out += std::string(2 * i + 1, op.moves[0]);
+      out += std::string(2 * i + 1, op.moves[1]);
+      out += std::string(2 * i + 2, op.moves[2]);
+      out += std::string(2 * i + 2, op.moves[3]);
+    }
+    return out;
+  }
+  }
+  return "";
+}
+
+// Helper functions, bound in the program's preamble when used.
+//   r s n = s repeated n times.
+//   p d i m = spiral loops i..m-1, turning through the directions in d.
+static constexpr std::string_view Y_COMBINATOR =
+  "B$ Lf B$ Lx B$ vf B$ vx vx Lx B$ vf B$ vx vx ";
+static constexpr std::string_view REPEAT_DEF =
+  "Lr Ls Ln ? B= vn I! S B. vs B$ B$ vr vs B- vn I\"";
+static constexpr std::string_view SPIRAL_DEF =
+  "Lp Ld Li Lm ? B= vi vm S B. B. B. B. "
+  "B$ B$ vr BT I\" vd B+ B* I# vi I\" "
+  "B$ B$ vr BT I\" BD I\" vd B+ B* I# vi I\" "
+  "B$ B$ vr BT I\" BD I# vd B+ B* I# vi I# "
+  "B$ B$ vr BT I\" BD I$ vd B+ B* I# vi I# "
+  "B$ B$ B$ vp vd B+ vi I\" vm";
+
+struct Uses {
+  bool repeat = false, spiral = false;
+};
+
+static std::string EmitSeq(const std::vector<Op> &ops, size_t start,
+                           Uses *uses);
+
+static std::string Emit(const Op &op, Uses *uses) {
+  switch (op.kind) {
+  case Op::MOVES:
+    return "S" + EncodeString(op.moves);
+  case Op::REPEAT:
+    uses->repeat = true;
+    return "B$ B$ vr " + EmitSeq(op.body, 0, uses) + " " +
+      IntConstant(op.count);
+  case Op::SPIRAL:
+    uses->repeat = true;
+    uses->spiral = true;
+    return "B$ B$ B$ vp S" + EncodeString(op.moves) + " I! " +
+      IntConstant(op.count);
+  }
+  return "";
+}
+
+static std::string EmitSeq(const std::vector<Op> &ops, size_t start,
+                           Uses *uses) {
+  CHECK(start < ops.size());
+  if (start + 1 == ops.size()) return Emit(ops[start], uses);
+  return "B. " + Emit(ops[start], uses) + " " +
+    EmitSeq(ops, start + 1, uses);
+}
+
+// The complete program. Leading literal moves are merged into the
+// "solve" string.
+static std::string EmitProgram(int problem, const std::vector<Op> &ops) {
+  const std::string prefix = StringPrintf("solve lambdaman%d ", problem);
+  std::vector<Op> all = ops;
+  if (!all.empty() && all[0].kind == Op::MOVES) {
+    all[0].moves = prefix + all[0].moves;
+  } else {
+    all.insert(all.begin(), Op{.kind = Op::MOVES, .moves = prefix});
+  }
+
+  Uses uses;
+  std::string body = EmitSeq(all, 0, &uses);
+  if (uses.spiral) {
+    body = StringPrintf("B$ Lp %s %s%s", body.c_str(),
+                        std::string(Y_COMBINATOR).c_str(),
+                        std::string(SPIRAL_DEF).c_str());
+  }
+  if (uses.repeat) {
+    body = StringPrintf("B$ Lr %s %s%s", body.c_str(),
+                        std::string(Y_COMBINATOR).c_str(),
+                        std::string(REPEAT_DEF).c_str());
+  }
+  return body;
+}
+
+// Run of one character, as a literal or repeat, whichever is smaller.
+static Op Run(char c, int64_t n) {
+  Op lit{.kind = Op::MOVES, .moves = std::string(n, c)};
+  Op rep{.kind = Op::REPEAT, .count = n,
+         .body = {Op{.kind = Op::MOVES, .moves = std::string(1, c)}}};
+  Uses unused;
+  return Emit(lit, &unused).size() <= Emit(rep, &unused).size() ? lit : rep;
+}
+
+struct State {
+  BitBoard board;
+  std::vector<Op> ops;
+  int64_t size = 0;
+  int dots = 0;
+};
+
+static void Append(int problem, State *state, Op op) {
+  // Consecutive literals are cheaper as one string.
+  if (op.kind == Op::MOVES && !state->ops.empty() &&
+      state->ops.back().kind == Op::MOVES) {
+    state->ops.back().moves += op.moves;
+  } else {
+    state->ops.push_back(std::move(op));
+  }
+  state->size = EmitProgram(problem, state->ops).size();
+}
+
+static uint64_t StateHash(const BitBoard &board) {
+  uint64_t h = 0xCAFEBABE ^ (uint64_t)board.pos;
+  for (uint64_t w : board.dots) {
+    h ^= w;
+    h *= 0x9E3779B97F4A7C15ULL;
+    h ^= h >> 29;
+  }
+  return h;
+}
+
+// Number of moves until we'd hit a wall going in direction d.
+static int RunLength(const BitBoard &board, int d) {
+  int n = 0;
+  for (int p = board.pos + board.Delta(d); !board.IsWall(p);
+       p += board.Delta(d))
+    n++;
+  return n;
+}
+
+// Moves along a shortest path to the nearest dot, or nullopt if
+// there are none reachable.
+static std::optional<std::string> PathToNearestDot(const BitBoard &board) {
+  std::vector<int8_t> from(board.stride * board.height, -1);
+  std::vector<int> queue = {board.pos};
+  from[board.pos] = 4;
+  for (size_t head = 0; head < queue.size(); head++) {
+    const int p = queue[head];
+    for (int d = 0; d < 4; d++) {
+      const int np = p + board.Delta(d);
+      if (board.IsWall(np) || from[np] >= 0) continue;
+      from[np] = d;
+      if (board.IsDot(np)) {
+        std::string path;
+        for (int q = np; q != board.pos; q -= board.Delta(from[q]))
+          path.push_back(DIR_CHARS[from[q]]);
+        std::reverse(path.begin(), path.end());
+        return {path};
+      }
+      queue.push_back(np);
+    }
+  }
+  return std::nullopt;
+}
+
+// Candidate next operations from the state.
+static std::vector<Op> Candidates(const BitBoard &board) {
+  std::vector<Op> ops;
+  const int big = std::max(board.width, board.height);
+
+  for (int d = 0; d < 4; d++) {
+    // Single steps, so that the structured operations can start
+    // from somewhere else.
+    if (!board.IsWall(board.pos + board.Delta(d)))
+      ops.push_back(Op{.kind = Op::MOVES,
+                       .moves = std::string(1, DIR_CHARS[d])});
+    // Run to the wall.
+    const int n = RunLength(board, d);
+    if (n > 1) ops.push_back(Run(DIR_CHARS[d], n));
+  }
+
+  // Returns the largest count (up to max) for which the last
+  // repetition of the block still eats a dot, or 0.
+  auto ProductiveCount = [&board](std::string_view block, int max) {
+      BitBoard b = board;
+      const std::vector<uint8_t> dirs = BitBoard::DecodeDirs(block);
+      int dots = b.DotsRemaining();
+      int best = 0;
+      for (int k = 1; k <= max; k++) {
+        const int after = b.Play(dirs);
+        if (after < dots) best = k;
+        if (after == 0) break;
+        dots = after;
+      }
+      return best;
+    };
+
+  // Serpentine sweeps: all the way along d1, one step in d2, all the
+  // way back, one step in d2.
+  for (int d1 = 0; d1 < 4; d1++) {
+    for (int d2 : {(d1 + 1) % 4, (d1 + 3) % 4}) {
+      const char a = DIR_CHARS[d1], b = DIR_CHARS[d2],
+        back = DIR_CHARS[(d1 + 2) % 4];
+      const std::string block = std::string(big, a) + b +
+        std::string(big, back) + b;
+      const int k = ProductiveCount(block, big);
+      if (k == 0) continue;
+      Op rep{.kind = Op::REPEAT, .count = k};
+      rep.body = {Run(a, big), Op{.kind = Op::MOVES, .moves = {b}},
+                  Run(back, big), Op{.kind = Op::MOVES, .moves = {b}}};
+      ops.push_back(std::move(rep));
+    }
+  }
+
+  // Spirals, clockwise and counterclockwise, starting in any
+  // direction.
+  for (int d = 0; d < 4; d++) {
+    for (int turn : {1, 3}) {
+      std::string dirs;
+      for (int i = 0; i < 4; i++) dirs.push_back(DIR_CHARS[(d + turn * i) % 4]);
+      Op spiral{.kind = Op::SPIRAL, .moves = dirs, .count = 1};
+      // Each loop is a different block, so search incrementally.
+      BitBoard b = board;
+      int dots = b.DotsRemaining();
+      int best = 0;
+      for (int i = 0; i < big / 2 + 1; i++) {
+        std::string loop = std::string(2 * i + 1, dirs[0]) +
+          std::string(2 * i + 1, dirs[1]) + std::string(2 * i + 2, dirs[2]) +
+          std::string(2 * i + 2, dirs[3]);
+        const int after = b.Play(BitBoard::DecodeDirs(loop));
+        if (after < dots) best = i + 1;
+        if (after == 0) break;
+        dots = after;
+      }
+      if (best > 1) {
+        spiral.count = best;
+        ops.push_back(std::move(spiral));
+      }
+    }
+  }
+
+  if (std::optional<std::string> path = PathToNearestDot(board))
+    ops.push_back(Op{.kind = Op::MOVES, .moves = path.value()});
+
+  return ops;
+}
+
+int main(int argc, char **argv) {
+  ANSI::Init();
+
+  CHECK(argc >= 2) << "./lambdaman-planner.exe problem_num "
+    "[-beam n] [-lambda bytes_per_dot] [-seconds s] [-out file.icfp]\n"
+    "Run from the cc directory.";
+
+  const int problem = atoi(argv[1]);
+  int beam_width = 64;
+  // Estimated program bytes per remaining dot, for ranking plans that
+  // aren't done.
+  double lambda = 1.0;
+  double seconds = 60.0;
+  std::string outfile;
+  for (int i = 2; i < argc; i++) {
+    std::string arg = argv[i];
+    CHECK(i + 1 < argc) << arg << " needs an argument";
+    if (arg == "-beam") {
+      beam_width = atoi(argv[++i]);
+    } else if (arg == "-lambda") {
+      lambda = atof(argv[++i]);
+    } else if (arg == "-seconds") {
+      seconds = atof(argv[++i]);
+    } else if (arg == "-out") {
+      outfile = argv[++i];
+    } else {
+      LOG(FATAL) << "Unknown argument " << arg;
+    }
+  }
+
+  const Board start_board =
+    FromFile(StringPrintf("../puzzles/lambdaman/lambdaman%d.txt", problem));
+  const int threads = std::max(1, (int)std::thread::hardware_concurrency());
+
+  auto Score = [lambda](const State &s) {
+      return s.size + lambda * s.dots;
+    };
+
+  State start{.board = BitBoard(start_board)};
+  start.dots = start.board.DotsRemaining();
+  start.size = EmitProgram(problem, {}).size();
+
+  std::optional<State> best;
+  std::vector<State> beam = {start};
+  Timer timer;
+  for (int depth = 0; !beam.empty(); depth++) {
+    if (timer.Seconds() > seconds) {
+      // Out of time. Finish the best plan greedily.
+      State s = *std::min_element(
+          beam.begin(), beam.end(),
+          [&](const State &a, const State &b) { return Score(a) < Score(b); });
+      while (std::optional<std::string> path = PathToNearestDot(s.board)) {
+        s.board.Play(BitBoard::DecodeDirs(path.value()));
+        Append(problem, &s, Op{.kind = Op::MOVES, .moves = path.value()});
+      }
+      s.dots = s.board.DotsRemaining();
+      if (!best.has_value() || s.size < best->size) best = std::move(s);
+      fprintf(stderr, "Out of time at depth %d.\n", depth);
+      break;
+    }
+
+    std::vector<std::vector<State>> children(beam.size());
+    ParallelComp(beam.size(), [&](int64_t i) {
+        const State &parent = beam[i];
+        for (Op &op : Candidates(parent.board)) {
+          State child = parent;
+          child.dots = child.board.Play(BitBoard::DecodeDirs(Expand(op)));
+          if (child.dots == parent.dots) continue;
+          Append(problem, &child, std::move(op));
+          children[i].push_back(std::move(child));
+        }
+      }, threads);
+
+    // Dedupe on the board state, keeping the smallest program.
+    std::unordered_map<uint64_t, State> next;
+    for (std::vector<State> &cs : children) {
+      for (State &child : cs) {
+        if (best.has_value() && child.size >= best->size) continue;
+        if (child.dots == 0) {
+          best = std::move(child);
+          fprintf(stderr, "Depth %d: solved in " AGREEN("%lld") " bytes\n",
+                  depth, (long long)best->size);
+          continue;
+        }
+        const uint64_t h = StateHash(child.board);
+        auto it = next.find(h);
+        if (it == next.end()) {
+          next.emplace(h, std::move(child));
+        } else if (child.size < it->second.size) {
+          it->second = std::move(child);
+        }
+      }
+    }
+
+    beam.clear();
+    for (auto &[h, s] : next) beam.push_back(std::move(s));
+    std::sort(beam.begin(), beam.end(),
+              [&](const State &a, const State &b) {
+                return Score(a) < Score(b);
+              });
+    if ((int)beam.size() > beam_width)
+      beam.erase(beam.begin() + beam_width, beam.end());
+    if (!beam.empty()) {
+      fprintf(stderr, "Depth %d: %d states. Best has %d dots left, "
+              "%lld bytes\n", depth, (int)beam.size(), beam[0].dots,
+              (long long)beam[0].size);
+    }
+  }
+
+  CHECK(best.has_value()) << "No plan found?";
+  const std::string program = EmitProgram(problem, best->ops);
+  const Verdict verdict = VerifySolution("lambdaman", problem, program);
+  CHECK(verdict.status == Verdict::VALID) <<
+    "Program does not actually solve it! " << verdict.error;
+  fprintf(stderr, "Verified " AGREEN("%d") " byte program in %s.\n",
+          (int)program.size(), ANSI::Time(timer.Seconds()).c_str());
+
+  if (!outfile.empty()) {
+    Util::WriteFile(outfile, program);
+    fprintf(stderr, "Wrote %s\n", outfile.c_str());
+  }
+  printf("%s\n", program.c_str());
+  return 0;
+}
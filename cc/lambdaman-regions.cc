@@ -0,0 +1,371 @@
+
+// Solves a big lambdaman maze by dividing it into regions. The
+// regions are the biconnected components (blocks) of the open cells,
+// which form a tree joined at articulation points. Each block with
+// dots in it (or below it) is solved on its own, in parallel: a
+// closed tour from the point where we enter it, through its dots and
+// the articulation points that lead to other regions that need
+// visiting. The tours are stitched together by walking the tree, with
+// the most expensive branch last at each point, since we don't need
+// to come back from wherever we end.
+//
+// In a tree-like maze most blocks are single corridors, so this is
+// mostly the optimal depth-first order for the dead ends; in an open
+// board it's one big block and we just do the TSP.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "ansi.h"
+#include "base/logging.h"
+#include "base/stringprintf.h"
+#include "lambdaman-board.h"
+#include "lambdaman-graph.h"
+#include "threadutil.h"
+#include "timer.h"
+#include "util.h"
+
+static constexpr char DIRS[4] = {'U', 'R', 'D', 'L'};
+
+// A block of the graph, with its cells renumbered and its own
+// adjacency, so that BFS stays inside it.
+struct Region {
+  // Cell where we enter it (the articulation point towards the start,
+  // or the start itself).
+  int entry = -1;
+  std::vector<int> cells;
+  // Cells that the tour has to visit (not including the entry).
+  std::vector<int> required;
+  // The closed tour, as cells, starting and ending at entry.
+  std::vector<int> tour;
+  // Its length in moves.
+  int64_t length = 0;
+  // Length of everything under this region, for ordering.
+  int64_t subtree_length = 0;
+};
+
+// Breadth-first distances from local cell src to every local cell,
+// staying in the region.
+static void LocalBFS(const MazeGraph &graph,
+                     const std::vector<int> &cells,
+                     const std::unordered_map<int, int> &local,
+                     int src, std::vector<int> *dist) {
+  dist->assign(cells.size(), -1);
+  std::vector<int> queue = {src};
+  (*dist)[src] = 0;
+  for (size_t head = 0; head < queue.size(); head++) {
+    const int l = queue[head];
+    for (int d : graph.delta) {
+      auto it = local.find(cells[l] + d);
+      if (it == local.end() || (*dist)[it->second] >= 0) continue;
+      (*dist)[it->second] = (*dist)[l] + 1;
+      queue.push_back(it->second);
+    }
+  }
+}
+
+// Fill in the region's tour. With few enough points, nearest neighbor
+// and then 2-opt on exact distances; otherwise just nearest neighbor.
+static void SolveRegion(const MazeGraph &graph, int max_exact,
+                        Region *region) {
+  std::unordered_map<int, int> local;
+  for (int i = 0; i < (int)region->cells.size(); i++)
+    local[region->cells[i]] = i;
+
+  // Point 0 is the entry.
+  std::vector<int> points = {region->entry};
+  for (int r : region->required) points.push_back(r);
+  const int n = (int)points.size();
+
+  std::vector<int> dist;
+  std::vector<int> order = {0};
+  int64_t length = 0;
+  if (n <= max_exact) {
+    std::vector<int> m(n * n);
+    for (int i = 0; i < n; i++) {
+      LocalBFS(graph, region->cells, local, local.at(points[i]), &dist);
+      for (int j = 0; j < n; j++) {
+        m[i * n + j] = dist[local.at(points[j])];
+        CHECK(m[i * n + j] >= 0);
+      }
+    }
+    auto D = [&](int a, int b) { return m[a * n + b]; };
+
+    std::vector<bool> used(n, false);
+    used[0] = true;
+    for (int k = 1; k < n; k++) {
+      const int cur = order.back();
+      int best = -1;
+      for (int j = 1; j < n; j++)
+        if (!used[j] && (best < 0 || D(cur, j) < D(cur, best))) best = j;
+      used[best] = true;
+      order.push_back(best);
+    }
+    order.push_back(0);
+
+    for (bool improved = true; improved; /* in loop */) {
+      improved = false;
+      for (int i = 1; i + 2 < (int)order.size(); i++) {
+        for (int j = i + 1; j + 1 < (int)order.size(); j++) {
+          const int a = order[i - 1], b = order[i];
+          const int c = order[j], e = order[j + 1];
+          if (D(a, c) + D(b, e) < D(a, b) + D(c, e)) {
+            std::reverse(order.begin() + i, order.begin() + j + 1);
+            improved = true;
+          }
+        }
+      }
+    }
+    for (int i = 0; i + 1 < (int)order.size(); i++)
+      length += D(order[i], order[i + 1]);
+
+  } else {
+    // Point index for each local cell, or -1.
+    std::vector<int> point_of(region->cells.size(), -1);
+    for (int i = 1; i < n; i++) point_of[local.at(points[i])] = i;
+    std::vector<int> seen(region->cells.size(), -1);
+    std::vector<std::pair<int, int>> queue;
+    for (int k = 1; k < n; k++) {
+      // BFS until we find the nearest unused point.
+      const int src = local.at(points[order.back()]);
+      queue.clear();
+      queue.emplace_back(src, 0);
+      seen[src] = k;
+      int best = -1, best_dist = 0;
+      for (size_t head = 0; head < queue.size() && best < 0; head++) {
+        const auto [l, dl] = queue[head];
+        for (int d : graph.delta) {
+          auto it = local.find(region->cells[l] + d);
+          if (it == local.end() || seen[it->second] == k) continue;
+          seen[it->second] = k;
+          const int p = point_of[it->second];
+          if (p > 0) {
+            point_of[it->second] = -1;
+            best = p;
+            best_dist = dl + 1;
+            break;
+          }
+          queue.emplace_back(it->second, dl + 1);
+        }
+      }
+      CHECK(best > 0);
+      length += best_dist;
+      order.push_back(best);
+    }
+    LocalBFS(graph, region->cells, local, local.at(points[0]), &dist);
+    length += dist[local.at(points[order.back()])];
+    order.push_back(0);
+  }
+
+  region->tour.clear();
+  for (int i : order) region->tour.push_back(points[i]);
+  region->length = length;
+}
+
+int main(int argc, char **argv) {
+  ANSI::Init();
+
+  CHECK(argc >= 2) << "./lambdaman-regions.exe problem_num "
+    "[-max-exact n] [-out file.txt]\n"
+    "Run from the cc directory.";
+
+  const int problem = atoi(argv[1]);
+  int max_exact = 400;
+  std::string outfile;
+  for (int i = 2; i < argc; i++) {
+    std::string arg = argv[i];
+    CHECK(i + 1 < argc) << arg << " needs an argument";
+    if (arg == "-max-exact") {
+      max_exact = atoi(argv[++i]);
+    } else if (arg == "-out") {
+      outfile = argv[++i];
+    } else {
+      LOG(FATAL) << "Unknown argument " << arg;
+    }
+  }
+
+  const Board board =
+    FromFile(StringPrintf("../puzzles/lambdaman/lambdaman%d.txt", problem));
+  const int threads = std::max(1, (int)std::thread::hardware_concurrency());
+
+  Timer timer;
+  const MazeGraph graph(board);
+  fprintf(stderr, "%s\n", graph.Summary().c_str());
+
+  // Block-cut tree, rooted at the start.
+  const int num_cells = (int)board.cells.size();
+  const int start = board.ly * board.width + board.lx;
+  std::vector<std::vector<int>> cell_blocks(num_cells);
+  for (int b = 0; b < (int)graph.blocks.size(); b++)
+    for (int c : graph.blocks[b]) cell_blocks[c].push_back(b);
+
+  std::vector<Region> regions(graph.blocks.size());
+  // Blocks to enter from each cell, and the blocks in BFS order.
+  std::vector<std::vector<int>> children(num_cells);
+  std::vector<int> order;
+  std::vector<bool> seen(graph.blocks.size(), false);
+  for (int b : cell_blocks[start]) {
+    regions[b].entry = start;
+    children[start].push_back(b);
+    seen[b] = true;
+    order.push_back(b);
+  }
+  for (size_t head = 0; head < order.size(); head++) {
+    const int b = order[head];
+    regions[b].cells = graph.blocks[b];
+    for (int c : graph.blocks[b]) {
+      if (c == regions[b].entry || !graph.articulation[c]) continue;
+      for (int b2 : cell_blocks[c]) {
+        if (seen[b2]) continue;
+        seen[b2] = true;
+        regions[b2].entry = c;
+        children[c].push_back(b2);
+        order.push_back(b2);
+      }
+    }
+  }
+
+  // Which blocks have dots in them or below them, bottom up.
+  std::vector<bool> needed(regions.size(), false);
+  for (int k = (int)order.size() - 1; k >= 0; k--) {
+    Region &region = regions[order[k]];
+    bool need = false;
+    for (int c : region.cells) {
+      if (c == region.entry) continue;
+      bool child_needed = false;
+      for (int b2 : children[c]) child_needed = child_needed || needed[b2];
+      if (board.cells[c] == '.' || child_needed) {
+        region.required.push_back(c);
+        need = true;
+      }
+    }
+    needed[order[k]] = need;
+  }
+  int dots_found = 0;
+  for (int c = 0; c < num_cells; c++)
+    if (board.cells[c] == '.' && !cell_blocks[c].empty()) dots_found++;
+  CHECK(dots_found == board.dots) << "Some dots are unreachable.";
+
+  std::vector<int> todo;
+  for (int b : order) if (needed[b]) todo.push_back(b);
+  fprintf(stderr, "%d regions to solve.\n", (int)todo.size());
+  ParallelComp(todo.size(), [&](int64_t i) {
+      SolveRegion(graph, max_exact, &regions[todo[i]]);
+    }, threads);
+  fprintf(stderr, "Solved regions in %s.\n",
+          ANSI::Time(timer.Seconds()).c_str());
+
+  // Cost of each subtree, bottom up, so that we can visit the biggest
+  // branch last.
+  for (int k = (int)order.size() - 1; k >= 0; k--) {
+    Region &region = regions[order[k]];
+    if (!needed[order[k]]) continue;
+    region.subtree_length = region.length;
+    for (int c : region.required)
+      for (int b2 : children[c])
+        if (needed[b2]) region.subtree_length += regions[b2].subtree_length;
+  }
+  for (std::vector<int> &cs : children) {
+    std::erase_if(cs, [&](int b) { return !needed[b]; });
+    std::sort(cs.begin(), cs.end(), [&](int a, int b) {
+        return regions[a].subtree_length < regions[b].subtree_length;
+      });
+  }
+
+  // Stitch into a list of waypoints with an explicit stack, since the
+  // tree can be very deep.
+  std::vector<int> waypoints;
+  struct Frame {
+    int cell = 0;
+    // Next child block of the cell.
+    size_t child = 0;
+    // When in a block's tour, the block and next index.
+    int block = -1;
+    size_t idx = 0;
+  };
+  std::vector<Frame> stack = {Frame{.cell = start}};
+  while (!stack.empty()) {
+    Frame &f = stack.back();
+    if (f.block >= 0) {
+      const Region &region = regions[f.block];
+      if (f.idx == region.tour.size()) {
+        stack.pop_back();
+        continue;
+      }
+      const int c = region.tour[f.idx++];
+      waypoints.push_back(c);
+      // Visit the regions below this cell, and then continue the
+      // tour. (Not for the entry, which is handled by the parent.)
+      if (f.idx > 1 && f.idx < region.tour.size() && !children[c].empty())
+        stack.push_back(Frame{.cell = c});
+    } else {
+      if (f.child == children[f.cell].size()) {
+        stack.pop_back();
+        continue;
+      }
+      const int b = children[f.cell][f.child++];
+      stack.push_back(Frame{.block = b});
+    }
+  }
+
+  // Connect the waypoints with shortest paths, stopping once every
+  // dot is eaten, which drops the walk home.
+  Board play = board;
+  std::string path;
+  std::vector<int> from(num_cells, -1);
+  std::vector<int> stamp(num_cells, 0);
+  int cur_stamp = 0;
+  for (int w : waypoints) {
+    if (play.dots == 0) break;
+    const int src = play.ly * play.width + play.lx;
+    if (w == src) continue;
+    cur_stamp++;
+    std::vector<int> queue = {src};
+    stamp[src] = cur_stamp;
+    for (size_t head = 0; head < queue.size() && stamp[w] != cur_stamp;
+         head++) {
+      const int c = queue[head];
+      for (int d = 0; d < 4; d++) {
+        const int n = c + graph.delta[d];
+        if (!graph.open[n] || stamp[n] == cur_stamp) continue;
+        stamp[n] = cur_stamp;
+        from[n] = d;
+        queue.push_back(n);
+      }
+    }
+    CHECK(stamp[w] == cur_stamp);
+    std::string leg;
+    for (int c = w; c != src; c -= graph.delta[from[c]])
+      leg.push_back(DIRS[from[c]]);
+    std::reverse(leg.begin(), leg.end());
+    for (char m : leg) {
+      if (play.dots == 0) break;
+      path += play.Play(std::string_view(&m, 1));
+    }
+  }
+
+  {
+    Board check = board;
+    check.Play(path);
+    CHECK(check.dots == 0) << "Bug: " << check.dots << " dots left.";
+  }
+
+  const std::string soln =
+    StringPrintf("solve lambdaman%d ", problem) + path;
+  fprintf(stderr, "Path of " AGREEN("%d") " moves in %s.\n",
+          (int)path.size(), ANSI::Time(timer.Seconds()).c_str());
+  if (!outfile.empty()) {
+    Util::WriteFile(outfile, soln);
+    fprintf(stderr, "Wrote %s\n", outfile.c_str());
+  } else {
+    printf("%s\n", soln.c_str());
+  }
+  return 0;
+}
@@ -0,0 +1,232 @@
+
+// Searches for a short lambdaman solution of the form "random walk
+// from an LCG", like lambdaman4 and lambdaman9. The program is
+//
+//  (. "solve lambdamanN "
+//     ((fix (λ c. λ d. λ e.
+//        if (= d steps) then ""
+//        else (. (T 1 (D (% (/ e K) 4) "UDLR"))
+//                (c (+ d 1) (% (+ (* e A) C) M))))) 0 seed))
+//
+// so its size depends on the LCG parameters and the sizes of seed and
+// steps. We try every seed (in parallel) for each parameter set,
+// running the walk until it eats every dot (or until it can't
+// anymore), and keep the shortest program.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ansi.h"
+#include "base/logging.h"
+#include "base/stringprintf.h"
+#include "bignum/big.h"
+#include "icfp.h"
+#include "lambdaman-board.h"
+#include "periodically.h"
+#include "threadutil.h"
+#include "timer.h"
+#include "util.h"
+#include "verify-solution.h"
+
+using namespace icfp;
+
+// Linear congruential generator e' = (e * a + c) % m. Each move is
+// (e / k) % 4, indexing into "UDLR".
+struct LCG {
+  uint64_t a = 0, c = 0, m = 0, k = 0;
+};
+
+static constexpr LCG LCGS[] = {
+  // Numerical recipes; what we used for lambdaman4, 9, 10.
+  {.a = 1664525, .c = 1013904223, .m = 4294967296, .k = 1073741824},
+  // Smaller constants are cheaper to write down.
+  {.a = 69069, .c = 1, .m = 4294967296, .k = 1073741824},
+  // MINSTD. No increment, so the program is shorter, but the seed
+  // can't be zero.
+  {.a = 48271, .c = 0, .m = 2147483647, .k = 536870912},
+};
+
+static inline uint8_t LCGMove(const LCG &lcg, uint64_t e) {
+  static constexpr uint8_t UDLR[4] = {
+    BitBoard::UP, BitBoard::DOWN, BitBoard::LEFT, BitBoard::RIGHT,
+  };
+  return UDLR[(e / lcg.k) % 4];
+}
+
+static inline uint64_t LCGNext(const LCG &lcg, uint64_t e) {
+  // e < m <= 2^32 and a < 2^21 (the largest is 1664525), so the
+  // product is below 2^53 and this doesn't overflow.
+  return (e * lcg.a + lcg.c) % lcg.m;
+}
+
+static std::string MakeProgram(int problem, const LCG &lcg,
+                               uint64_t seed, int64_t steps) {
+  const std::string next = lcg.c == 0 ?
+    StringPrintf("B%% B* ve %s %s",
+                 IntConstant(lcg.a).c_str(), IntConstant(lcg.m).c_str()) :
+    StringPrintf("B%% B+ B* ve %s %s %s",
+                 IntConstant(lcg.a).c_str(), IntConstant(lcg.c).c_str(),
+                 IntConstant(lcg.m).c_str());
+  return StringPrintf(
+      "B. S%s "
+      "B$ B$ B$ Lf B$ Lx B$ vf B$ vx vx Lx B$ vf B$ vx vx "
+      "Lc Ld Le ? B= vd %s S "
+      "B. BT I\" BD B%% B/ ve %s I%% S%s "
+      "B$ B$ vc B+ vd I\" %s "
+      "I! %s",
+      EncodeString(StringPrintf("solve lambdaman%d ", problem)).c_str(),
+      IntConstant(steps).c_str(),
+      IntConstant(lcg.k).c_str(),
+      EncodeString("UDLR").c_str(),
+      next.c_str(),
+      IntConstant(seed).c_str());
+}
+
+struct Found {
+  int lcg_idx = -1;
+  uint64_t seed = 0;
+  int64_t steps = 0;
+  int64_t size = 0;
+};
+
+// Returns the number of steps it takes for the walk to eat every
+// dot, or nullopt if it doesn't within max_steps.
+static std::optional<int64_t> Walk(const BitBoard &start, const LCG &lcg,
+                                   uint64_t seed, int64_t max_steps) {
+  BitBoard board = start;
+  int dots = board.DotsRemaining();
+  uint64_t e = seed;
+  for (int64_t step = 0; step < max_steps; step++) {
+    // Each step eats at most one dot.
+    if (dots > max_steps - step) return std::nullopt;
+    dots -= board.Step(LCGMove(lcg, e));
+    if (dots == 0) return {step + 1};
+    e = LCGNext(lcg, e);
+  }
+  return std::nullopt;
+}
+
+int main(int argc, char **argv) {
+  ANSI::Init();
+
+  CHECK(argc >= 2) << "./lambdaman-rw-search.exe problem_num "
+    "[-seeds n] [-max-steps n] [-out file.icfp]\n"
+    "Run from the cc directory.";
+
+  const int problem = atoi(argv[1]);
+  uint64_t num_seeds = 1000000;
+  int64_t max_steps = 1000000;
+  std::string outfile;
+  for (int i = 2; i < argc; i++) {
+    std::string arg = argv[i];
+    CHECK(i + 1 < argc) << arg << " needs an argument";
+    if (arg == "-seeds") {
+      num_seeds = strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "-max-steps") {
+      max_steps = strtoll(argv[++i], nullptr, 10);
+    } else if (arg == "-out") {
+      outfile = argv[++i];
+    } else {
+      LOG(FATAL) << "Unknown argument " << arg;
+    }
+  }
+
+  const Board board =
+    FromFile(StringPrintf("../puzzles/lambdaman/lambdaman%d.txt", problem));
+  const BitBoard start(board);
+
+  const int threads = std::max(1, (int)std::thread::hardware_concurrency());
+
+  std::mutex m;
+  Found best;
+  Timer timer;
+  Periodically status_per(5.0);
+
+  for (int lcg_idx = 0; lcg_idx < (int)std::size(LCGS); lcg_idx++) {
+    const LCG &lcg = LCGS[lcg_idx];
+    // Size of the program without the seed and steps, which we can
+    // get by subtracting their size from a sample.
+    const int64_t base_size =
+      (int64_t)MakeProgram(problem, lcg, 0, 0).size() -
+      2 * IntConstant(0).size();
+
+    static constexpr uint64_t CHUNK = 1024;
+    const uint64_t num_chunks = (num_seeds + CHUNK - 1) / CHUNK;
+    ParallelComp(num_chunks, [&](int64_t chunk) {
+        for (uint64_t seed = chunk * CHUNK;
+             seed < std::min((uint64_t)(chunk + 1) * CHUNK, num_seeds);
+             seed++) {
+          // Zero is a fixed point without the increment.
+          if (lcg.c == 0 && seed == 0) continue;
+
+          // Don't bother with walks that can't beat the best.
+          int64_t limit = max_steps;
+          {
+            std::unique_lock<std::mutex> ml(m);
+            if (best.lcg_idx >= 0) {
+              const int64_t budget =
+                best.size - base_size - (int64_t)IntConstant(seed).size();
+              if (budget <= 0) continue;
+              // Longest step count that fits in the budget, which
+              // is I and then budget - 1 base-94 digits. (With equal
+              // size we still want fewer steps, so allow equality.)
+              int64_t fits = 1;
+              for (int d = 0; d < budget - 1 && fits <= max_steps; d++)
+                fits *= 94;
+              limit = std::min(fits - 1, max_steps);
+            }
+          }
+          if (limit <= 0) continue;
+
+          if (std::optional<int64_t> steps =
+              Walk(start, lcg, seed, limit)) {
+            const int64_t size = base_size + IntConstant(seed).size() +
+              IntConstant(steps.value()).size();
+            std::unique_lock<std::mutex> ml(m);
+            if (best.lcg_idx < 0 || size < best.size ||
+                (size == best.size && steps.value() < best.steps)) {
+              best = Found{.lcg_idx = lcg_idx, .seed = seed,
+                           .steps = steps.value(), .size = size};
+              fprintf(stderr, "New best: " AGREEN("%lld") " bytes "
+                      "(lcg %d, seed %llu, %lld steps)\n",
+                      (long long)size, lcg_idx,
+                      (unsigned long long)seed, (long long)steps.value());
+            }
+          }
+        }
+
+        if (status_per.ShouldRun()) {
+          fprintf(stderr, "%s\n",
+                  ANSI::ProgressBar(chunk, num_chunks,
+                                    StringPrintf("lcg %d", lcg_idx),
+                                    timer.Seconds()).c_str());
+        }
+      }, threads);
+  }
+
+  CHECK(best.lcg_idx >= 0) << "No walk solves lambdaman" << problem <<
+    " within " << max_steps << " steps. Try more seeds or steps?";
+
+  std::string program = MakeProgram(problem, LCGS[best.lcg_idx],
+                                    best.seed, best.steps);
+  CHECK((int64_t)program.size() == best.size);
+  const Verdict verdict = VerifySolution("lambdaman", problem, program);
+  CHECK(verdict.status == Verdict::VALID) <<
+    "Program does not actually solve it! " << verdict.error;
+  fprintf(stderr, "Verified " AGREEN("%d") " byte program in %s.\n",
+          (int)program.size(), ANSI::Time(timer.Seconds()).c_str());
+
+  if (!outfile.empty()) {
+    Util::WriteFile(outfile, program);
+    fprintf(stderr, "Wrote %s\n", outfile.c_str());
+  }
+  printf("%s\n", program.c_str());
+  return 0;
+}
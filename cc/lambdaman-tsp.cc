@@ -0,0 +1,353 @@
+
+// Solves a lambdaman board as a traveling salesman problem. Dots are
+// grouped into clusters (square tiles, sized so that there aren't too
+// many), we compute the BFS distance field from each cluster in
+// parallel, and then find a short open tour from lambda man's start
+// through every cluster with nearest-neighbor followed by 2-opt and
+// Or-opt until we run out of time. The tour is then turned into moves
+// by walking to the nearest uneaten dot of each cluster in turn.
+//
+// This optimizes the length of the path, not the size of a program
+// that generates it, so it's mainly useful for the boards that we
+// solve with a (compressed) string.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "ansi.h"
+#include "base/logging.h"
+#include "base/stringprintf.h"
+#include "lambdaman-board.h"
+#include "threadutil.h"
+#include "timer.h"
+#include "util.h"
+
+struct Cluster {
+  // Cell index of a dot near the middle of the cluster.
+  int rep = 0;
+  // Cell indices of all the dots.
+  std::vector<int> dots;
+};
+
+// Groups dots into tiles of size x size cells, using the smallest size
+// that results in at most max_nodes clusters.
+static std::vector<Cluster> MakeClusters(const Board &board, int max_nodes) {
+  for (int size = 1; /* in loop */; size++) {
+    const int tw = (board.width + size - 1) / size;
+    const int th = (board.height + size - 1) / size;
+    std::vector<int> tile_cluster(tw * th, -1);
+    std::vector<Cluster> clusters;
+    for (int y = 0; y < board.height; y++) {
+      for (int x = 0; x < board.width; x++) {
+        if (board.At(x, y) != '.') continue;
+        int &c = tile_cluster[(y / size) * tw + (x / size)];
+        if (c < 0) {
+          c = (int)clusters.size();
+          clusters.emplace_back();
+        }
+        clusters[c].dots.push_back(y * board.width + x);
+      }
+    }
+
+    if ((int)clusters.size() > max_nodes) continue;
+
+    for (Cluster &cluster : clusters) {
+      double mx = 0.0, my = 0.0;
+      for (int c : cluster.dots) {
+        mx += c % board.width;
+        my += c / board.width;
+      }
+      mx /= cluster.dots.size();
+      my /= cluster.dots.size();
+      auto SqDist = [&](int c) {
+          const double dx = c % board.width - mx;
+          const double dy = c / board.width - my;
+          return dx * dx + dy * dy;
+        };
+      cluster.rep = *std::min_element(
+          cluster.dots.begin(), cluster.dots.end(),
+          [&](int a, int b) { return SqDist(a) < SqDist(b); });
+    }
+
+    fprintf(stderr, "%d clusters with tile size %d.\n",
+            (int)clusters.size(), size);
+    return clusters;
+  }
+}
+
+// Distances between tour nodes. Node 0 is lambda man's start, nodes
+// 1..n are the clusters, and the last node is a sentinel at distance
+// zero from everything, so that an open path can be treated as a
+// tour with both endpoints fixed.
+struct Distances {
+  int num = 0;
+  std::vector<uint16_t> d;
+  int operator()(int a, int b) const { return d[a * num + b]; }
+};
+
+static Distances ComputeDistances(const Board &board,
+                                  const std::vector<Cluster> &clusters,
+                                  int threads) {
+  std::vector<int> reps;
+  reps.push_back(board.ly * board.width + board.lx);
+  for (const Cluster &cluster : clusters) reps.push_back(cluster.rep);
+
+  Distances dist;
+  dist.num = (int)reps.size() + 1;
+  dist.d.resize(dist.num * dist.num, 0);
+
+  ParallelComp(reps.size(), [&](int64_t i) {
+      const std::vector<uint16_t> field =
+        DistanceField(board, reps[i] % board.width, reps[i] / board.width);
+      uint16_t *row = &dist.d[i * dist.num];
+      for (int j = 0; j < (int)reps.size(); j++) {
+        CHECK(field[reps[j]] != UNREACHABLE) << "Unreachable dot at " <<
+          reps[j] % board.width << "," << reps[j] / board.width;
+        row[j] = field[reps[j]];
+      }
+    }, threads);
+
+  return dist;
+}
+
+static int64_t TourCost(const Distances &dist, const std::vector<int> &tour) {
+  int64_t cost = 0;
+  for (int i = 0; i + 1 < (int)tour.size(); i++)
+    cost += dist(tour[i], tour[i + 1]);
+  return cost;
+}
+
+static std::vector<int> NearestNeighbor(const Distances &dist) {
+  const int end = dist.num - 1;
+  std::vector<bool> used(dist.num, false);
+  std::vector<int> tour = {0};
+  used[0] = true;
+  for (int k = 1; k < end; k++) {
+    const int cur = tour.back();
+    int best = -1;
+    for (int j = 1; j < end; j++) {
+      if (!used[j] && (best < 0 || dist(cur, j) < dist(cur, best)))
+        best = j;
+    }
+    used[best] = true;
+    tour.push_back(best);
+  }
+  tour.push_back(end);
+  return tour;
+}
+
+// One pass of 2-opt: reverse segments tour[i..j] when that makes the
+// tour shorter. The endpoints are fixed. Returns true if anything
+// improved.
+static bool TwoOpt(const Distances &dist, std::vector<int> *tour,
+                   const Timer &timer, double seconds) {
+  std::vector<int> &t = *tour;
+  const int n = (int)t.size();
+  bool improved = false;
+  for (int i = 1; i < n - 2; i++) {
+    if (timer.Seconds() > seconds) break;
+    for (int j = i + 1; j < n - 1; j++) {
+      const int a = t[i - 1], b = t[i], c = t[j], e = t[j + 1];
+      const int delta = dist(a, c) + dist(b, e) - dist(a, b) - dist(c, e);
+      if (delta < 0) {
+        std::reverse(t.begin() + i, t.begin() + j + 1);
+        improved = true;
+      }
+    }
+  }
+  return improved;
+}
+
+// One pass of Or-opt: move segments of up to three nodes (possibly
+// reversing them) to a better place in the tour.
+static bool OrOpt(const Distances &dist, std::vector<int> *tour,
+                  const Timer &timer, double seconds) {
+  std::vector<int> &t = *tour;
+  bool improved = false;
+  for (int len = 1; len <= 3; len++) {
+    for (int i = 1; i + len < (int)t.size(); i++) {
+      if (timer.Seconds() > seconds) return improved;
+      const int n = (int)t.size();
+      const int first = t[i], last = t[i + len - 1];
+      const int prev = t[i - 1], next = t[i + len];
+      const int gain = dist(prev, first) + dist(last, next) - dist(prev, next);
+
+      int best_delta = 0, best_p = -1;
+      bool best_rev = false;
+      for (int p = 0; p + 1 < n; p++) {
+        // The edge (t[p], t[p + 1]) must not touch the segment.
+        if (p >= i - 1 && p < i + len) continue;
+        const int u = t[p], v = t[p + 1];
+        const int fwd = dist(u, first) + dist(last, v) - dist(u, v);
+        const int rev = dist(u, last) + dist(first, v) - dist(u, v);
+        const int delta = std::min(fwd, rev) - gain;
+        if (delta < best_delta) {
+          best_delta = delta;
+          best_p = p;
+          best_rev = rev < fwd;
+        }
+      }
+
+      if (best_p >= 0) {
+        std::vector<int> seg(t.begin() + i, t.begin() + i + len);
+        if (best_rev) std::reverse(seg.begin(), seg.end());
+        std::vector<int> out;
+        out.reserve(n);
+        for (int p = 0; p < n; p++) {
+          if (p >= i && p < i + len) continue;
+          out.push_back(t[p]);
+          if (p == best_p) out.insert(out.end(), seg.begin(), seg.end());
+        }
+        t = std::move(out);
+        improved = true;
+      }
+    }
+  }
+  return improved;
+}
+
+// Walk the tour, visiting each cluster by repeatedly moving to its
+// nearest uneaten dot. Returns the moves.
+static std::string MakePath(Board board,
+                            const std::vector<Cluster> &clusters,
+                            const std::vector<int> &tour) {
+  std::vector<int> cluster_of(board.cells.size(), -1);
+  for (int c = 0; c < (int)clusters.size(); c++)
+    for (int cell : clusters[c].dots) cluster_of[cell] = c;
+
+  const int w = board.width;
+  const int delta[4] = {-w, 1, w, -1};
+  static constexpr char DIRS[4] = {'U', 'R', 'D', 'L'};
+
+  // BFS state, reused. A cell is visited in this search if its stamp
+  // is the current one.
+  std::vector<int> stamp(board.cells.size(), 0);
+  std::vector<uint8_t> from(board.cells.size(), 0);
+  std::vector<int> queue;
+  int cur_stamp = 0;
+
+  std::string path;
+  auto Uneaten = [&](int c) {
+      for (int cell : clusters[c].dots)
+        if (board.cells[cell] == '.') return true;
+      return false;
+    };
+
+  for (int node : tour) {
+    if (node == 0 || node > (int)clusters.size()) continue;
+    const int c = node - 1;
+    while (Uneaten(c)) {
+      cur_stamp++;
+      queue.clear();
+      const int start = board.ly * w + board.lx;
+      queue.push_back(start);
+      stamp[start] = cur_stamp;
+      int target = -1;
+      for (size_t head = 0; head < queue.size() && target < 0; head++) {
+        const int cell = queue[head];
+        for (int d = 0; d < 4; d++) {
+          const int n = cell + delta[d];
+          const uint8_t v = board.cells[n];
+          if (v == '#' || v == '@' || stamp[n] == cur_stamp) continue;
+          stamp[n] = cur_stamp;
+          from[n] = d;
+          if (v == '.' && cluster_of[n] == c) {
+            target = n;
+            break;
+          }
+          queue.push_back(n);
+        }
+      }
+      CHECK(target >= 0);
+
+      std::string leg;
+      for (int cell = target; cell != start;
+           cell -= delta[from[cell]]) {
+        leg.push_back(DIRS[from[cell]]);
+      }
+      std::reverse(leg.begin(), leg.end());
+      // This eats any dots along the way, too.
+      path += board.Play(leg);
+    }
+  }
+  return path;
+}
+
+int main(int argc, char **argv) {
+  ANSI::Init();
+
+  CHECK(argc >= 2) << "./lambdaman-tsp.exe problem_num "
+    "[-seconds s] [-max-nodes n] [-out file.txt]\n"
+    "Run from the cc directory.";
+
+  const int problem = atoi(argv[1]);
+  double seconds = 10.0;
+  int max_nodes = 2000;
+  std::string outfile;
+  for (int i = 2; i < argc; i++) {
+    std::string arg = argv[i];
+    CHECK(i + 1 < argc) << arg << " needs an argument";
+    if (arg == "-seconds") {
+      seconds = atof(argv[++i]);
+    } else if (arg == "-max-nodes") {
+      max_nodes = atoi(argv[++i]);
+    } else if (arg == "-out") {
+      outfile = argv[++i];
+    } else {
+      LOG(FATAL) << "Unknown argument " << arg;
+    }
+  }
+
+  const Board board =
+    FromFile(StringPrintf("../puzzles/lambdaman/lambdaman%d.txt", problem));
+  const int threads = std::max(1, (int)std::thread::hardware_concurrency());
+
+  Timer timer;
+  const std::vector<Cluster> clusters = MakeClusters(board, max_nodes);
+  const Distances dist = ComputeDistances(board, clusters, threads);
+  fprintf(stderr, "Distances in %s.\n", ANSI::Time(timer.Seconds()).c_str());
+
+  std::vector<int> tour = NearestNeighbor(dist);
+  fprintf(stderr, "Nearest neighbor: %lld\n", (long long)TourCost(dist, tour));
+
+  // The time limit is for the local search.
+  Timer search_timer;
+  for (int pass = 0; search_timer.Seconds() < seconds; pass++) {
+    const bool two = TwoOpt(dist, &tour, search_timer, seconds);
+    const bool orr = OrOpt(dist, &tour, search_timer, seconds);
+    fprintf(stderr, "Pass %d: %lld\n", pass, (long long)TourCost(dist, tour));
+    if (!two && !orr) break;
+  }
+
+  const std::string path = MakePath(board, clusters, tour);
+
+  // Check it.
+  {
+    Board check = board;
+    check.Play(path);
+    CHECK(check.dots == 0) << "Bug: " << check.dots << " dots left.";
+  }
+
+  const std::string soln =
+    StringPrintf("solve lambdaman%d ", problem) + path;
+  const std::string existing = Util::NormalizeWhitespace(Util::ReadFile(
+      StringPrintf("../solutions/lambdaman/lambdaman%d.txt", problem)));
+  fprintf(stderr, "Path of " AGREEN("%d") " moves in %s. "
+          "(Saved solution is %d bytes.)\n",
+          (int)path.size(), ANSI::Time(timer.Seconds()).c_str(),
+          (int)existing.size());
+
+  if (!outfile.empty()) {
+    Util::WriteFile(outfile, soln);
+    fprintf(stderr, "Wrote %s\n", outfile.c_str());
+  } else {
+    printf("%s\n", soln.c_str());
+  }
+  return 0;
+}
@@ -0,0 +1,66 @@
+
+#ifndef MAPPED_FILE_H_
+#define MAPPED_FILE_H_
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#ifdef _WIN32
+# include <optional>
+# include "util.h"
+#else
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+#include "base/logging.h"
+
+// Read-only mapping of a whole file. The pages come from the page
+// cache, so processes that map the same file share the memory.
+// On Windows, this just reads the file into memory that we own.
+struct MappedFile {
+#ifdef _WIN32
+  explicit MappedFile(const std::string &filename) {
+    std::optional<std::string> contents = Util::ReadFileOpt(filename);
+    CHECK(contents.has_value()) << "Couldn't open " << filename;
+    owned = std::move(contents.value());
+    data = owned.data();
+    size = owned.size();
+  }
+#else
+  explicit MappedFile(const std::string &filename) {
+    const int fd = open(filename.c_str(), O_RDONLY);
+    CHECK(fd >= 0) << "Couldn't open " << filename;
+    struct stat st;
+    CHECK(fstat(fd, &st) == 0) << filename;
+    size = st.st_size;
+    if (size > 0) {
+      void *m = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      CHECK(m != MAP_FAILED) << "Couldn't map " << filename;
+      data = (const char *)m;
+    }
+    close(fd);
+  }
+  ~MappedFile() {
+    if (data != nullptr) munmap((void *)data, size);
+  }
+#endif
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator =(const MappedFile &) = delete;
+
+  std::string_view View() const { return std::string_view(data, size); }
+
+  const char *data = nullptr;
+  size_t size = 0;
+
+#ifdef _WIN32
+ private:
+  std::string owned;
+#endif
+};
+
+#endif
@@ -18,10 +18,7 @@
 using namespace icfp;
 
 
-static std::string PrettyVar(const icfp::int_type &i) {
-  // If you're using bignum and this fails, you could just call
-  // i.ToString() here.
-  int64_t ii = icfp::GetInt64(i);
+static std::string PrettyVar(int64_t ii) {
   CHECK(ii >= 0);
   if (ii < 26) return StringPrintf("%c", 'a' + ii);
   return StringPrintf("v%zu", (size_t)ii);
@@ -150,7 +147,8 @@ int main(int argc, char **argv) {
   std::string input = ReadAllInput();
   std::string_view input_view(input);
 
-  std::shared_ptr<Exp> exp = ParseLeadingExp(&input_view);
+  Parser parser;
+  std::shared_ptr<Exp> exp = parser.ParseLeadingExp(&input_view);
 
   CHECK(input_view.empty()) << "extra stuff after expression?";
 
@@ -1,29 +1,9 @@
 #!/bin/bash
 
-make -j spaceship.exe || exit -1
+# Solves all of the spaceship problems in parallel, writing the ones
+# that improve on ../solutions/spaceship. Arguments are passed to
+# spaceship-all.exe (e.g. -opt 60 -beam 8).
 
-./spaceship.exe 1 > ../solutions/spaceshit/spaceship1.txt
-./spaceship.exe 2 > ../solutions/spaceshit/spaceship2.txt
-./spaceship.exe 3 > ../solutions/spaceshit/spaceship3.txt
-./spaceship.exe 4 > ../solutions/spaceshit/spaceship4.txt
-./spaceship.exe 5 > ../solutions/spaceshit/spaceship5.txt
-./spaceship.exe 6 > ../solutions/spaceshit/spaceship6.txt
-./spaceship.exe 7 > ../solutions/spaceshit/spaceship7.txt
-./spaceship.exe 8 > ../solutions/spaceshit/spaceship8.txt
-./spaceship.exe 9 > ../solutions/spaceshit/spaceship9.txt
-./spaceship.exe 10 > ../solutions/spaceshit/spaceship10.txt
-./spaceship.exe 11 > ../solutions/spaceshit/spaceship11.txt
-./spaceship.exe 12 > ../solutions/spaceshit/spaceship12.txt
-./spaceship.exe 13 > ../solutions/spaceshit/spaceship13.txt
-./spaceship.exe 14 > ../solutions/spaceshit/spaceship14.txt
-./spaceship.exe 15 > ../solutions/spaceshit/spaceship15.txt
-./spaceship.exe 16 > ../solutions/spaceshit/spaceship16.txt
-./spaceship.exe 17 > ../solutions/spaceshit/spaceship17.txt
-./spaceship.exe 18 > ../solutions/spaceshit/spaceship18.txt
-./spaceship.exe 19 > ../solutions/spaceshit/spaceship19.txt
-./spaceship.exe 20 > ../solutions/spaceshit/spaceship20.txt
-./spaceship.exe 21 > ../solutions/spaceshit/spaceship21.txt
-./spaceship.exe 22 > ../solutions/spaceshit/spaceship22.txt
-./spaceship.exe 23 > ../solutions/spaceshit/spaceship23.txt
-./spaceship.exe 24 > ../solutions/spaceshit/spaceship24.txt
-./spaceship.exe 25 > ../solutions/spaceshit/spaceship25.txt
+make -j spaceship-all.exe || exit -1
+
+./spaceship-all.exe "$@"
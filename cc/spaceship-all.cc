@@ -0,0 +1,214 @@
+
+// Solves every spaceship problem in one process, several at once,
+// biggest first. A solution is written to ../solutions/spaceship
+// only when it is valid and shorter than the one that's there.
+// Prints a summary table at the end. Run from the cc directory.
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ansi.h"
+#include "base/logging.h"
+#include "base/stringprintf.h"
+#include "spaceship-bound.h"
+#include "spaceship-legs.h"
+#include "spaceship-problem.h"
+#include "spaceship-solver.h"
+#include "threadutil.h"
+#include "timer.h"
+#include "util.h"
+
+struct Job {
+  int n = 0;
+  Problem problem;
+  // Current solution's length, or -1 if there is none.
+  int64_t previous = -1;
+  SpaceshipSolution solution;
+  bool valid = false;
+  bool written = false;
+  double seconds = 0.0;
+};
+
+// Number of moves in the saved solution, or -1 if it is missing or
+// not a plain solve string.
+static int64_t SavedMoves(const std::string &file, int n) {
+  if (!std::filesystem::exists(file)) return -1;
+  std::string contents = Util::NormalizeWhitespace(Util::ReadFile(file));
+  const std::string marker = StringPrintf("solve spaceship%d ", n);
+  if (!contents.starts_with(marker)) return -1;
+  return (int64_t)contents.size() - (int64_t)marker.size();
+}
+
+int main(int argc, char **argv) {
+  ANSI::Init();
+
+  const int threads = std::max(1, (int)std::thread::hardware_concurrency());
+  SpaceshipSolverOptions options;
+  bool dry_run = false;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-opt" && i + 1 < argc) {
+      options.opt_seconds = atof(argv[++i]);
+    } else if (arg == "-beam" && i + 1 < argc) {
+      options.beam_width = atoi(argv[++i]);
+    } else if (arg == "-depth" && i + 1 < argc) {
+      options.beam_depth = atoi(argv[++i]);
+    } else if (arg == "-branch" && i + 1 < argc) {
+      options.beam_branch = atoi(argv[++i]);
+    } else if (arg == "-sweep" && i + 1 < argc) {
+      options.min_sweep = atoi(argv[++i]);
+    } else if (arg == "-dry") {
+      dry_run = true;
+    } else {
+      LOG(FATAL) << "./spaceship-all.exe [-opt seconds] [-beam width] "
+        "[-depth d] [-branch k] [-sweep len] [-dry]\n"
+        "Options are as for spaceship.exe. With -dry, doesn't write "
+        "solutions.";
+    }
+  }
+  options.verbose = false;
+
+  // Optional; see spaceship-leg-table.cc.
+  std::unique_ptr<LegTable> leg_table = LegTable::Load(LegTable::DEFAULT_FILE);
+  SetLegTable(leg_table.get());
+
+  std::vector<Job> jobs;
+  for (const auto &entry :
+         std::filesystem::directory_iterator("../puzzles/spaceship")) {
+    const std::string name = entry.path().filename().string();
+    int n = 0;
+    if (sscanf(name.c_str(), "spaceship%d.txt", &n) != 1 ||
+        name != StringPrintf("spaceship%d.txt", n))
+      continue;
+    Job job;
+    job.n = n;
+    job.problem = Problem::FromFile(entry.path().string());
+    job.previous = SavedMoves(
+        StringPrintf("../solutions/spaceship/spaceship%d.txt", n), n);
+    jobs.push_back(std::move(job));
+  }
+  CHECK(!jobs.empty()) << "No puzzles found. Run from the cc directory.";
+
+  // Largest first, so that it isn't the one we're waiting for at the
+  // end.
+  std::sort(jobs.begin(), jobs.end(), [](const Job &a, const Job &b) {
+      return a.problem.stars.size() > b.problem.stars.size();
+    });
+
+  // Each problem's own parallelism is decided when it starts, from
+  // the cores that are free then: it gets a share in proportion to
+  // its size among the problems that haven't started. So the big ones
+  // (which start first) get more, and the problems at the end get the
+  // cores that finished ones gave back. A problem waits for at least
+  // one free core.
+  const int outer = std::min(threads, (int)jobs.size());
+  int free_cores = threads;
+  int64_t unstarted_stars = 0;
+  for (const Job &job : jobs) unstarted_stars += job.problem.stars.size();
+  std::condition_variable freed;
+
+  Timer timer;
+  std::mutex m;
+  int done = 0;
+  ParallelComp(jobs.size(), [&](int64_t idx) {
+      Job &job = jobs[idx];
+      const int64_t stars = job.problem.stars.size();
+      SpaceshipSolverOptions job_options = options;
+      {
+        std::unique_lock<std::mutex> ul(m);
+        freed.wait(ul, [&free_cores]() { return free_cores > 0; });
+        const int64_t share = unstarted_stars > 0 ?
+          (free_cores * stars + unstarted_stars / 2) / unstarted_stars : 0;
+        job_options.threads = std::clamp((int)share, 1, free_cores);
+        free_cores -= job_options.threads;
+        unstarted_stars -= stars;
+      }
+
+      Timer job_timer;
+      job.solution = SolveSpaceship(job.problem, job_options);
+      job.valid = job.problem.StarsMissed(job.solution.moves) == 0;
+      const bool better = job.previous < 0 ||
+        (int64_t)job.solution.moves.size() < job.previous;
+      if (job.valid && better && !dry_run) {
+        job.written = Util::WriteFile(
+            StringPrintf("../solutions/spaceship/spaceship%d.txt", job.n),
+            StringPrintf("solve spaceship%d %s\n", job.n,
+                         job.solution.moves.c_str()));
+        CHECK(job.written) << job.n;
+      }
+      job.seconds = job_timer.Seconds();
+
+      {
+        MutexLock ml(&m);
+        free_cores += job_options.threads;
+        done++;
+        fprintf(stderr, "[%d/%d] spaceship%d: %lld moves in %s "
+                "(%d threads)\n",
+                done, (int)jobs.size(), job.n,
+                (long long)job.solution.moves.size(),
+                ANSI::Time(job.seconds).c_str(), job_options.threads);
+      }
+      freed.notify_all();
+    }, outer);
+
+  std::sort(jobs.begin(), jobs.end(), [](const Job &a, const Job &b) {
+      return a.n < b.n;
+    });
+
+  int improved = 0, invalid = 0;
+  int64_t total_before = 0, total_after = 0, total_bound = 0;
+  // The gap is for the best solution we have, whether or not it's
+  // the new one.
+  printf("%-12s %7s %10s %10s %10s  %-9s %10s %7s %8s\n",
+         "problem", "stars", "greedy", "optimized", "previous", "status",
+         "bound", "gap", "time");
+  for (const Job &job : jobs) {
+    const int64_t moves = job.solution.moves.size();
+    const bool better = job.previous < 0 || moves < job.previous;
+    const char *status =
+      !job.valid ? "invalid" :
+      better ? (dry_run ? "better" : "written") :
+      moves == job.previous ? "same" : "kept";
+    const char *color =
+      !job.valid ? ANSI_RED : better ? ANSI_GREEN : ANSI_GREY;
+    const int64_t best = job.valid && better ? moves : job.previous;
+    const SpaceshipBound &bound = job.solution.bound;
+    printf("spaceship%-3d %7d %10lld %10lld %10s  %s%-9s" ANSI_RESET
+           " %10lld %6s%% %8s\n",
+           job.n, (int)job.problem.stars.size(),
+           (long long)job.solution.greedy_moves, (long long)moves,
+           job.previous < 0 ? "--" :
+           StringPrintf("%lld", (long long)job.previous).c_str(),
+           color, status, (long long)bound.Bound(),
+           best < 0 ? "--" :
+           StringPrintf("%.1f", bound.GapPercent(best)).c_str(),
+           ANSI::Time(job.seconds).c_str());
+    if (!job.valid) invalid++;
+    if (job.valid && better) improved++;
+    if (job.previous >= 0) total_before += job.previous;
+    if (best >= 0) {
+      total_after += best;
+      total_bound += bound.Bound();
+    }
+  }
+
+  printf("\n%d problems in %s. " AGREEN("%d") " improved, %s%d invalid"
+         ANSI_RESET ". Total moves %lld -> %lld (lower bound %lld, "
+         "gap %.1f%%).\n",
+         (int)jobs.size(), ANSI::Time(timer.Seconds()).c_str(), improved,
+         invalid > 0 ? ANSI_RED : ANSI_GREEN, invalid,
+         (long long)total_before, (long long)total_after,
+         (long long)total_bound,
+         total_after > 0 ?
+         (100.0 * (total_after - total_bound)) / total_after : 0.0);
+  return invalid > 0 ? 1 : 0;
+}
@@ -0,0 +1,270 @@
+#include "spaceship-bound.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "base/logging.h"
+#include "base/stringprintf.h"
+#include "geom/tree-2d.h"
+#include "hashing.h"
+#include "spaceship-problem.h"
+#include "threadutil.h"
+
+// Rounding toward negative and positive infinity, for b > 0.
+static int64_t FloorDiv(int64_t a, int64_t b) {
+  return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+static int64_t CeilDiv(int64_t a, int64_t b) {
+  return -FloorDiv(-a, b);
+}
+
+static int64_t Chebyshev(std::pair<int, int> a, std::pair<int, int> b) {
+  return std::max(std::abs((int64_t)a.first - b.first),
+                  std::abs((int64_t)a.second - b.second));
+}
+
+double SpaceshipBound::GapPercent(int64_t moves) const {
+  if (moves <= 0) return 0.0;
+  return (100.0 * (moves - Bound())) / moves;
+}
+
+std::string SpaceshipBound::ToString() const {
+  return StringPrintf("%lld (distinct stars %lld, travel %lld for "
+                      "nearest-neighbor sum %lld, turning %lld)",
+                      (long long)Bound(), (long long)distinct,
+                      (long long)travel, (long long)nearest_sum,
+                      (long long)turn);
+}
+
+namespace {
+// Stars bucketed into square cells, sized so that there is about one
+// star per cell, over the bounding box.
+struct StarGrid {
+  explicit StarGrid(const std::vector<std::pair<int, int>> &stars) :
+    stars(stars) {
+    int64_t x0 = 0, x1 = 0, y0 = 0, y1 = 0;
+    for (const auto &[x, y] : stars) {
+      x0 = std::min(x0, (int64_t)x);
+      x1 = std::max(x1, (int64_t)x);
+      y0 = std::min(y0, (int64_t)y);
+      y1 = std::max(y1, (int64_t)y);
+    }
+    const double side =
+      std::sqrt((double)(x1 - x0 + 1) * (y1 - y0 + 1) / stars.size());
+    while (bits < 24 && (int64_t{2} << bits) <= side) bits++;
+    cx0 = x0 >> bits;
+    cx1 = x1 >> bits;
+    cy0 = y0 >> bits;
+    cy1 = y1 >> bits;
+    const int64_t w = cx1 - cx0 + 1;
+    start.resize(w * (cy1 - cy0 + 1) + 1, 0);
+    auto Index = [&](std::pair<int, int> star) {
+        return ((star.second >> bits) - cy0) * w + (star.first >> bits) - cx0;
+      };
+    for (const auto &star : stars) start[Index(star) + 1]++;
+    for (size_t c = 1; c < start.size(); c++) start[c] += start[c - 1];
+    order.resize(stars.size());
+    std::vector<int> fill(start.begin(), start.end() - 1);
+    for (int i = 0; i < (int)stars.size(); i++)
+      order[fill[Index(stars[i])]++] = i;
+    // Stars can be clustered, so sort each cell by y for the box
+    // queries.
+    for (size_t c = 0; c + 1 < start.size(); c++)
+      std::sort(order.begin() + start[c], order.begin() + start[c + 1],
+                [&stars](int a, int b) {
+                  return stars[a].second < stars[b].second;
+                });
+  }
+
+  // Calls f(star index) for the stars in the cell, until it returns
+  // true.
+  template<class F>
+  bool AnyInCell(int64_t cx, int64_t cy, const F &f) const {
+    if (cx < cx0 || cx > cx1 || cy < cy0 || cy > cy1) return false;
+    const int64_t c = (cy - cy0) * (cx1 - cx0 + 1) + cx - cx0;
+    for (int k = start[c]; k < start[c + 1]; k++)
+      if (f(order[k])) return true;
+    return false;
+  }
+
+  // Is there a star other than s and p in the box?
+  bool AnyStar(int64_t x0, int64_t x1, int64_t y0, int64_t y1,
+               std::pair<int, int> s, std::pair<int, int> p) const {
+    x0 = std::max(x0, cx0 << bits);
+    y0 = std::max(y0, cy0 << bits);
+    x1 = std::min(x1, ((cx1 + 1) << bits) - 1);
+    y1 = std::min(y1, ((cy1 + 1) << bits) - 1);
+    for (int64_t cy = y0 >> bits; cy <= (y1 >> bits); cy++) {
+      for (int64_t cx = x0 >> bits; cx <= (x1 >> bits); cx++) {
+        const int64_t c = (cy - cy0) * (cx1 - cx0 + 1) + cx - cx0;
+        auto it = std::lower_bound(
+            order.begin() + start[c], order.begin() + start[c + 1], y0,
+            [this](int i, int64_t y) { return stars[i].second < y; });
+        for (; it != order.begin() + start[c + 1]; ++it) {
+          const auto &q = stars[*it];
+          if (q.second > y1) break;
+          if (q.first >= x0 && q.first <= x1 && q != s && q != p)
+            return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  const std::vector<std::pair<int, int>> &stars;
+  int bits = 4;
+  // Range of the cells.
+  int64_t cx0 = 0, cx1 = 0, cy0 = 0, cy1 = 0;
+  // The stars in cell c are order[start[c]] to order[start[c + 1] - 1],
+  // with the cells in row-major order.
+  std::vector<int> start, order;
+};
+}  // namespace
+
+// Can we go from p to s in j moves, and then to another star in m,
+// without going faster than the speed limit? Each axis gives a range
+// of velocities at s, and then a box for the next star.
+static bool Feasible(const StarGrid &grid, int64_t speed,
+                     std::pair<int, int> s, std::pair<int, int> p,
+                     int64_t j, int64_t m) {
+  const int64_t rj = j * (j - 1) / 2, rm = m * (m + 1) / 2;
+  const int64_t d[2] = {(int64_t)s.first - p.first,
+                        (int64_t)s.second - p.second};
+  const int64_t sv[2] = {s.first, s.second};
+  int64_t lo[2], hi[2];
+  for (int a = 0; a < 2; a++) {
+    const int64_t vlo = std::max(CeilDiv(d[a] - rj, j), -speed);
+    const int64_t vhi = std::min(FloorDiv(d[a] + rj, j), speed);
+    if (vlo > vhi) return false;
+    lo[a] = sv[a] + m * vlo - rm;
+    hi[a] = sv[a] + m * vhi + rm;
+  }
+  return grid.AnyStar(lo[0], hi[0], lo[1], hi[1], s, p);
+}
+
+// Least number of moves in the legs on either side of the star, as
+// in SpaceshipBound::turn, or a lower bound on it if we give up.
+static int TurnCost(const StarGrid &grid, int64_t speed,
+                    std::pair<int, int> s) {
+  // Ruling out cheap turns for a star can mean looking at every
+  // other point, so we stop after this much work.
+  static constexpr int64_t MAX_WORK = 1 << 14;
+  const std::pair<int, int> origin = {0, 0};
+  const int64_t scx = s.first >> grid.bits, scy = s.second >> grid.bits;
+  int64_t work = 0;
+  // Rule out each cost in turn; the one we're on when we give up is
+  // still a lower bound.
+  for (int c = 2; c <= SpaceshipBound::MAX_TURN; c++) {
+    auto Check = [&](std::pair<int, int> p) {
+        for (int j = 1; j < c; j++)
+          if (Feasible(grid, speed, s, p, j, c - j)) return true;
+        return false;
+      };
+    // Farther than this, we'd need to go faster than the limit.
+    const int64_t reach = (c - 1) * speed + (c - 1) * (c - 2) / 2;
+    if (Chebyshev(s, origin) <= reach && Check(origin)) return c;
+
+    // Cells in rings around the star's, nearest first, since the
+    // cheap turns are usually close.
+    for (int64_t r = 0; (r - 1) << grid.bits < reach; r++) {
+      if (scx - r < grid.cx0 && scx + r > grid.cx1 &&
+          scy - r < grid.cy0 && scy + r > grid.cy1)
+        break;
+      for (int64_t dy = -r; dy <= r; dy++) {
+        const bool edge = dy == -r || dy == r;
+        for (int64_t dx = -r; dx <= r; dx += edge ? 1 : 2 * r) {
+          if (++work > MAX_WORK) return c;
+          if (grid.AnyInCell(scx + dx, scy + dy, [&](int i) {
+              const auto &p = grid.stars[i];
+              if (p == s || Chebyshev(s, p) > reach) return false;
+              work++;
+              return Check(p);
+            }))
+            return c;
+          if (r == 0) break;
+        }
+      }
+    }
+  }
+  return SpaceshipBound::MAX_TURN + 1;
+}
+
+// The turning bound with the speed limit.
+static int64_t TurnBound(const StarGrid &grid, int64_t speed, int threads) {
+  std::vector<int> cost =
+    ParallelTabulate(grid.stars.size(), [&](int64_t i) {
+        return TurnCost(grid, speed, grid.stars[i]);
+      }, threads);
+  int64_t sum = 0, most = 0;
+  for (int c : cost) {
+    sum += c;
+    most = std::max(most, (int64_t)c);
+  }
+  return (sum - most + 1) / 2;
+}
+
+SpaceshipBound LowerBound(const Problem &p, int threads) {
+  const std::pair<int, int> origin = {0, 0};
+  std::unordered_set<std::pair<int, int>,
+                     Hashing<std::pair<int, int>>> unique(p.stars.begin(),
+                                                          p.stars.end());
+  // The path's points: the origin, and the stars we need to enter.
+  std::vector<std::pair<int, int>> stars;
+  for (const auto &star : unique)
+    if (star != origin) stars.push_back(star);
+
+  SpaceshipBound bound;
+  bound.distinct = stars.size();
+  if (stars.empty()) return bound;
+
+  Tree2D<int, int> tree;
+  tree.Insert(origin, -1);
+  for (int i = 0; i < (int)stars.size(); i++) tree.Insert(stars[i], i);
+
+  // The tree measures Euclidean distance, which is at least the
+  // Chebyshev distance and at most sqrt(2) times it. So the Chebyshev
+  // nearest neighbor is within sqrt(2) times the Chebyshev distance
+  // of the Euclidean nearest neighbor, which bounds the search.
+  std::vector<int64_t> nearest =
+    ParallelTabulate(stars.size(), [&](int64_t i) {
+        const auto near = tree.KNearest(stars[i], 2);
+        CHECK(near.size() == 2);
+        // The first is the star itself, since the points are distinct.
+        const auto &[closest, idx_, dist_] = near[1];
+        int64_t best = Chebyshev(stars[i], closest);
+        for (const auto &[pos, idx, dist] :
+               tree.LookUp(stars[i], best * std::sqrt(2.0) + 1.0)) {
+          if (pos != stars[i]) best = std::min(best, Chebyshev(stars[i], pos));
+        }
+        return best;
+      }, threads);
+
+  for (int64_t d : nearest) bound.nearest_sum += d;
+
+  int64_t t = std::sqrt(2.0 * bound.nearest_sum);
+  while (t > 0 && t * (t - 1) / 2 >= bound.nearest_sum) t--;
+  while (t * (t + 1) / 2 < bound.nearest_sum) t++;
+  bound.travel = t;
+
+  // The speed after t moves is at most t, so a solution with T moves
+  // never goes faster than T. So for any speed limit V, a solution
+  // is either longer than V or satisfies the turning bound computed
+  // with that limit. A lower limit rules out more of the far away
+  // pairs, which is also faster, so start low and raise it while it
+  // is the limit that's holding the bound back.
+  const StarGrid grid(stars);
+  int64_t speed = 2 * std::max(bound.distinct, bound.travel);
+  for (;;) {
+    const int64_t turn = TurnBound(grid, speed, threads);
+    bound.turn = std::max(bound.turn, std::min(speed, turn));
+    if (turn < speed) break;
+    speed *= 2;
+  }
+  return bound;
+}
@@ -0,0 +1,56 @@
+
+#ifndef SPACESHIP_BOUND_H_
+#define SPACESHIP_BOUND_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+#include "spaceship-problem.h"
+
+// Lower bounds on the number of moves in any solution, so that we
+// know how far from optimal we might be.
+struct SpaceshipBound {
+  // Each move lands on one position, so we need at least one move
+  // per distinct star (other than one at the origin).
+  int64_t distinct = 0;
+
+  // Every star is entered from some other point (a star or the
+  // origin) of the path, so the path's length in the Chebyshev metric
+  // is at least the sum over the stars of the distance to the nearest
+  // other point. That's a relaxation of the assignment of a
+  // predecessor to each star.
+  int64_t nearest_sum = 0;
+  // Each move travels |v|_inf, and the speed after t moves is at most
+  // t, starting from rest. So T moves travel at most T(T+1)/2, which
+  // gives the smallest T that covers nearest_sum.
+  int64_t travel = 0;
+
+  // Turning. If a leg of j moves ends at a star with velocity v, its
+  // earlier velocities are within j - i of v, so its displacement D
+  // has |D - jv| <= j(j-1)/2 in each axis; likewise the next leg, of
+  // m moves, has |E - mv| <= m(m+1)/2. So a star only has short legs
+  // on both sides if the point before it and the star after it line
+  // up through it. Each star's cost is the least j + m over all such
+  // pairs (up to MAX_TURN + 1, or less where we give up looking).
+  // Every leg is the incoming leg of one star and the outgoing leg of
+  // the previous one, so twice the number of moves is at least the
+  // sum of the costs, leaving out the last star's.
+  static constexpr int MAX_TURN = 8;
+  int64_t turn = 0;
+
+  int64_t Bound() const {
+    return std::max(std::max(distinct, travel), turn);
+  }
+
+  // Gap between a solution and the bound, as a percentage of the
+  // solution.
+  double GapPercent(int64_t moves) const;
+  std::string ToString() const;
+};
+
+// Uses a spatial index for the nearest neighbors, computed in
+// parallel.
+SpaceshipBound LowerBound(const Problem &p, int threads);
+
+#endif
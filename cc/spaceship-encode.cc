@@ -0,0 +1,100 @@
+
+// Turns a plain spaceship solution ("solve spaceshipN 7894...") into
+// a shorter icfp program that evaluates to it, using the compact
+// token encoding in spaceship-encoding.h. The program is checked with
+// the evaluator before it's printed. If the program would be bigger
+// than the plain string (short solutions), prints the string instead.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <variant>
+
+#include "ansi.h"
+#include "base/logging.h"
+#include "base/stringprintf.h"
+#include "timer.h"
+#include "util.h"
+
+#include "icfp.h"
+#include "spaceship-encoding.h"
+
+using namespace icfp;
+
+int main(int argc, char **argv) {
+  ANSI::Init();
+
+  bool pow2 = false;
+  int max_run = 0;
+  int chunk_size = 65536;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-pow2") {
+      pow2 = true;
+    } else if (arg == "-max-run" && i + 1 < argc) {
+      max_run = atoi(argv[++i]);
+      CHECK(max_run >= 1);
+    } else if (arg == "-chunk-size" && i + 1 < argc) {
+      chunk_size = atoi(argv[++i]);
+      CHECK(chunk_size > 0);
+    } else {
+      fprintf(stderr,
+              "./spaceship-encode.exe [-pow2] [-max-run k] [-chunk-size n] "
+              "< spaceshipN.txt > spaceshipN.icfp\n"
+              "By default, max-run is whatever makes the output smallest.\n");
+      return -1;
+    }
+  }
+
+  const std::string input = Util::NormalizeWhitespace(ReadAllInput());
+  int n = 0;
+  CHECK(sscanf(input.c_str(), "solve spaceship%d ", &n) == 1) <<
+    "Expected a solution like \"solve spaceshipN 7894...\"";
+  const std::string prefix = StringPrintf("solve spaceship%d ", n);
+  CHECK(input.starts_with(prefix)) << "Expected a single space after the "
+    "problem name.";
+  const std::string_view moves = std::string_view(input).substr(prefix.size());
+
+  if (max_run == 0) max_run = BestMaxRun(moves, pow2);
+  const int64_t tokens = SpaceshipTokens(moves, max_run).size();
+
+  Timer encode_timer;
+  const std::string encoded = EncodeSpaceship(prefix, moves, max_run,
+                                              chunk_size);
+  const std::string plain = StringPrintf("S%s", EncodeString(input).c_str());
+  const bool use_plain = plain.size() <= encoded.size();
+  const std::string &program = use_plain ? plain : encoded;
+  const double encode_sec = encode_timer.Seconds();
+
+  Timer eval_timer;
+  std::string_view program_view(program);
+  Parser parser;
+  std::shared_ptr<Exp> exp = parser.ParseLeadingExp(&program_view);
+  CHECK(exp.get() != nullptr && program_view.empty()) << "Doesn't parse?";
+  Evaluation evaluation;
+  const Value v = evaluation.Eval(exp);
+  const String *s = std::get_if<String>(&v);
+  CHECK(s != nullptr) << "Evaluates to " << ValueString(v);
+  CHECK(s->s == input) << "Decodes to the wrong string.";
+  const double eval_sec = eval_timer.Seconds();
+
+  fprintf(stderr,
+          "spaceship%d: %lld moves as %lld tokens (runs of 5 up to %d, "
+          "radix %d). " AGREEN("%lld") " -> " AGREEN("%lld") " bytes "
+          "(%.1f%%). Encoded in %s; verified in %s.\n",
+          n, (long long)moves.size(), (long long)tokens, max_run,
+          SpaceshipRadix(max_run), (long long)input.size(),
+          (long long)program.size(),
+          (100.0 * program.size()) / input.size(),
+          ANSI::Time(encode_sec).c_str(), ANSI::Time(eval_sec).c_str());
+  if (use_plain) {
+    fprintf(stderr, "The encoded program was %lld bytes, so this is the "
+            "plain string.\n", (long long)encoded.size());
+  }
+
+  printf("%s\n", program.c_str());
+  return 0;
+}
@@ -0,0 +1,117 @@
+#include "spaceship-encoding.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "base/logging.h"
+#include "base/stringprintf.h"
+#include "bignum/big.h"
+
+#include "base-x.h"
+#include "icfp.h"
+
+// The keys other than 5, in digit order.
+static constexpr std::string_view KEYS = "12346789";
+
+int SpaceshipRadix(int max_run) {
+  return KEYS.size() + max_run;
+}
+
+std::vector<int> SpaceshipTokens(std::string_view moves, int max_run) {
+  CHECK(max_run >= 1);
+  std::vector<int> tokens;
+  for (size_t i = 0; i < moves.size(); /* in loop */) {
+    if (moves[i] == '5') {
+      int run = 1;
+      while (run < max_run && i + run < moves.size() && moves[i + run] == '5')
+        run++;
+      tokens.push_back(KEYS.size() + run - 1);
+      i += run;
+    } else {
+      const size_t d = KEYS.find(moves[i]);
+      CHECK(d != std::string_view::npos) << "Bad move: " << moves[i];
+      tokens.push_back(d);
+      i++;
+    }
+  }
+  return tokens;
+}
+
+int BestMaxRun(std::string_view moves, bool pow2) {
+  // Runs are split greedily into the longest tokens, so the count for
+  // each max_run follows from the run lengths.
+  int64_t others = 0;
+  std::vector<int64_t> runs;
+  for (size_t i = 0; i < moves.size(); /* in loop */) {
+    if (moves[i] == '5') {
+      size_t j = i;
+      while (j < moves.size() && moves[j] == '5') j++;
+      runs.push_back(j - i);
+      i = j;
+    } else {
+      others++;
+      i++;
+    }
+  }
+
+  int best = 1;
+  double best_bits = -1.0;
+  for (int max_run = 1; max_run <= 256; max_run++) {
+    const int radix = SpaceshipRadix(max_run);
+    if (pow2 && (radix & (radix - 1)) != 0) continue;
+    int64_t tokens = others;
+    for (int64_t run : runs) tokens += (run + max_run - 1) / max_run;
+    const double bits = tokens * std::log2((double)radix);
+    if (best_bits < 0.0 || bits < best_bits) {
+      best = max_run;
+      best_bits = bits;
+    }
+  }
+  return best;
+}
+
+std::string EncodeSpaceship(std::string_view prefix, std::string_view moves,
+                            int max_run, int chunk_size) {
+  CHECK(chunk_size > 0);
+  const std::vector<int> tokens = SpaceshipTokens(moves, max_run);
+  const int radix = SpaceshipRadix(max_run);
+
+  const std::string one = icfp::IntConstant(BigInt{1});
+  const std::string keys_exp = icfp::IntConstant(BigInt((int)KEYS.size()));
+  const std::string keys_lookup =
+    StringPrintf("S%s", icfp::EncodeString(KEYS).c_str());
+  const std::string run_lookup =
+    StringPrintf("S%s", icfp::EncodeString(std::string(max_run, '5')).c_str());
+
+  // Bind the digit to d, since we use it several times. If it's a
+  // key, drop d and take 1 from the keys. Otherwise take d - 7 from a
+  // string of 5s.
+  auto Render = [&](const std::string &digit) {
+      return StringPrintf(
+          "B$ Ld ? B< vd %s BT %s BD vd %s BT B- vd %s %s %s",
+          keys_exp.c_str(), one.c_str(), keys_lookup.c_str(),
+          icfp::IntConstant(BigInt((int)KEYS.size() - 1)).c_str(),
+          run_lookup.c_str(), digit.c_str());
+    };
+
+  std::vector<std::string> parts;
+  if (!prefix.empty())
+    parts.push_back(StringPrintf("S%s", icfp::EncodeString(prefix).c_str()));
+  for (size_t start = 0; start < tokens.size(); start += chunk_size) {
+    const std::vector<int> chunk(
+        tokens.begin() + start,
+        tokens.begin() + std::min(tokens.size(), start + chunk_size));
+    parts.push_back(BaseXDecoder(chunk.size(), BaseXNumber(chunk, radix),
+                                 radix, Render));
+  }
+
+  if (parts.empty()) return "S";
+  std::string out = parts[0];
+  for (int i = 1; i < (int)parts.size(); i++)
+    out = StringPrintf("B. %s %s", out.c_str(), parts[i].c_str());
+  return out;
+}
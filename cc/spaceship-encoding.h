@@ -0,0 +1,32 @@
+
+#ifndef SPACESHIP_ENCODING_H_
+#define SPACESHIP_ENCODING_H_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Compact icfp programs for spaceship solutions. The moves are tokens
+// in one big base-X number (see base-x.h): digits 0-7 are the keys
+// other than 5, and 8 + k - 1 is a run of k 5s (coasting), for k up
+// to max_run. With max_run = 1 that's just base 9.
+
+// The radix of the number: the eight keys, plus the runs.
+int SpaceshipRadix(int max_run);
+
+// The tokens for the moves, which must be keypad keys 1-9.
+std::vector<int> SpaceshipTokens(std::string_view moves, int max_run);
+
+// The max_run that minimizes the encoded size in bits (tokens times
+// log2 of the radix). With pow2, only ones that make the radix a power
+// of two, which is faster to decode.
+int BestMaxRun(std::string_view moves, bool pow2);
+
+// A program that evaluates to prefix followed by the moves. Large
+// solutions are split into chunks of at most chunk_size tokens, since
+// decoding is quadratic in the size of the number.
+std::string EncodeSpaceship(std::string_view prefix, std::string_view moves,
+                            int max_run, int chunk_size = 65536);
+
+#endif
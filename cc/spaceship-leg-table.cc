@@ -0,0 +1,58 @@
+
+// Precomputes the table of arrival velocities in spaceship-legs.h
+// and writes it to a file, which spaceship.exe and spaceship-all.exe
+// map at startup if it's there. Run from the cc directory.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "ansi.h"
+#include "base/logging.h"
+#include "spaceship-legs.h"
+#include "spaceship-problem.h"
+#include "timer.h"
+
+int main(int argc, char **argv) {
+  ANSI::Init();
+
+  int max_v = 32, max_d = 1024, max_t = 100;
+  std::string filename = LegTable::DEFAULT_FILE;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-v" && i + 1 < argc) {
+      max_v = atoi(argv[++i]);
+    } else if (arg == "-d" && i + 1 < argc) {
+      max_d = atoi(argv[++i]);
+    } else if (arg == "-t" && i + 1 < argc) {
+      max_t = atoi(argv[++i]);
+    } else if (arg == "-o" && i + 1 < argc) {
+      filename = argv[++i];
+    } else {
+      LOG(FATAL) << "./spaceship-leg-table.exe [-v max_velocity] "
+        "[-d max_offset] [-t max_steps] [-o file]\n"
+        "max_steps is at most 127. Writes spaceship-legs.bin by default.";
+    }
+  }
+  CHECK(max_t < 128) << "max_t must be less than 128.";
+
+  const int threads = std::max(1, (int)std::thread::hardware_concurrency());
+  Timer timer;
+  LegTable::Generate(filename, max_v, max_d, max_t, threads);
+  const double gen_sec = timer.Seconds();
+
+  Timer load_timer;
+  std::unique_ptr<LegTable> table = LegTable::Load(filename);
+  CHECK(table.get() != nullptr);
+  fprintf(stderr,
+          "Wrote %s: |v| <= %d, |d| <= %d, t <= %d (%lld bytes) in %s. "
+          "Loads in %s.\n",
+          filename.c_str(), max_v, max_d, max_t,
+          (long long)(2 * max_v + 1) * (2 * max_d + 1) * (max_t + 1),
+          ANSI::Time(gen_sec).c_str(),
+          ANSI::Time(load_timer.Seconds()).c_str());
+  return 0;
+}
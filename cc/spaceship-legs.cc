@@ -0,0 +1,125 @@
+#include "spaceship-legs.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "base/logging.h"
+#include "spaceship-problem.h"
+#include "threadutil.h"
+#include "util.h"
+
+// Bump when the layout or FlyTo's choices change.
+static constexpr char MAGIC[8] = {'S', 'H', 'I', 'P', 'L', 'E', 'G', '1'};
+// Magic, then max_v, max_d and max_t as little-endian uint32s.
+static constexpr int HEADER_SIZE = 8 + 3 * 4;
+
+int64_t Arrival1D(int64_t v, int64_t d, int64_t t) {
+  for (; t > 0; t--) {
+    v += FirstAccel(v, d, t);
+    d -= v;
+  }
+  CHECK(d == 0) << "Unreachable";
+  return v;
+}
+
+static void PutU32(uint32_t x, std::string *out) {
+  for (int i = 0; i < 4; i++) out->push_back((x >> (8 * i)) & 0xFF);
+}
+
+static uint32_t GetU32(const char *p) {
+  uint32_t x = 0;
+  for (int i = 0; i < 4; i++) x |= (uint32_t)(uint8_t)p[i] << (8 * i);
+  return x;
+}
+
+void LegTable::Generate(const std::string &filename,
+                        int max_v, int max_d, int max_t, int threads) {
+  CHECK(max_v >= 0 && max_d >= 0 && max_t >= 0 && max_t < 128);
+  const int64_t width = 2 * max_d + 1;
+  const int64_t layer = (2 * max_v + 1) * width;
+
+  std::string out(MAGIC, sizeof (MAGIC));
+  PutU32(max_v, &out);
+  PutU32(max_d, &out);
+  PutU32(max_t, &out);
+  CHECK((int)out.size() == HEADER_SIZE);
+  out.resize(HEADER_SIZE + layer * (max_t + 1), (char)UNREACHABLE);
+  int8_t *table = (int8_t *)out.data() + HEADER_SIZE;
+
+  for (int t = 0; t <= max_t; t++) {
+    ParallelComp(2 * max_v + 1, [&](int64_t vi) {
+        const int64_t v = vi - max_v;
+        for (int64_t d = -max_d; d <= max_d; d++) {
+          if (!FeasibleTimes(v, d).Contains(t)) continue;
+          int64_t w = v;
+          if (t > 0) {
+            // Same as one step of Arrival1D, then the previous layer.
+            const int64_t nv = v + FirstAccel(v, d, t);
+            const int64_t nd = d - nv;
+            if (nv >= -max_v && nv <= max_v && nd >= -max_d && nd <= max_d) {
+              const int8_t delta =
+                table[Index(max_v, max_d, nv, nd, t - 1)];
+              CHECK(delta != UNREACHABLE);
+              w = nv + delta;
+            } else {
+              w = Arrival1D(nv, nd, t - 1);
+            }
+          }
+          table[Index(max_v, max_d, v, d, t)] = (int8_t)(w - v);
+        }
+      }, threads);
+  }
+
+  CHECK(Util::WriteFile(filename, out)) << filename;
+}
+
+std::unique_ptr<LegTable> LegTable::Load(const std::string &filename) {
+  if (!std::filesystem::exists(filename)) return nullptr;
+  std::unique_ptr<LegTable> table(new LegTable(filename));
+  const MappedFile &file = table->file;
+  CHECK(file.size >= HEADER_SIZE &&
+        memcmp(file.data, MAGIC, sizeof (MAGIC)) == 0) <<
+    filename << " isn't a leg table of this version. Regenerate it "
+    "with spaceship-leg-table.exe.";
+  table->max_v = GetU32(file.data + 8);
+  table->max_d = GetU32(file.data + 12);
+  table->max_t = GetU32(file.data + 16);
+  const int64_t size = (2 * (int64_t)table->max_v + 1) *
+    (2 * (int64_t)table->max_d + 1) * (table->max_t + 1);
+  CHECK((int64_t)file.size == HEADER_SIZE + size) << filename <<
+    " is truncated.";
+  table->data = (const int8_t *)file.data + HEADER_SIZE;
+  return table;
+}
+
+static const LegTable *leg_table = nullptr;
+
+void SetLegTable(const LegTable *table) {
+  leg_table = table;
+}
+
+std::optional<Leg> TabledLeg(const Spaceship &ship, int x, int y) {
+  if (leg_table == nullptr) return std::nullopt;
+  const int64_t dx = x - ship.x, dy = y - ship.y;
+  const int64_t t = MinTime2D(ship.dx, ship.dy, dx, dy);
+  const std::optional<int64_t> vx = leg_table->Arrival(ship.dx, dx, t);
+  if (!vx.has_value()) return std::nullopt;
+  const std::optional<int64_t> vy = leg_table->Arrival(ship.dy, dy, t);
+  if (!vy.has_value()) return std::nullopt;
+  return Leg{.steps = t, .vx = (int)vx.value(), .vy = (int)vy.value()};
+}
+
+Leg FlyLeg(const Spaceship &ship, int x, int y) {
+  if (std::optional<Leg> leg = TabledLeg(ship, x, y)) return leg.value();
+  const int64_t dx = x - ship.x, dy = y - ship.y;
+  const int64_t t = MinTime2D(ship.dx, ship.dy, dx, dy);
+  return Leg{.steps = t,
+             .vx = (int)Arrival1D(ship.dx, dx, t),
+             .vy = (int)Arrival1D(ship.dy, dy, t)};
+}
@@ -0,0 +1,82 @@
+
+#ifndef SPACESHIP_LEGS_H_
+#define SPACESHIP_LEGS_H_
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "mapped-file.h"
+#include "spaceship-problem.h"
+
+// The result of FlyTo, without generating the path: the number of
+// steps and the velocity on arrival.
+struct Leg {
+  int64_t steps = 0;
+  int vx = 0, vy = 0;
+};
+
+// FlyTo's acceleration on each axis depends only on that axis's
+// velocity and offset and on the time left, which is the same for
+// both axes (MinTime2D). So a leg is MinTime2D and, for each axis,
+// the velocity on arrival after exactly t steps, Arrival1D(v, d, t).
+// By simulation; this takes O(t).
+int64_t Arrival1D(int64_t v, int64_t d, int64_t t);
+
+// A dense table of Arrival1D, precomputed by spaceship-leg-table.exe
+// and mapped read-only from a file, so that loading is instant and
+// concurrent processes share the memory. Since
+//   Arrival1D(v, d, t) = Arrival1D(v + a, d - (v + a), t - 1)
+// with a = FirstAccel(v, d, t), it's filled in order of increasing
+// t, so that each entry's dependency is ready, with each layer done
+// in parallel.
+struct LegTable {
+  static constexpr const char *DEFAULT_FILE = "spaceship-legs.bin";
+
+  // Covers |v| <= max_v, |d| <= max_d, 0 <= t <= max_t. max_t must be
+  // less than 128, so that the velocity changes fit in a byte.
+  static void Generate(const std::string &filename,
+                       int max_v, int max_d, int max_t, int threads);
+
+  // Nullptr if the file doesn't exist. Fails if it isn't a table of
+  // the current version.
+  static std::unique_ptr<LegTable> Load(const std::string &filename);
+
+  // Arrival1D, if it's in the table and reachable.
+  std::optional<int64_t> Arrival(int64_t v, int64_t d, int64_t t) const {
+    if (v < -max_v || v > max_v || d < -max_d || d > max_d ||
+        t < 0 || t > max_t)
+      return std::nullopt;
+    const int8_t delta = data[Index(max_v, max_d, v, d, t)];
+    if (delta == UNREACHABLE) return std::nullopt;
+    return v + delta;
+  }
+
+  int max_v = 0, max_d = 0, max_t = 0;
+
+ private:
+  explicit LegTable(const std::string &filename) : file(filename) {}
+
+  static constexpr int8_t UNREACHABLE = -128;
+  static int64_t Index(int max_v, int max_d, int64_t v, int64_t d,
+                       int64_t t) {
+    return (t * (2 * max_v + 1) + (v + max_v)) * (2 * max_d + 1) +
+      (d + max_d);
+  }
+
+  MappedFile file;
+  const int8_t *data = nullptr;
+};
+
+// Use this table (or none) for TabledLeg and FlyLeg. Call at startup;
+// the table must outlive its uses.
+void SetLegTable(const LegTable *table);
+
+// The leg from the ship to (x, y), if both axes are in the table.
+std::optional<Leg> TabledLeg(const Spaceship &ship, int x, int y);
+
+// The leg from the ship to (x, y), from the table if possible.
+Leg FlyLeg(const Spaceship &ship, int x, int y);
+
+#endif
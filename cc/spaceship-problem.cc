@@ -0,0 +1,239 @@
+#include "spaceship-problem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "ansi.h"
+#include "base/logging.h"
+#include "bounds.h"
+#include "hashing.h"
+#include "util.h"
+
+// Triangular number.
+static inline int64_t Tri(int64_t t) { return t * (t + 1) / 2; }
+
+// Integers t >= 0 with t^2 + b*t + c < 0, as a closed interval.
+static FeasibleTimes::Gap NegativeInterval(int64_t b, int64_t c) {
+  auto Q = [b, c](int64_t t) { return t * t + b * t + c; };
+  FeasibleTimes::Gap gap;
+  const double disc = (double)b * b - 4.0 * (double)c;
+  if (disc <= 0.0) return gap;
+  const double s = std::sqrt(disc);
+  // Approximate roots, then fix up the rounding exactly. The
+  // quadratic is negative only strictly between the roots.
+  int64_t lo = std::max<int64_t>(0, (int64_t)std::floor((-b - s) / 2.0));
+  int64_t hi = std::max<int64_t>(0, (int64_t)std::ceil((-b + s) / 2.0));
+  while (lo > 0 && Q(lo - 1) < 0) lo--;
+  while (lo <= hi && Q(lo) >= 0) lo++;
+  while (hi >= lo && Q(hi) >= 0) hi--;
+  while (Q(hi + 1) < 0) hi++;
+  if (lo <= hi) {
+    gap.lo = lo;
+    gap.hi = hi;
+  }
+  return gap;
+}
+
+FeasibleTimes::FeasibleTimes(int64_t v, int64_t d) : v(v), d(d) {
+  // d - t*v <= T(t)  <=>  t^2 + (2v + 1)t - 2d >= 0
+  // t*v - d <= T(t)  <=>  t^2 + (1 - 2v)t + 2d >= 0
+  gaps[0] = NegativeInterval(2 * v + 1, -2 * d);
+  gaps[1] = NegativeInterval(1 - 2 * v, 2 * d);
+}
+
+bool FeasibleTimes::Contains(int64_t t) const {
+  return t >= 0 && std::abs(d - t * v) <= Tri(t);
+}
+
+int64_t FeasibleTimes::NextFrom(int64_t t) const {
+  t = std::max<int64_t>(t, 0);
+  // Skipping past one gap can land in the other, but not again
+  // in the first.
+  for (int i = 0; i < 2; i++)
+    for (const Gap &gap : gaps)
+      if (t >= gap.lo && t <= gap.hi) t = gap.hi + 1;
+  return t;
+}
+
+int64_t MinTime2D(int64_t vx, int64_t vy, int64_t dx, int64_t dy) {
+  const FeasibleTimes x(vx, dx), y(vy, dy);
+  int64_t t = 0;
+  for (;;) {
+    const int64_t tx = x.NextFrom(t);
+    const int64_t ty = y.NextFrom(tx);
+    if (ty == tx) return tx;
+    t = ty;
+  }
+}
+
+int FirstAccel(int64_t v, int64_t d, int64_t t) {
+  // After accelerating by a and moving, the rest is the same
+  // problem with velocity v + a, offset d - (v + a), and t - 1 steps,
+  // which is feasible iff |d - t(v + a)| <= T(t - 1).
+  int best = 0;
+  int64_t best_slack = -1;
+  for (int a : {0, -1, 1}) {
+    const int64_t slack = Tri(t - 1) - std::abs(d - t * (v + a));
+    if (slack > best_slack) {
+      best = a;
+      best_slack = slack;
+    }
+  }
+  CHECK(best_slack >= 0) << "Infeasible: " << v << " " << d << " " << t;
+  return best;
+}
+
+// Largest displacement beyond t*v with t steps whose accelerations
+// sum to s, for |s| <= t.
+static int64_t MaxExtra(int64_t t, int64_t s) {
+  const int64_t p = (t + s) / 2, m = p - s;
+  return p * t - p * (p - 1) / 2 - m * (m + 1) / 2;
+}
+
+bool FeasibleWithVelocity(int64_t v, int64_t d, int64_t w, int64_t t) {
+  const int64_t s = w - v;
+  if (t < 0 || std::abs(s) > t) return false;
+  const int64_t r = d - t * v;
+  return r <= MaxExtra(t, s) && -r <= MaxExtra(t, -s);
+}
+
+int64_t MinTimeWithVelocity2D(int64_t vx, int64_t vy, int64_t dx, int64_t dy,
+                              int64_t wx, int64_t wy) {
+  // Not monotonic, but the bound grows quadratically in t and the
+  // offset only linearly, so this terminates. It's usually close to
+  // the unconstrained time.
+  int64_t t = std::max({MinTime2D(vx, vy, dx, dy),
+                        std::abs(wx - vx), std::abs(wy - vy)});
+  while (!FeasibleWithVelocity(vx, dx, wx, t) ||
+         !FeasibleWithVelocity(vy, dy, wy, t))
+    t++;
+  return t;
+}
+
+int FirstAccelWithVelocity(int64_t v, int64_t d, int64_t w, int64_t t) {
+  for (int a : {0, -1, 1})
+    if (FeasibleWithVelocity(v + a, d - (v + a), w, t - 1))
+      return a;
+  LOG(FATAL) << "Infeasible: " << v << " " << d << " " << w << " " << t;
+  return 0;
+}
+
+Problem Problem::FromFile(const std::string &filename) {
+  Problem p;
+  for (std::string line : Util::NormalizeLines(
+           Util::ReadFileToLines(filename))) {
+    int x = atoi(Util::chop(line).c_str());
+    int y = atoi(Util::chop(line).c_str());
+
+    CHECK(line.empty()) << line;
+    p.stars.emplace_back(x, y);
+  }
+  return p;
+}
+
+void Problem::PrintInfo() {
+  std::unordered_set<std::pair<int, int>,
+                     Hashing<std::pair<int, int>>>
+    unique;
+  IntBounds bounds;
+  bounds.Bound(0, 0);
+  for (const auto &star : stars) {
+    unique.insert(star);
+    bounds.Bound(star);
+  }
+  fprintf(stderr,
+          AYELLOW("%d") " stars; " ACYAN("%d")
+          " distinct. %d x %d\n",
+          (int)stars.size(), (int)unique.size(),
+          (int)bounds.Width(), (int)bounds.Height());
+}
+
+namespace {
+// Open addressing over the distinct stars, with linear probing, for
+// the lookup per step in StarsMissed. Most positions aren't stars, so
+// a sparse bitmap filters them out first; then the branch is almost
+// always predicted, which matters more than the memory access.
+struct StarTable {
+  explicit StarTable(const std::vector<std::pair<int, int>> &stars) {
+    size_t size = 16;
+    while (size < 2 * stars.size()) size <<= 1;
+    mask = size - 1;
+    keys.resize(size, 0);
+    slots.resize(size, -1);
+    // About 1/64 of the bits set.
+    filter_mask = 64 * size - 1;
+    filter.resize(size, 0);
+    for (const auto &[x, y] : stars) {
+      const uint64_t key = Key(x, y);
+      size_t h = Hash(key);
+      while (slots[h] != -1 && keys[h] != key) h = (h + 1) & mask;
+      if (slots[h] == -1) {
+        keys[h] = key;
+        slots[h] = distinct++;
+      }
+      const uint64_t f = FilterBit(key);
+      filter[f >> 6] |= uint64_t{1} << (f & 63);
+    }
+    visited.resize(distinct, 0);
+  }
+
+  // Marks the star at (x, y) visited, if there is one.
+  void Visit(int64_t x, int64_t y) {
+    // Stars have int coordinates.
+    if (x != (int32_t)x || y != (int32_t)y) return;
+    const uint64_t key = Key(x, y);
+    const uint64_t f = FilterBit(key);
+    if (!((filter[f >> 6] >> (f & 63)) & 1)) return;
+    for (size_t h = Hash(key); slots[h] != -1; h = (h + 1) & mask) {
+      if (keys[h] == key) {
+        num_visited += !visited[slots[h]];
+        visited[slots[h]] = 1;
+        return;
+      }
+    }
+  }
+
+  int Missed() const { return distinct - num_visited; }
+
+ private:
+  static uint64_t Key(int64_t x, int64_t y) {
+    return ((uint64_t)(uint32_t)x << 32) | (uint32_t)y;
+  }
+  size_t Hash(uint64_t key) const {
+    return (size_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+  }
+  // Independent of Hash.
+  uint64_t FilterBit(uint64_t key) const {
+    return ((key * 0xD6E8FEB86659FD93ULL) >> 24) & filter_mask;
+  }
+
+  size_t mask = 0;
+  uint64_t filter_mask = 0;
+  std::vector<uint64_t> filter;
+  std::vector<uint64_t> keys;
+  // Index of the distinct star, or -1 if empty.
+  std::vector<int> slots;
+  std::vector<uint8_t> visited;
+  int distinct = 0, num_visited = 0;
+};
+}  // namespace
+
+int Problem::StarsMissed(std::string_view moves) const {
+  StarTable table(stars);
+  // A star at the origin is visited at the start.
+  table.Visit(0, 0);
+  const int64_t steps =
+    ForEachStep(moves, [&table](int64_t x, int64_t y, int, int) {
+        table.Visit(x, y);
+      });
+  if (steps != (int64_t)moves.size()) return -1;
+  return table.Missed();
+}
@@ -0,0 +1,193 @@
+
+#ifndef SPACESHIP_PROBLEM_H_
+#define SPACESHIP_PROBLEM_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+struct Spaceship {
+  int x = 0, y = 0;
+  int dx = 0, dy = 0;
+
+  // Gets the acceleration for a keypad key 1-9. Returns false for
+  // anything else.
+  static bool KeyAccel(uint8_t c, int *ax, int *ay) {
+    if (c < '1' || c > '9') return false;
+    *ax = (c - '1') % 3 - 1;
+    *ay = (c - '1') / 3 - 1;
+    return true;
+  }
+
+  // The inverse: the keypad key for an acceleration in [-1, 1]^2.
+  static char AccelKey(int ax, int ay) {
+    return '1' + (ay + 1) * 3 + (ax + 1);
+  }
+};
+
+// Keypad keys decoded by table lookup: the acceleration, and whether
+// the byte is not a key at all.
+struct KeyTable {
+  int8_t ax[256] = {}, ay[256] = {};
+  uint8_t bad[256] = {};
+  constexpr KeyTable() {
+    for (int c = 0; c < 256; c++) {
+      if (c >= '1' && c <= '9') {
+        ax[c] = (c - '1') % 3 - 1;
+        ay[c] = (c - '1') / 3 - 1;
+      } else {
+        bad[c] = 1;
+      }
+    }
+  }
+};
+inline constexpr KeyTable KEY_TABLE;
+
+// Fly the moves from the origin, calling f(x, y, ax, ay) with the
+// position after each step and the acceleration that got there. This
+// works a block at a time: the keys are decoded with the table, then
+// the velocity and position are prefix sums of the acceleration and
+// velocity, in tight loops without branches. Stops before the first
+// byte that isn't a key 1-9, and returns the number of steps taken.
+template<class F>
+inline int64_t ForEachStep(std::string_view moves, const F &f) {
+  static constexpr int BLOCK = 2048;
+  int8_t axs[BLOCK], ays[BLOCK];
+  int64_t xs[BLOCK], ys[BLOCK];
+  int64_t x = 0, y = 0, vx = 0, vy = 0;
+  const uint8_t *data = (const uint8_t *)moves.data();
+  for (size_t start = 0; start < moves.size(); start += BLOCK) {
+    const uint8_t *block = data + start;
+    const int len = std::min<size_t>(BLOCK, moves.size() - start);
+    uint8_t bad = 0;
+    for (int i = 0; i < len; i++) {
+      axs[i] = KEY_TABLE.ax[block[i]];
+      ays[i] = KEY_TABLE.ay[block[i]];
+      bad |= KEY_TABLE.bad[block[i]];
+    }
+    int valid = len;
+    if (bad) {
+      valid = 0;
+      while (!KEY_TABLE.bad[block[valid]]) valid++;
+    }
+
+    for (int i = 0; i < valid; i++) {
+      vx += axs[i];
+      vy += ays[i];
+      x += vx;
+      y += vy;
+      xs[i] = x;
+      ys[i] = y;
+    }
+
+    for (int i = 0; i < valid; i++) f(xs[i], ys[i], axs[i], ays[i]);
+    if (valid < len) return start + valid;
+  }
+  return moves.size();
+}
+
+// Exact reachability, one axis at a time. On an axis with velocity v
+// and the target at offset d, after t steps we have moved
+// t*v + sum_k k*a_k for k = 1..t, where the a_k are the accelerations
+// (each -1, 0 or 1) in reverse order. Those sums are exactly the
+// integers in [-T(t), T(t)] with T(t) = t(t+1)/2, so we can be at the
+// target at time t iff |d - t*v| <= T(t). The axes are independent,
+// so a 2D target is reachable at t iff it is on both axes.
+struct FeasibleTimes {
+  FeasibleTimes(int64_t v, int64_t d);
+
+  bool Contains(int64_t t) const;
+  // The smallest feasible time that's at least t.
+  int64_t NextFrom(int64_t t) const;
+
+  int64_t v = 0, d = 0;
+  // Both conditions d - t*v <= T(t) and t*v - d <= T(t) are quadratic
+  // in t, and fail on an interval between their roots. So the
+  // infeasible times are (at most) these two closed intervals. Empty
+  // ones have lo > hi.
+  struct Gap { int64_t lo = 1, hi = 0; };
+  Gap gaps[2];
+};
+
+// The smallest t at which the ship can be exactly at offset
+// (dx, dy) from where it is, with any velocity.
+int64_t MinTime2D(int64_t vx, int64_t vy, int64_t dx, int64_t dy);
+
+// The acceleration on one axis for the first step of a path that
+// reaches offset d at time t >= 1 (which must be feasible). Among the
+// accelerations that keep it feasible, prefers the one that leaves
+// the most slack.
+int FirstAccel(int64_t v, int64_t d, int64_t t);
+
+// Fly to (x, y) in the minimum number of steps, using FirstAccel on
+// each axis, and calling emit(ship, ax, ay) after each step. Returns
+// the ship when it arrives. Everything that measures or generates
+// paths between stars uses this, so that they agree.
+template<class F>
+inline Spaceship FlyTo(Spaceship ship, int x, int y, const F &emit) {
+  for (int64_t t = MinTime2D(ship.dx, ship.dy, x - ship.x, y - ship.y);
+       t > 0; t--) {
+    const int ax = FirstAccel(ship.dx, x - ship.x, t);
+    const int ay = FirstAccel(ship.dy, y - ship.y, t);
+    ship.dx += ax;
+    ship.dy += ay;
+    ship.x += ship.dx;
+    ship.y += ship.dy;
+    emit(ship, ax, ay);
+  }
+  return ship;
+}
+
+// The same, but also arriving with velocity w. Writing the
+// accelerations as p of +1 and m of -1 with p - m = w - v, the
+// displacement beyond t*v is a sum of p distinct weights from 1..t
+// minus m others. Those sums are exactly the integers in an
+// interval, whose upper end is attained with p = floor((t + w - v)/2)
+// on the largest weights (and the lower end symmetrically).
+bool FeasibleWithVelocity(int64_t v, int64_t d, int64_t w, int64_t t);
+
+// The smallest t at which the ship can be exactly at offset (dx, dy)
+// with velocity (wx, wy). There always is one.
+int64_t MinTimeWithVelocity2D(int64_t vx, int64_t vy, int64_t dx, int64_t dy,
+                              int64_t wx, int64_t wy);
+
+// Like FirstAccel, for a path that also arrives with velocity w.
+int FirstAccelWithVelocity(int64_t v, int64_t d, int64_t w, int64_t t);
+
+// Like FlyTo, but arriving with velocity (wx, wy).
+template<class F>
+inline Spaceship FlyToWithVelocity(Spaceship ship, int x, int y,
+                                   int wx, int wy, const F &emit) {
+  for (int64_t t = MinTimeWithVelocity2D(ship.dx, ship.dy,
+                                         x - ship.x, y - ship.y, wx, wy);
+       t > 0; t--) {
+    const int ax = FirstAccelWithVelocity(ship.dx, x - ship.x, wx, t);
+    const int ay = FirstAccelWithVelocity(ship.dy, y - ship.y, wy, t);
+    ship.dx += ax;
+    ship.dy += ay;
+    ship.x += ship.dx;
+    ship.y += ship.dy;
+    emit(ship, ax, ay);
+  }
+  return ship;
+}
+
+struct Problem {
+  static Problem FromFile(const std::string &filename);
+
+  std::vector<std::pair<int, int>> stars;
+
+  void PrintInfo();
+
+  // Fly the moves from the origin. Returns the number of distinct
+  // stars that we never stop on (including the start), or -1 if the
+  // moves contain something other than 1-9. One streaming pass with
+  // ForEachStep and a flat hash table, so it takes milliseconds for
+  // millions of moves.
+  int StarsMissed(std::string_view moves) const;
+};
+
+#endif
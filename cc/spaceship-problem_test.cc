@@ -0,0 +1,386 @@
+#include "spaceship-problem.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "arcfour.h"
+#include "base/logging.h"
+#include "hashing.h"
+#include "randutil.h"
+#include "spaceship-bound.h"
+#include "spaceship-legs.h"
+#include "spaceship-sweeps.h"
+
+// Compare the closed form against brute force: every (offset,
+// velocity) reachable on one axis after t steps.
+static void TestFeasibleTimes() {
+  for (int v = -6; v <= 6; v++) {
+    std::set<std::pair<int, int>> states = {{0, v}};
+    for (int t = 0; t <= 14; t++) {
+      std::set<int> positions;
+      for (const auto &[p, vel] : states) positions.insert(p);
+      for (int d = -130; d <= 130; d++) {
+        const FeasibleTimes times(v, d);
+        const bool want = positions.contains(d);
+        CHECK(times.Contains(t) == want) << v << " " << d << " " << t;
+        // No gap contains a feasible time, and every infeasible
+        // time is in a gap.
+        CHECK((times.NextFrom(t) == t) == want) << v << " " << d << " " << t;
+        for (int w = -22; w <= 22; w++) {
+          CHECK(FeasibleWithVelocity(v, d, w, t) == states.contains({d, w}))
+            << v << " " << d << " " << w << " " << t;
+        }
+      }
+
+      std::set<std::pair<int, int>> next;
+      for (const auto &[p, vel] : states)
+        for (int a : {-1, 0, 1})
+          next.emplace(p + vel + a, vel + a);
+      states = std::move(next);
+    }
+  }
+}
+
+// Following FirstAccel from the minimum time lands on the target
+// exactly then, and never sooner.
+static void TestPaths() {
+  for (int vx = -5; vx <= 5; vx++) {
+    for (int vy = -5; vy <= 5; vy += 2) {
+      for (int dx = -40; dx <= 40; dx += 3) {
+        for (int dy = -40; dy <= 40; dy += 7) {
+          const int64_t t = MinTime2D(vx, vy, dx, dy);
+          CHECK(FeasibleTimes(vx, dx).Contains(t) &&
+                FeasibleTimes(vy, dy).Contains(t));
+          for (int64_t s = 0; s < t; s++) {
+            CHECK(!FeasibleTimes(vx, dx).Contains(s) ||
+                  !FeasibleTimes(vy, dy).Contains(s));
+          }
+
+          Spaceship ship{.x = 0, .y = 0, .dx = vx, .dy = vy};
+          for (int64_t s = t; s > 0; s--) {
+            const int ax = FirstAccel(ship.dx, dx - ship.x, s);
+            const int ay = FirstAccel(ship.dy, dy - ship.y, s);
+            ship.dx += ax;
+            ship.dy += ay;
+            ship.x += ship.dx;
+            ship.y += ship.dy;
+          }
+          CHECK(ship.x == dx && ship.y == dy) << vx << " " << vy << " "
+                                              << dx << " " << dy;
+        }
+      }
+    }
+  }
+
+  // Big values are fine too.
+  const int64_t t = MinTime2D(-3000, 2500, 4000000, -1000000);
+  CHECK(FeasibleTimes(-3000, 4000000).Contains(t));
+  CHECK(FeasibleTimes(2500, -1000000).Contains(t));
+  CHECK(!FeasibleTimes(-3000, 4000000).Contains(t - 1) ||
+        !FeasibleTimes(2500, -1000000).Contains(t - 1));
+}
+
+// Likewise when the arrival velocity is given.
+static void TestPathsWithVelocity() {
+  for (int vx = -4; vx <= 4; vx++) {
+    for (int vy = -4; vy <= 4; vy += 3) {
+      for (int x = -25; x <= 25; x += 5) {
+        for (int y = -25; y <= 25; y += 7) {
+          for (const auto &[wx, wy] :
+                 {std::make_pair(0, 0), std::make_pair(3, -1),
+                  std::make_pair(-5, 4)}) {
+            const Spaceship start{.x = 0, .y = 0, .dx = vx, .dy = vy};
+            const int64_t want =
+              MinTimeWithVelocity2D(vx, vy, x, y, wx, wy);
+            int64_t steps = 0;
+            const Spaceship end =
+              FlyToWithVelocity(start, x, y, wx, wy,
+                                [&steps](const Spaceship &, int, int) {
+                                  steps++;
+                                });
+            CHECK(steps == want);
+            CHECK(end.x == x && end.y == y && end.dx == wx && end.dy == wy);
+            for (int64_t t = 0; t < want; t++) {
+              CHECK(!FeasibleWithVelocity(vx, x, wx, t) ||
+                    !FeasibleWithVelocity(vy, y, wy, t));
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// The streaming simulation agrees with flying step by step, across
+// block boundaries, and stops at a bad key.
+static void TestForEachStep() {
+  ArcFour rc("steps");
+  for (int len : {0, 1, 2047, 2048, 2049, 10000}) {
+    std::string moves;
+    for (int i = 0; i < len; i++) moves.push_back('1' + RandTo(&rc, 9));
+    if (len > 5 && (len & 1)) moves[len - 3] = '0';
+
+    Spaceship ship;
+    std::vector<std::tuple<int64_t, int64_t, int, int>> want;
+    for (uint8_t c : moves) {
+      int ax = 0, ay = 0;
+      if (!Spaceship::KeyAccel(c, &ax, &ay)) break;
+      ship.dx += ax;
+      ship.dy += ay;
+      ship.x += ship.dx;
+      ship.y += ship.dy;
+      want.emplace_back(ship.x, ship.y, ax, ay);
+    }
+
+    std::vector<std::tuple<int64_t, int64_t, int, int>> got;
+    const int64_t steps =
+      ForEachStep(moves, [&](int64_t x, int64_t y, int ax, int ay) {
+          got.emplace_back(x, y, ax, ay);
+        });
+    CHECK(steps == (int64_t)want.size());
+    CHECK(got == want) << len;
+
+    // Every position is a star except the last, and one that's not
+    // on the path.
+    Problem p;
+    for (const auto &[x, y, ax_, ay_] : want) p.stars.emplace_back(x, y);
+    p.stars.emplace_back(0, 0);
+    p.stars.emplace_back(1 << 30, 7);
+    const std::string_view valid(moves.data(), steps);
+    CHECK(p.StarsMissed(valid) == 1);
+    if (steps > 0) {
+      // Stopping short misses the final position, unless it's
+      // visited earlier too.
+      const auto &[x, y, ax_, ay_] = want.back();
+      int before = 0;
+      for (int i = 0; i + 1 < (int)want.size(); i++)
+        if (std::get<0>(want[i]) == x && std::get<1>(want[i]) == y) before++;
+      CHECK(p.StarsMissed(valid.substr(0, steps - 1)) ==
+            (before > 0 ? 1 : 2)) << len;
+    }
+    CHECK((p.StarsMissed(moves) == -1) == (steps < (int64_t)moves.size()));
+  }
+}
+
+static void TestStarsMissed() {
+  Problem p;
+  p.stars = {{0, 0}, {1, 0}, {3, 1}, {5, 5}};
+  // 6 accelerates right; 9 up and right.
+  CHECK(p.StarsMissed("") == 3);
+  CHECK(p.StarsMissed("69") == 1);
+  CHECK(p.StarsMissed("6x") == -1);
+}
+
+// Fewest moves that visit every star, by breadth-first search over
+// position, velocity, and the set of stars visited.
+static int64_t OptimalMoves(const Problem &p) {
+  const int n = p.stars.size();
+  using State = std::tuple<int, int, int, int, int>;
+  auto Visit = [&](int x, int y, int mask) {
+      for (int i = 0; i < n; i++)
+        if (p.stars[i] == std::make_pair(x, y)) mask |= 1 << i;
+      return mask;
+    };
+  const State start = {0, 0, 0, 0, Visit(0, 0, 0)};
+  std::unordered_map<State, int64_t, Hashing<State>> dist = {{start, 0}};
+  std::deque<State> queue = {start};
+  while (!queue.empty()) {
+    const State s = queue.front();
+    queue.pop_front();
+    const auto &[x, y, dx, dy, mask] = s;
+    if (mask == (1 << n) - 1) return dist[s];
+    for (int ax : {-1, 0, 1}) {
+      for (int ay : {-1, 0, 1}) {
+        const int ndx = dx + ax, ndy = dy + ay;
+        const int nx = x + ndx, ny = y + ndy;
+        const State next = {nx, ny, ndx, ndy, Visit(nx, ny, mask)};
+        if (dist.contains(next)) continue;
+        dist[next] = dist[s] + 1;
+        queue.push_back(next);
+      }
+    }
+  }
+  LOG(FATAL) << "unreachable";
+  return -1;
+}
+
+static void TestLowerBound() {
+  {
+    Problem p;
+    p.stars = {{0, 0}, {1, 0}, {1, 0}};
+    const SpaceshipBound bound = LowerBound(p, 1);
+    CHECK(bound.distinct == 1);
+    CHECK(bound.nearest_sum == 1);
+    CHECK(bound.travel == 1);
+    CHECK(bound.Bound() == 1);
+  }
+
+  {
+    // Far apart, so travel dominates: nearest distances 10 and 10.
+    Problem p;
+    p.stars = {{10, 0}, {10, -10}};
+    const SpaceshipBound bound = LowerBound(p, 2);
+    CHECK(bound.distinct == 2);
+    CHECK(bound.nearest_sum == 20);
+    CHECK(bound.travel == 6) << bound.travel;
+  }
+
+  {
+    // Back and forth between two columns: arriving at any star fast
+    // enough to get there in one move means leaving it the wrong way.
+    Problem p;
+    p.stars = {{10, 0}, {-10, 0}, {10, 1}, {-10, 1}, {10, 2}, {-10, 2}};
+    const SpaceshipBound bound = LowerBound(p, 2);
+    CHECK(bound.distinct == 6);
+    CHECK(bound.turn == 8) << bound.ToString();
+    CHECK(bound.Bound() == 8);
+  }
+
+  ArcFour rc("bound");
+  for (int iter = 0; iter < 40; iter++) {
+    Problem p;
+    const int n = 1 + RandTo(&rc, 3);
+    for (int i = 0; i < n; i++)
+      p.stars.emplace_back((int)RandTo(&rc, 7) - 3,
+                           (int)RandTo(&rc, 7) - 3);
+    const SpaceshipBound bound = LowerBound(p, 2);
+    const int64_t opt = OptimalMoves(p);
+    CHECK(bound.Bound() <= opt) << bound.ToString() << " vs " << opt;
+  }
+}
+
+static void TestSweeps() {
+  Problem p;
+  // A line of five with step (3, -2), a shorter one, and clutter
+  // (including a duplicate).
+  for (int i = 0; i < 5; i++) p.stars.emplace_back(100 + 3 * i, 50 - 2 * i);
+  for (int i = 0; i < 2; i++) p.stars.emplace_back(-40, -40 + 7 * i);
+  p.stars.emplace_back(103, 48);
+  p.stars.emplace_back(0, 0);
+  p.stars.emplace_back(55, -12);
+
+  const std::vector<Sweep> sweeps = FindSweeps(p.stars, 3, 2);
+  CHECK(sweeps.size() == 1) << sweeps.size();
+  const Sweep &sweep = sweeps[0];
+  CHECK(sweep.length == 5);
+  // Normalized to point right.
+  CHECK(sweep.dx == 3 && sweep.dy == -2);
+  CHECK(sweep.start == std::make_pair(100, 50));
+
+  // Flying it from anywhere visits all of its stars, coasting.
+  for (const Sweep &s : {sweep, sweep.Reversed()}) {
+    Problem line;
+    for (int i = 0; i < s.length; i++) line.stars.push_back(s.Star(i));
+    std::string moves;
+    int64_t coasting = 0;
+    FlySweep(Spaceship{.x = 0, .y = 0, .dx = 2, .dy = -1}, s,
+             [&](const Spaceship &, int ax, int ay) {
+               moves.push_back(Spaceship::AccelKey(ax, ay));
+             });
+    for (int i = 0; i < s.length - 1; i++)
+      if (moves[moves.size() - 1 - i] == '5') coasting++;
+    CHECK(coasting == s.length - 1);
+    CHECK((int64_t)moves.size() ==
+          SweepSteps(Spaceship{.x = 0, .y = 0, .dx = 2, .dy = -1}, s));
+
+    // StarsMissed starts from rest, so check from there too.
+    moves.clear();
+    FlySweep(Spaceship(), s, [&](const Spaceship &, int ax, int ay) {
+        moves.push_back(Spaceship::AccelKey(ax, ay));
+      });
+    CHECK(line.StarsMissed(moves) == 0) << moves;
+  }
+
+  CHECK(FindSweeps(p.stars, 6, 1).empty());
+}
+
+// The table agrees with Arrival1D wherever it has an entry, and
+// legs agree with FlyTo whether or not they come from the table.
+static void TestLegTable() {
+  const std::string filename = "spaceship-legs-test.bin";
+  LegTable::Generate(filename, 6, 60, 30, 2);
+  std::unique_ptr<LegTable> table = LegTable::Load(filename);
+  CHECK(table.get() != nullptr);
+  CHECK(table->max_v == 6 && table->max_d == 60 && table->max_t == 30);
+
+  for (int t = 0; t <= 30; t++) {
+    for (int v = -6; v <= 6; v++) {
+      for (int d = -60; d <= 60; d++) {
+        const std::optional<int64_t> w = table->Arrival(v, d, t);
+        if (FeasibleTimes(v, d).Contains(t)) {
+          CHECK(w.has_value() && w.value() == Arrival1D(v, d, t)) <<
+            v << " " << d << " " << t;
+        } else {
+          CHECK(!w.has_value()) << v << " " << d << " " << t;
+        }
+      }
+    }
+  }
+  CHECK(!table->Arrival(7, 0, 3).has_value());
+  CHECK(!table->Arrival(0, 61, 20).has_value());
+  CHECK(!table->Arrival(0, 1, 31).has_value());
+
+  auto Simulate = [](const Spaceship &start, int x, int y) {
+      Leg leg;
+      const Spaceship ship = FlyTo(start, x, y,
+                                   [&leg](const Spaceship &, int, int) {
+                                     leg.steps++;
+                                   });
+      leg.vx = ship.dx;
+      leg.vy = ship.dy;
+      return leg;
+    };
+
+  ArcFour rc("legs");
+  for (int use_table = 0; use_table < 2; use_table++) {
+    SetLegTable(use_table ? table.get() : nullptr);
+    int tabled = 0;
+    for (int i = 0; i < 5000; i++) {
+      // Mostly within the table, but not always.
+      const Spaceship ship{.x = (int)RandTo(&rc, 200) - 100,
+                           .y = (int)RandTo(&rc, 200) - 100,
+                           .dx = (int)RandTo(&rc, 17) - 8,
+                           .dy = (int)RandTo(&rc, 17) - 8};
+      const int x = ship.x + (int)RandTo(&rc, 150) - 75;
+      const int y = ship.y + (int)RandTo(&rc, 150) - 75;
+      if (TabledLeg(ship, x, y).has_value()) tabled++;
+      const Leg expected = Simulate(ship, x, y);
+      const Leg leg = FlyLeg(ship, x, y);
+      CHECK(leg.steps == expected.steps &&
+            leg.vx == expected.vx && leg.vy == expected.vy);
+    }
+    if (use_table) {
+      CHECK(tabled > 1000 && tabled < 5000) << tabled;
+    } else {
+      CHECK(tabled == 0);
+    }
+  }
+
+  SetLegTable(nullptr);
+  table.reset();
+  std::filesystem::remove(filename);
+}
+
+int main(int argc, char **argv) {
+  TestFeasibleTimes();
+  TestPaths();
+  TestPathsWithVelocity();
+  TestForEachStep();
+  TestStarsMissed();
+  TestLowerBound();
+  TestSweeps();
+  TestLegTable();
+
+  printf("OK\n");
+  return 0;
+}
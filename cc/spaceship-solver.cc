@@ -0,0 +1,535 @@
+#include "spaceship-solver.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "ansi.h"
+#include "auto-histo.h"
+#include "base/logging.h"
+#include "base/stringprintf.h"
+#include "geom/tree-2d.h"
+#include "hashing.h"
+#include "periodically.h"
+#include "spaceship-bound.h"
+#include "spaceship-legs.h"
+#include "spaceship-problem.h"
+#include "spaceship-sweeps.h"
+#include "spaceship-tour.h"
+#include "threadutil.h"
+#include "timer.h"
+
+#define SIMPLE_GREEDY 0
+
+namespace {
+struct Solver {
+  std::string solution;
+  // The stars in the order that the solution visits them.
+  std::vector<std::pair<int, int>> tour;
+
+  // Stars that we haven't visited yet.
+  struct Unit { };
+  Tree2D<int, Unit> tree;
+  // Each distinct star once.
+  std::vector<std::pair<int, int>> stars;
+
+  Spaceship ship;
+
+  AutoHisto histo;
+
+  int maxdx = 0, maxdy = 0;
+
+  // For nonnegative v, d.
+  static double TimeToDistNonNeg(double v, double d) {
+    CHECK(v >= 0.0);
+    CHECK(d >= 0.0);
+    // t = -v +/- sqrt(v^2 + 2 * a * d)/a
+    // and a=1
+    double s = sqrt(v * v + 2 * d);
+    double t0 = -v + s;
+    double t1 = -v - s;
+
+    CHECK(t0 >= 0.0 || t1 >= 0.0) <<
+      "Maybe d or v is negative? v: " << v << " d: " << d;
+    if (t0 < 0.0) return t1;
+    if (t1 < 0.0) return t0;
+    // Probably impossible?
+    return std::min(t0, t1);
+  }
+
+  static double TimeToDist1D(double v, double d) {
+    // make d nonnegative, by reflecting
+    if (d < 0.0) {
+      d = -d;
+      v = -v;
+    }
+
+    CHECK(d >= 0.0);
+
+    // If we're headed the wrong way, first we need to stop
+    if (v < 0.0) {
+      // How far away (p) do we get when the final velocity (vf) = 0?
+      // p = (vf^2 - v^2) / 2a
+      // p = -v^2 / 2
+      double p = v * v / -2;
+      // p is negative, but we are increasing the dist.
+      double effective_dist = d - p;
+      // PERF: Could specialize this since we know v is 0.
+      return TimeToDistNonNeg(0.0, effective_dist);
+    } else {
+      return TimeToDistNonNeg(v, d);
+    }
+  }
+
+  // Various distances, just used for picking the "closest".
+  static int64_t DistSqEuclidean(const Spaceship &ship, int x1, int y1) {
+    int64_t dxx = x1 - ship.x;
+    int64_t dyy = y1 - ship.y;
+    return dxx * dxx + dyy * dyy;
+  }
+
+  // Treating each axis separately, find how long it would take us
+  // (milliticks) to reach the point by constantly accelerating
+  // towards it. This is optimistic because we aren't moving
+  // continuously.
+  static int64_t DistConstantAccelSeparate(const Spaceship &ship, int x1, int y1) {
+    return std::max(TimeToDist1D(ship.dx, x1 - ship.x),
+                    TimeToDist1D(ship.dy, y1 - ship.y)) * 1000.0;
+  }
+
+  // Number of stars to consider for each target, in the velocity-aware
+  // mode. More isn't necessarily better, since it's still greedy.
+  static constexpr int NUM_CANDIDATES = 8;
+
+  // The nearest few stars (O(log n + k) with the tree), best first
+  // by the time to reach them given our velocity. Exact time breaks
+  // ties, since the estimate is continuous. Skips the stars in
+  // exclude.
+  std::vector<std::pair<int, int>> Candidates(
+      const Spaceship &ship, int num,
+      const std::vector<std::pair<int, int>> &exclude = {}) const {
+    std::vector<std::pair<std::pair<int64_t, int64_t>, std::pair<int, int>>>
+      scored;
+    for (const auto &[star, unit_, dist_] :
+           tree.KNearest({ship.x, ship.y}, num + (int)exclude.size())) {
+      if (std::find(exclude.begin(), exclude.end(), star) != exclude.end())
+        continue;
+      scored.emplace_back(std::make_pair(
+                              DistConstantAccelSeparate(ship, star.first,
+                                                        star.second),
+                              (int64_t)DistTo(ship, star)),
+                          star);
+    }
+    std::stable_sort(scored.begin(), scored.end(),
+                     [](const auto &a, const auto &b) {
+                       return a.first < b.first;
+                     });
+    std::vector<std::pair<int, int>> out;
+    for (const auto &[score_, star] : scored) {
+      if ((int)out.size() == num) break;
+      out.push_back(star);
+    }
+    return out;
+  }
+
+  // Lookahead: with beam_width > 0, instead of taking the best
+  // candidate, search over sequences of beam_depth targets (trying
+  // the best beam_branch candidates at each step), keeping the
+  // beam_width shortest at each depth, and take the first target of
+  // the best one. This avoids arriving at a star with a velocity that
+  // makes the next few expensive.
+  int beam_width = 0, beam_depth = 3, beam_branch = 4;
+  int threads = 1;
+
+  struct Partial {
+    Spaceship ship;
+    // Targets so far.
+    std::vector<std::pair<int, int>> path;
+    int64_t steps = 0;
+  };
+
+  // Two partial tours are equivalent if they end in the same state
+  // and visit the same set of stars.
+  static uint64_t PartialHash(const Partial &p) {
+    uint64_t h = Hashing<std::tuple<int, int, int, int>>()(
+        std::make_tuple(p.ship.x, p.ship.y, p.ship.dx, p.ship.dy));
+    // Order-independent.
+    uint64_t set = 0;
+    for (const auto &star : p.path) {
+      uint64_t s = Hashing<std::pair<int, int>>()(star);
+      s *= 0x9E3779B97F4A7C15ULL;
+      set += s ^ (s >> 29);
+    }
+    return h ^ (set * 0xBF58476D1CE4E5B9ULL);
+  }
+
+  std::pair<int, int> BeamTarget() {
+    std::vector<Partial> beam = {Partial{.ship = ship}};
+    for (int depth = 0; depth < beam_depth; depth++) {
+      std::vector<std::vector<Partial>> expanded =
+        ParallelMap(beam, [this](const Partial &p) {
+            std::vector<Partial> children;
+            for (const auto &star : Candidates(p.ship, beam_branch, p.path)) {
+              Partial child = p;
+              const Leg leg = FlyLeg(p.ship, star.first, star.second);
+              child.ship = Spaceship{.x = star.first, .y = star.second,
+                                     .dx = leg.vx, .dy = leg.vy};
+              child.steps += leg.steps;
+              child.path.push_back(star);
+              children.push_back(std::move(child));
+            }
+            // Out of stars.
+            if (children.empty()) children.push_back(p);
+            return children;
+          }, threads);
+
+      std::vector<Partial> next;
+      for (auto &children : expanded)
+        for (Partial &child : children)
+          next.push_back(std::move(child));
+      std::stable_sort(next.begin(), next.end(),
+                       [](const Partial &a, const Partial &b) {
+                         return a.steps < b.steps;
+                       });
+      beam.clear();
+      std::unordered_set<uint64_t> seen;
+      for (Partial &p : next) {
+        if ((int)beam.size() == beam_width) break;
+        if (seen.insert(PartialHash(p)).second)
+          beam.push_back(std::move(p));
+      }
+    }
+
+    CHECK(!beam.empty() && !beam[0].path.empty());
+    return beam[0].path[0];
+  }
+
+  // Pick a target node (removing it from the tree).
+  std::pair<int, int> GetTarget() {
+    CHECK(!tree.Empty());
+
+    #if SIMPLE_GREEDY
+
+    const auto &[star_pos, unit_, dist_] = tree.Closest({ship.x, ship.y});
+    const int64_t best_dist = DistSqEuclidean(ship, star_pos.first,
+                                              star_pos.second);
+
+    #else
+    const std::pair<int, int> star_pos = beam_width > 0 ? BeamTarget() :
+      Candidates(ship, NUM_CANDIDATES)[0];
+    const int64_t best_dist = DistTo(ship, star_pos);
+    #endif
+
+    histo.Observe(best_dist);
+
+    CHECK(tree.Remove(star_pos));
+    return star_pos;
+  }
+
+  explicit Solver(Problem p) {
+    // Insert each star once.
+    std::unordered_set<std::pair<int, int>,
+                       Hashing<std::pair<int, int>>> unique;
+    for (const auto &pt : p.stars) {
+      if (unique.insert(pt).second) {
+        tree.Insert(pt, Unit{});
+        stars.push_back(pt);
+      }
+    }
+  }
+
+  // With min_sweep > 0, arithmetic progressions of at least that many
+  // stars are macro-targets: when the greedy search picks one of a
+  // sweep's ends, we take the whole sweep if arriving with its
+  // velocity and coasting through is faster than flying star to star.
+  int min_sweep = 0;
+  // Allowance, in steps per star of the sweep, for how much better
+  // coasting is than flying to them one by one.
+  static constexpr int SWEEP_SLACK = 2;
+  std::vector<Sweep> sweeps;
+  // Index of the sweep that each star is in (if any). Sweeps are
+  // disjoint.
+  std::unordered_map<std::pair<int, int>, int,
+                     Hashing<std::pair<int, int>>> sweep_of;
+  // Sweeps that we've visited any star of.
+  std::vector<bool> sweep_used;
+
+  // Steps to fly to each star in order, one at a time.
+  static int64_t ChainSteps(Spaceship ship,
+                            const std::vector<std::pair<int, int>> &path) {
+    int64_t steps = 0;
+    for (const auto &[x, y] : path)
+      ship = FlyTo(ship, x, y, [&steps](const Spaceship &, int, int) {
+          steps++;
+        });
+    return steps;
+  }
+
+  // The stars of the longest progression (of at least min_sweep) that
+  // starts at tour[i].
+  std::optional<Sweep> SweepAt(const std::vector<std::pair<int, int>> &tour,
+                               size_t i) const {
+    if (min_sweep < 2 || i + 1 >= tour.size()) return std::nullopt;
+    Sweep sweep{.start = tour[i],
+                .dx = tour[i + 1].first - tour[i].first,
+                .dy = tour[i + 1].second - tour[i].second,
+                .length = 2};
+    if (sweep.dx == 0 && sweep.dy == 0) return std::nullopt;
+    while (i + sweep.length < tour.size() &&
+           tour[i + sweep.length] == sweep.Star(sweep.length))
+      sweep.length++;
+    if (sweep.length < min_sweep) return std::nullopt;
+    return sweep;
+  }
+
+  // Fly to tour[i], or through a sweep starting there if that's
+  // faster, appending to the solution. Returns the index of the next
+  // star to fly to.
+  size_t GoFrom(const std::vector<std::pair<int, int>> &tour, size_t i) {
+    const std::optional<Sweep> sweep = SweepAt(tour, i);
+    if (sweep.has_value()) {
+      const size_t end = i + sweep.value().length;
+      // Include the leg after, since it depends on how we leave.
+      const size_t next = std::min(end + 1, tour.size());
+      const std::vector<std::pair<int, int>> path(tour.begin() + i,
+                                                  tour.begin() + next);
+      const Sweep &sw = sweep.value();
+      Spaceship after{.x = sw.Star(sw.length - 1).first,
+                      .y = sw.Star(sw.length - 1).second,
+                      .dx = sw.dx, .dy = sw.dy};
+      const int64_t sweep_steps = SweepSteps(ship, sw) +
+        ChainSteps(after, std::vector<std::pair<int, int>>(
+                       tour.begin() + end, tour.begin() + next));
+      if (sweep_steps < ChainSteps(ship, path)) {
+        GoSweep(sw);
+        return end;
+      }
+    }
+    GoTo(tour[i]);
+    return i + 1;
+  }
+
+  bool verbose = true;
+
+  // If the star is in a sweep that we haven't started, and it's
+  // about as fast to take the whole sweep (from whichever end is
+  // better), that sweep. Either way, the star's sweep is used.
+  std::optional<Sweep> TakeSweep(std::pair<int, int> star_pos) {
+    auto it = sweep_of.find(star_pos);
+    if (it == sweep_of.end() || sweep_used[it->second]) return std::nullopt;
+    sweep_used[it->second] = true;
+    Sweep sweep = sweeps[it->second];
+    if (SweepSteps(ship, sweep.Reversed()) < SweepSteps(ship, sweep))
+      sweep = sweep.Reversed();
+    // Visiting the rest takes at least one step each, so compare to
+    // that.
+    if (SweepSteps(ship, sweep) >
+        DistTo(ship, star_pos) + SWEEP_SLACK * (sweep.length - 1))
+      return std::nullopt;
+    return sweep;
+  }
+
+  // Move to every spot, appending to the solution.
+  void Solve() {
+    Periodically status_per(1.0);
+    Timer timer;
+
+    if (min_sweep > 0) {
+      sweeps = FindSweeps(stars, min_sweep, threads);
+      sweep_used.resize(sweeps.size(), false);
+      int64_t covered = 0;
+      for (int i = 0; i < (int)sweeps.size(); i++) {
+        covered += sweeps[i].length;
+        for (int k = 0; k < sweeps[i].length; k++)
+          sweep_of[sweeps[i].Star(k)] = i;
+      }
+      if (verbose) {
+        fprintf(stderr, "%d sweeps cover %lld of %d stars.\n\n",
+                (int)sweeps.size(), (long long)covered, (int)stars.size());
+      }
+    }
+
+    const int total = (int)tree.Size();
+    int done = 0;
+    while (!tree.Empty()) {
+      auto star_pos = GetTarget();
+
+      const size_t pos = tour.size();
+      if (const std::optional<Sweep> sweep = TakeSweep(star_pos)) {
+        // The target was removed; the rest of the sweep's stars
+        // are still in the tree.
+        for (int k = 0; k < sweep.value().length; k++) {
+          const std::pair<int, int> star = sweep.value().Star(k);
+          if (star != star_pos) {
+            CHECK(tree.Remove(star));
+          }
+          tour.push_back(star);
+          done++;
+        }
+      } else {
+        tour.push_back(star_pos);
+        done++;
+      }
+
+      // Go to the point (or through the sweep).
+      for (size_t i = pos; i < tour.size(); i = GoFrom(tour, i)) { }
+
+      if (verbose && status_per.ShouldRun()) {
+        fprintf(stderr, ANSI_UP "%s\n",
+                ANSI::ProgressBar(
+                    done, total,
+                    StringPrintf("@%d,%d ^[%d,%d] sol %d",
+                                 ship.x, ship.y, ship.dx, ship.dy,
+                                 (int)solution.size()),
+                    timer.Seconds()).c_str());
+      }
+    }
+  }
+
+  // Generate a shortest path to the point, calling emit after each
+  // step.
+  template<class F>
+  Spaceship PathTo2D(
+      Spaceship ship,
+      std::pair<int, int> star_pos,
+      const F &emit) {
+    ship = FlyTo(ship, star_pos.first, star_pos.second, emit);
+    CHECK(ship.x == star_pos.first && ship.y == star_pos.second);
+    return ship;
+  }
+
+  // Number of steps to the point, without generating the path.
+  static int DistTo(const Spaceship &ship, std::pair<int, int> star_pos) {
+    return MinTime2D(ship.dx, ship.dy,
+                     star_pos.first - ship.x,
+                     star_pos.second - ship.y);
+  }
+
+  // Replace the solution with one that visits the stars in the given
+  // order.
+  void SetTour(std::vector<std::pair<int, int>> new_tour) {
+    ship = Spaceship();
+    solution.clear();
+    maxdx = maxdy = 0;
+    tour = std::move(new_tour);
+    for (size_t i = 0; i < tour.size(); i = GoFrom(tour, i)) { }
+  }
+
+  // Arrive at the sweep's start with its velocity, and coast through.
+  void GoSweep(const Sweep &sweep) {
+    ship = FlySweep(ship, sweep, [this](const Spaceship &ship, int ax, int ay) {
+        if (abs(ship.dx) > maxdx) maxdx = abs(ship.dx);
+        if (abs(ship.dy) > maxdy) maxdy = abs(ship.dy);
+
+        solution.push_back(Key(ax, ay));
+      });
+  }
+
+  // Generate the path to the point, and update the state/solution with it.
+  void GoTo(std::pair<int, int> star_pos) {
+    ship =
+      PathTo2D(ship, star_pos, [this](const Spaceship &ship, int ax, int ay) {
+          if (abs(ship.dx) > maxdx) maxdx = abs(ship.dx);
+          if (abs(ship.dy) > maxdy) maxdy = abs(ship.dy);
+
+          solution.push_back(Key(ax, ay));
+        });
+  }
+
+  static char Key(int ax, int ay) {
+    CHECK(ax >= -1 && ax <= 1);
+    CHECK(ay >= -1 && ay <= 1);
+    switch (ay) {
+    case +1: return "789"[ax + 1];
+    case  0: return "456"[ax + 1];
+    case -1: return "123"[ax + 1];
+    default: return 'X';
+    }
+  }
+
+};
+}  // namespace
+
+
+SpaceshipSolution SolveSpaceship(const Problem &p,
+                                 const SpaceshipSolverOptions &options) {
+  Solver solver(p);
+  solver.beam_width = options.beam_width;
+  solver.beam_depth = options.beam_depth;
+  solver.beam_branch = options.beam_branch;
+  solver.threads = options.threads;
+  solver.min_sweep = options.min_sweep;
+  solver.verbose = options.verbose;
+  solver.Solve();
+
+  SpaceshipSolution sol;
+  sol.greedy_moves = solver.solution.size();
+  sol.histo = solver.histo.SimpleANSI(32);
+  if (options.verbose) {
+    fprintf(stderr,
+            "\nGreedy: " AGREEN("%lld") " moves. Max velocity: ["
+            ACYAN("%d") "," ACYAN("%d") "]\n",
+            (long long)sol.greedy_moves, solver.maxdx, solver.maxdy);
+  }
+
+  if (options.opt_seconds > 0.0) {
+    TourOptimizerOptions opt_options;
+    opt_options.seconds = options.opt_seconds;
+    opt_options.threads = options.threads;
+    opt_options.verbose = options.verbose;
+    std::vector<std::pair<int, int>> tour = solver.tour;
+    sol.opt_stats = OptimizeTour(&tour, opt_options);
+    if (options.min_sweep == 0) {
+      CHECK(sol.opt_stats.steps_before == sol.greedy_moves);
+      solver.SetTour(std::move(tour));
+      CHECK(sol.opt_stats.steps_after == (int64_t)solver.solution.size());
+    } else {
+      // The optimizer measures flying star to star, so it doesn't see
+      // the sweeps. Replay its order with them, but keep the greedy
+      // tour if that was better.
+      std::vector<std::pair<int, int>> greedy_tour = solver.tour;
+      solver.SetTour(std::move(tour));
+      if ((int64_t)solver.solution.size() > sol.greedy_moves)
+        solver.SetTour(std::move(greedy_tour));
+      if (options.verbose) {
+        fprintf(stderr, "With sweeps: " AGREEN("%lld") " moves.\n",
+                (long long)solver.solution.size());
+      }
+    }
+    if (options.verbose) {
+      const TourOptimizerStats &stats = sol.opt_stats;
+      fprintf(stderr,
+              "Tour optimization: " AGREEN("%lld") " -> " AGREEN("%lld")
+              " moves (%.2f%% better) with %lld changes, %lld evaluated, "
+              "in %s.\n",
+              (long long)stats.steps_before, (long long)stats.steps_after,
+              stats.steps_before > 0 ?
+              (100.0 * (stats.steps_before - stats.steps_after)) /
+              stats.steps_before : 0.0,
+              (long long)stats.moves_applied,
+              (long long)stats.moves_evaluated,
+              ANSI::Time(stats.seconds).c_str());
+    }
+  }
+
+  sol.bound = LowerBound(p, options.threads);
+  if (options.verbose) {
+    fprintf(stderr, "Lower bound: %s. Gap: " AYELLOW("%.2f%%") "\n",
+            sol.bound.ToString().c_str(),
+            sol.bound.GapPercent(solver.solution.size()));
+  }
+
+  sol.maxdx = solver.maxdx;
+  sol.maxdy = solver.maxdy;
+  sol.moves = std::move(solver.solution);
+  return sol;
+}
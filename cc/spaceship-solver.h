@@ -0,0 +1,45 @@
+
+#ifndef SPACESHIP_SOLVER_H_
+#define SPACESHIP_SOLVER_H_
+
+#include <cstdint>
+#include <string>
+
+#include "spaceship-bound.h"
+#include "spaceship-problem.h"
+#include "spaceship-tour.h"
+
+struct SpaceshipSolverOptions {
+  // Lookahead: with beam_width > 0, each target is chosen by a beam
+  // search beam_depth targets deep, trying the best beam_branch
+  // candidates at each step. Otherwise greedy.
+  int beam_width = 0, beam_depth = 3, beam_branch = 4;
+  // Arithmetic progressions of at least this many stars are taken
+  // as a whole by coasting through them; 0 to disable.
+  int min_sweep = 0;
+  // Time for the tour optimizer afterwards; 0 to skip it.
+  double opt_seconds = 10.0;
+  int threads = 1;
+  // Progress and statistics on stderr.
+  bool verbose = true;
+};
+
+struct SpaceshipSolution {
+  // The keypad moves.
+  std::string moves;
+  // Number of moves before the tour optimizer.
+  int64_t greedy_moves = 0;
+  TourOptimizerStats opt_stats;
+  int maxdx = 0, maxdy = 0;
+  // Histogram of steps between stars (before optimization).
+  std::string histo;
+  // Lower bound on any solution's length, for the gap.
+  SpaceshipBound bound;
+};
+
+// Thread-safe, and the problems are independent, so several can be
+// solved at once.
+SpaceshipSolution SolveSpaceship(const Problem &p,
+                                 const SpaceshipSolverOptions &options);
+
+#endif
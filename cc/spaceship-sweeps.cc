@@ -0,0 +1,100 @@
+#include "spaceship-sweeps.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "geom/tree-2d.h"
+#include "hashing.h"
+#include "spaceship-problem.h"
+#include "threadutil.h"
+
+// Each star votes for the steps to this many of its neighbors.
+static constexpr int NEIGHBORS = 8;
+
+std::vector<Sweep> FindSweeps(const std::vector<std::pair<int, int>> &input,
+                              int min_length, int threads) {
+  using Pos = std::pair<int, int>;
+  std::vector<Pos> stars;
+  std::unordered_map<Pos, int, Hashing<Pos>> index;
+  for (const Pos &star : input) {
+    if (index.emplace(star, (int)stars.size()).second)
+      stars.push_back(star);
+  }
+
+  std::vector<Sweep> sweeps;
+  if (min_length < 2 || (int)stars.size() < min_length) return sweeps;
+
+  Tree2D<int, int> tree;
+  for (int i = 0; i < (int)stars.size(); i++) tree.Insert(stars[i], i);
+
+  // Steps are normalized to point right (or up), and each is stored
+  // with the star it starts from.
+  std::vector<std::vector<std::pair<Pos, int>>> votes =
+    ParallelTabulate(stars.size(), [&](int64_t i) {
+        std::vector<std::pair<Pos, int>> out;
+        for (const auto &[pos, j, dist_] :
+               tree.KNearest(stars[i], NEIGHBORS + 1)) {
+          const int dx = pos.first - stars[i].first;
+          const int dy = pos.second - stars[i].second;
+          if (dx > 0 || (dx == 0 && dy > 0))
+            out.emplace_back(Pos(dx, dy), (int)i);
+        }
+        return out;
+      }, threads);
+
+  std::unordered_map<Pos, std::vector<int>, Hashing<Pos>> accumulator;
+  for (const auto &v : votes)
+    for (const auto &[step, i] : v)
+      accumulator[step].push_back(i);
+  votes.clear();
+
+  // A progression of length L gets L - 1 votes (if its stars are
+  // near each other), so fewer can't be one.
+  std::vector<std::pair<Pos, std::vector<int>>> steps;
+  for (auto &[step, from] : accumulator)
+    if ((int)from.size() >= min_length - 1)
+      steps.emplace_back(step, std::move(from));
+  accumulator.clear();
+  // Most votes first. The rest only breaks ties deterministically.
+  std::sort(steps.begin(), steps.end(), [](const auto &a, const auto &b) {
+      if (a.second.size() != b.second.size())
+        return a.second.size() > b.second.size();
+      return a.first < b.first;
+    });
+
+  std::vector<bool> used(stars.size(), false);
+  auto Unused = [&](Pos p) {
+      auto it = index.find(p);
+      return it != index.end() && !used[it->second];
+    };
+  for (auto &[step, from] : steps) {
+    const auto [dx, dy] = step;
+    std::sort(from.begin(), from.end());
+    for (int i : from) {
+      if (used[i]) continue;
+      // Back up to the start of the progression, then take the whole
+      // thing.
+      Pos start = stars[i];
+      while (Unused({start.first - dx, start.second - dy}))
+        start = {start.first - dx, start.second - dy};
+      Sweep sweep{.start = start, .dx = dx, .dy = dy, .length = 0};
+      while (Unused(sweep.Star(sweep.length))) sweep.length++;
+      if (sweep.length < min_length) continue;
+      for (int k = 0; k < sweep.length; k++)
+        used[index[sweep.Star(k)]] = true;
+      sweeps.push_back(sweep);
+    }
+  }
+  return sweeps;
+}
+
+int64_t SweepSteps(const Spaceship &ship, const Sweep &sweep) {
+  return MinTimeWithVelocity2D(ship.dx, ship.dy,
+                               sweep.start.first - ship.x,
+                               sweep.start.second - ship.y,
+                               sweep.dx, sweep.dy) + sweep.length - 1;
+}
@@ -0,0 +1,53 @@
+
+#ifndef SPACESHIP_SWEEPS_H_
+#define SPACESHIP_SWEEPS_H_
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "spaceship-problem.h"
+
+// An arithmetic progression of stars, start + i * (dx, dy) for
+// i in [0, length). Arriving at the start with velocity (dx, dy), the
+// ship visits them all by coasting, one step each.
+struct Sweep {
+  std::pair<int, int> start;
+  int dx = 0, dy = 0;
+  int length = 0;
+
+  std::pair<int, int> Star(int i) const {
+    return {start.first + i * dx, start.second + i * dy};
+  }
+  // The same stars in the opposite direction.
+  Sweep Reversed() const {
+    return Sweep{.start = Star(length - 1), .dx = -dx, .dy = -dy,
+                 .length = length};
+  }
+};
+
+// Finds disjoint maximal progressions of at least min_length distinct
+// stars. Like a Hough transform: the differences between each star
+// and its nearest neighbors vote for steps, and the most popular steps
+// are extracted first. Parallel over the stars.
+std::vector<Sweep> FindSweeps(const std::vector<std::pair<int, int>> &stars,
+                              int min_length, int threads);
+
+// Steps to visit the sweep from the ship by arriving with its
+// velocity and coasting.
+int64_t SweepSteps(const Spaceship &ship, const Sweep &sweep);
+
+// Fly the sweep that way, calling emit(ship, ax, ay) after each step.
+template<class F>
+inline Spaceship FlySweep(Spaceship ship, const Sweep &sweep, const F &emit) {
+  ship = FlyToWithVelocity(ship, sweep.start.first, sweep.start.second,
+                           sweep.dx, sweep.dy, emit);
+  for (int i = 1; i < sweep.length; i++) {
+    ship.x += ship.dx;
+    ship.y += ship.dy;
+    emit(ship, 0, 0);
+  }
+  return ship;
+}
+
+#endif
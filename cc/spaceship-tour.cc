@@ -0,0 +1,342 @@
+#include "spaceship-tour.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "ansi.h"
+#include "arcfour.h"
+#include "base/logging.h"
+#include "base/stringprintf.h"
+#include "geom/tree-2d.h"
+#include "hashing.h"
+#include "periodically.h"
+#include "randutil.h"
+#include "spaceship-legs.h"
+#include "spaceship-problem.h"
+#include "threadutil.h"
+#include "timer.h"
+
+int64_t TourSteps(const std::vector<std::pair<int, int>> &tour) {
+  int64_t steps = 0;
+  Spaceship ship;
+  for (const auto &[x, y] : tour) {
+    const Leg leg = FlyLeg(ship, x, y);
+    steps += leg.steps;
+    ship = Spaceship{.x = x, .y = y, .dx = leg.vx, .dy = leg.vy};
+  }
+  return steps;
+}
+
+std::string TourMoves(const std::vector<std::pair<int, int>> &tour) {
+  std::string moves;
+  Spaceship ship;
+  for (const auto &[x, y] : tour)
+    ship = FlyTo(ship, x, y, [&moves](const Spaceship &, int ax, int ay) {
+        moves.push_back(Spaceship::AccelKey(ax, ay));
+      });
+  return moves;
+}
+
+namespace {
+
+// Memo of legs by velocity and offset, since the optimizer evaluates
+// the same ones over and over. Sharded so that threads rarely
+// contend for a lock. Misses come from the precomputed table if it's
+// loaded, which is still slower than a hit here.
+struct LegCache {
+  static constexpr int SHARDS = 64;
+  // Each shard is just cleared when it gets this big.
+  static constexpr size_t MAX_SHARD_SIZE = 1 << 18;
+
+  Leg Get(int vx, int vy, int dx, int dy) {
+    const Key key(vx, vy, dx, dy);
+    Shard &shard = shards[Hashing<Key>()(key) % SHARDS];
+    {
+      MutexLock ml(&shard.m);
+      auto it = shard.table.find(key);
+      if (it != shard.table.end()) return it->second;
+    }
+
+    const Leg leg =
+      FlyLeg(Spaceship{.x = 0, .y = 0, .dx = vx, .dy = vy}, dx, dy);
+
+    MutexLock ml(&shard.m);
+    if (shard.table.size() >= MAX_SHARD_SIZE) shard.table.clear();
+    shard.table[key] = leg;
+    return leg;
+  }
+
+ private:
+  using Key = std::tuple<int, int, int, int>;
+  struct Shard {
+    std::mutex m;
+    std::unordered_map<Key, Leg, Hashing<Key>> table;
+  };
+  Shard shards[SHARDS];
+};
+
+// Replace order[lo..hi] with content (a permutation of it).
+struct Move {
+  int lo = 0, hi = 0;
+  std::vector<int> content;
+  int64_t total = 0;
+};
+
+struct Optimizer {
+  Optimizer(const std::vector<std::pair<int, int>> &tour,
+            const TourOptimizerOptions &options) :
+    options(options), stars(tour), n((int)tour.size()) {
+    order.resize(n);
+    pos_of.resize(n);
+    for (int i = 0; i < n; i++) order[i] = pos_of[i] = i;
+    time.resize(n);
+    vel.resize(n);
+    Recompute(0, n);
+
+    Tree2D<int, int> tree;
+    for (int i = 0; i < n; i++) tree.Insert(stars[i], i);
+    neighbors = ParallelTabulate(n, [&](int64_t i) {
+        std::vector<int> out;
+        // The first is the star itself.
+        for (const auto &[pos_, idx, dist_] :
+               tree.KNearest(stars[i], options.neighbors + 1))
+          if (idx != i) out.push_back(idx);
+        return out;
+      }, options.threads);
+  }
+
+  int64_t Total() const { return n == 0 ? 0 : time[n - 1]; }
+
+  // The ship just before flying to order[k], and the time.
+  Spaceship Before(int k) const {
+    if (k == 0) return Spaceship();
+    const auto &[x, y] = stars[order[k - 1]];
+    return Spaceship{.x = x, .y = y,
+                     .dx = vel[k - 1].first, .dy = vel[k - 1].second};
+  }
+  int64_t TimeBefore(int k) const { return k == 0 ? 0 : time[k - 1]; }
+
+  // Fly from the ship to the star, updating the ship and time.
+  void Go(int star, Spaceship *ship, int64_t *t) {
+    const auto &[x, y] = stars[star];
+    const Leg leg = cache.Get(ship->dx, ship->dy, x - ship->x, y - ship->y);
+    *t += leg.steps;
+    *ship = Spaceship{.x = x, .y = y, .dx = leg.vx, .dy = leg.vy};
+  }
+
+  // Recompute time and vel for indices [lo, hi).
+  void Recompute(int lo, int hi) {
+    Spaceship ship = Before(lo);
+    int64_t t = TimeBefore(lo);
+    for (int k = lo; k < hi; k++) {
+      Go(order[k], &ship, &t);
+      time[k] = t;
+      vel[k] = {ship.dx, ship.dy};
+    }
+  }
+
+  // Total time if we applied the move, along with the index at which
+  // the velocity agrees with the current tour again (after which
+  // nothing changes), or n. Nullopt if it doesn't agree soon enough.
+  std::optional<std::pair<int64_t, int>> Evaluate(
+      int lo, int hi, const std::vector<int> &content) {
+    Spaceship ship = Before(lo);
+    int64_t t = TimeBefore(lo);
+    for (int c : content) Go(c, &ship, &t);
+    if (content.back() == order[hi] &&
+        ship.dx == vel[hi].first && ship.dy == vel[hi].second)
+      return {{t + Total() - time[hi], hi}};
+    for (int m = hi + 1; m < n; m++) {
+      if (m - hi > options.max_resync) return std::nullopt;
+      Go(order[m], &ship, &t);
+      if (ship.dx == vel[m].first && ship.dy == vel[m].second)
+        return {{t + Total() - time[m], m}};
+    }
+    return {{t, n - 1}};
+  }
+
+  // The best move that connects order[i - 1] to one of its neighbors,
+  // if it's an improvement. Doesn't modify the tour (but can be run
+  // in parallel).
+  std::optional<Move> BestMoveAt(int i, int64_t *evaluated) {
+    std::optional<Move> best;
+    const int a = order[i - 1];
+    auto Try = [&](int lo, int hi, std::vector<int> content) {
+        if (hi - lo + 1 > options.max_span) return;
+        (*evaluated)++;
+        const auto e = Evaluate(lo, hi, content);
+        if (!e.has_value()) return;
+        const int64_t total = e.value().first;
+        if (total < (best.has_value() ? best.value().total : Total())) {
+          best = Move{.lo = lo, .hi = hi, .content = std::move(content),
+                      .total = total};
+        }
+      };
+    auto Slice = [this](int lo, int hi) {
+        return std::vector<int>(order.begin() + lo, order.begin() + hi + 1);
+      };
+
+    for (int c : neighbors[a]) {
+      const int q = pos_of[c];
+      if (q == i) continue;
+      if (q > i) {
+        // 2-opt: reverse order[i..q], so that c follows a.
+        {
+          std::vector<int> content = Slice(i, q);
+          std::reverse(content.begin(), content.end());
+          Try(i, q, std::move(content));
+        }
+        // Or-opt: move a segment starting or ending at c to follow a.
+        for (int len = 1; len <= 3; len++) {
+          if (q + len - 1 < n) {
+            std::vector<int> content = Slice(q, q + len - 1);
+            for (int k = i; k < q; k++) content.push_back(order[k]);
+            Try(i, q + len - 1, std::move(content));
+          }
+          if (len > 1 && q - len + 1 >= i) {
+            std::vector<int> content = Slice(q - len + 1, q);
+            std::reverse(content.begin(), content.end());
+            for (int k = i; k < q - len + 1; k++) content.push_back(order[k]);
+            Try(i, q, std::move(content));
+          }
+        }
+      } else if (q < i - 1) {
+        // 2-opt: reverse order[q+1..i-1], so that a follows c.
+        {
+          std::vector<int> content = Slice(q + 1, i - 1);
+          std::reverse(content.begin(), content.end());
+          Try(q + 1, i - 1, std::move(content));
+        }
+        // Or-opt: move a segment starting or ending at c to follow a.
+        for (int len = 1; len <= 3; len++) {
+          if (q + len - 1 < i - 1) {
+            std::vector<int> content = Slice(q + len, i - 1);
+            for (int k = q; k < q + len; k++) content.push_back(order[k]);
+            Try(q, i - 1, std::move(content));
+          }
+          if (len > 1 && q - len + 1 >= 0) {
+            std::vector<int> content = Slice(q + 1, i - 1);
+            for (int k = q; k >= q - len + 1; k--) content.push_back(order[k]);
+            Try(q - len + 1, i - 1, std::move(content));
+          }
+        }
+      }
+    }
+    return best;
+  }
+
+  // Apply the move if it's still valid and improving on the current
+  // tour. Returns true if applied.
+  bool Apply(const Move &move) {
+    for (int c : move.content)
+      if (pos_of[c] < move.lo || pos_of[c] > move.hi) return false;
+    const auto e = Evaluate(move.lo, move.hi, move.content);
+    if (!e.has_value() || e.value().first >= Total()) return false;
+    const int resync = e.value().second;
+
+    const int64_t old_time = time[resync];
+    for (int k = move.lo; k <= move.hi; k++) {
+      order[k] = move.content[k - move.lo];
+      pos_of[order[k]] = k;
+    }
+    Recompute(move.lo, resync + 1);
+    const int64_t delta = time[resync] - old_time;
+    for (int k = resync + 1; k < n; k++) time[k] += delta;
+    CHECK(Total() == e.value().first);
+    return true;
+  }
+
+  TourOptimizerStats Run() {
+    Timer timer;
+    Periodically status_per(5.0);
+    TourOptimizerStats stats;
+    stats.steps_before = Total();
+    ArcFour rc(StringPrintf("tour.%d", n));
+
+    const int batch_size = 64 * std::max(1, options.threads);
+    bool improved = true;
+    while (improved && timer.Seconds() < options.seconds) {
+      improved = false;
+      std::vector<int> positions;
+      for (int i = 1; i < n; i++) positions.push_back(i);
+      Shuffle(&rc, &positions);
+
+      for (size_t start = 0;
+           start < positions.size() && timer.Seconds() < options.seconds;
+           start += batch_size) {
+        const size_t end = std::min(positions.size(), start + batch_size);
+        std::vector<int64_t> evaluated(end - start, 0);
+        std::vector<std::optional<Move>> moves =
+          ParallelTabulate(end - start, [&](int64_t b) {
+              return BestMoveAt(positions[start + b], &evaluated[b]);
+            }, options.threads);
+        for (int64_t e : evaluated) stats.moves_evaluated += e;
+
+        std::vector<Move> good;
+        for (auto &m : moves)
+          if (m.has_value()) good.push_back(std::move(m.value()));
+        std::sort(good.begin(), good.end(),
+                  [](const Move &a, const Move &b) {
+                    return a.total < b.total;
+                  });
+        for (const Move &m : good) {
+          if (Apply(m)) {
+            stats.moves_applied++;
+            improved = true;
+          }
+        }
+
+        if (options.verbose && status_per.ShouldRun()) {
+          fprintf(stderr, "Tour: %lld -> %lld steps (%lld moves) in %s\n",
+                  (long long)stats.steps_before, (long long)Total(),
+                  (long long)stats.moves_applied,
+                  ANSI::Time(timer.Seconds()).c_str());
+        }
+      }
+    }
+
+    stats.steps_after = Total();
+    stats.seconds = timer.Seconds();
+    return stats;
+  }
+
+  std::vector<std::pair<int, int>> Tour() const {
+    std::vector<std::pair<int, int>> tour;
+    tour.reserve(n);
+    for (int s : order) tour.push_back(stars[s]);
+    return tour;
+  }
+
+  const TourOptimizerOptions options;
+  const std::vector<std::pair<int, int>> stars;
+  const int n = 0;
+  // Star indices in the order visited, and the inverse.
+  std::vector<int> order, pos_of;
+  // Steps on arrival at order[k], and the velocity then.
+  std::vector<int64_t> time;
+  std::vector<std::pair<int, int>> vel;
+  std::vector<std::vector<int>> neighbors;
+  LegCache cache;
+};
+
+}  // namespace
+
+TourOptimizerStats OptimizeTour(std::vector<std::pair<int, int>> *tour,
+                                const TourOptimizerOptions &options) {
+  if (tour->size() < 3) {
+    const int64_t steps = TourSteps(*tour);
+    return TourOptimizerStats{.steps_before = steps, .steps_after = steps};
+  }
+  Optimizer opt(*tour, options);
+  TourOptimizerStats stats = opt.Run();
+  *tour = opt.Tour();
+  return stats;
+}
@@ -0,0 +1,52 @@
+
+#ifndef SPACESHIP_TOUR_H_
+#define SPACESHIP_TOUR_H_
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// A tour visits distinct stars in order, starting from rest at the
+// origin and flying to each one in turn with FlyTo. Its cost is the
+// total number of steps. Since we arrive at each star with some
+// velocity, the cost of a leg depends on everything before it.
+
+// The total number of steps.
+int64_t TourSteps(const std::vector<std::pair<int, int>> &tour);
+
+// The keypad moves for the tour.
+std::string TourMoves(const std::vector<std::pair<int, int>> &tour);
+
+struct TourOptimizerOptions {
+  double seconds = 10.0;
+  int threads = 8;
+  // Number of nearest stars to try to connect each star to.
+  int neighbors = 8;
+  // Largest span of the tour that a move can rearrange.
+  int max_span = 1000;
+  // A change to the tour alters the velocity on arrival at the stars
+  // after it, but usually it comes back into agreement after a few
+  // stars. If it doesn't within this many, the move is rejected,
+  // so that evaluation stays cheap (and exact).
+  int max_resync = 32;
+  bool verbose = true;
+};
+
+struct TourOptimizerStats {
+  int64_t steps_before = 0, steps_after = 0;
+  int64_t moves_applied = 0;
+  int64_t moves_evaluated = 0;
+  double seconds = 0.0;
+};
+
+// Improve the tour in place with 2-opt (segment reversal) and Or-opt
+// (moving short segments, possibly reversed), evaluating the true
+// step counts. Candidate moves connect each star to its spatial
+// nearest neighbors; they are evaluated in parallel against the
+// current tour, and then the improving ones are applied in order
+// (re-checking each). Runs until no move improves or the time is up.
+TourOptimizerStats OptimizeTour(std::vector<std::pair<int, int>> *tour,
+                                const TourOptimizerOptions &options);
+
+#endif
@@ -7,6 +7,7 @@
 #include "base/logging.h"
 #include "base/stringprintf.h"
 #include "ansi.h"
+#include "verify-solution.h"
 
 int main(int argc, char **argv) {
   ANSI::Init();
@@ -35,6 +36,13 @@ int main(int argc, char **argv) {
     } else if (oldc.size() == newc.size()) {
       printf("%d -> %d\n", (int)oldc.size(), (int)newc.size());
     } else if (oldc.empty() || (oldc.size() > newc.size())) {
+      // Never replace a solution with a broken one.
+      const Verdict verdict = VerifySolution(argv[2], n, newc);
+      if (verdict.status == Verdict::INVALID) {
+        printf("%d -> " ARED("%d INVALID") " %s\n", (int)oldc.size(),
+               (int)newc.size(), verdict.error.c_str());
+        continue;
+      }
       printf("%d -> " AGREEN("%d") "\n", (int)oldc.size(), (int)newc.size());
       // Write over it.
       Util::WriteFile(olde, newc);
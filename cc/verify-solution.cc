@@ -0,0 +1,89 @@
+#include "verify-solution.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+
+#include "base/stringprintf.h"
+#include "icfp.h"
+#include "lambdaman-board.h"
+#include "spaceship-problem.h"
+#include "util.h"
+
+using namespace icfp;
+
+// Like the contest's evaluator, give up on programs that take more
+// than this many beta reductions.
+static constexpr int64_t MAX_BETAS = 10'000'000;
+
+static Verdict Invalid(std::string error) {
+  return Verdict{.status = Verdict::INVALID, .error = std::move(error)};
+}
+
+Verdict VerifySolution(std::string_view kind, int n,
+                       std::string_view contents) {
+  if (kind != "lambdaman" && kind != "spaceship") return Verdict{};
+
+  std::string soln = Util::NormalizeWhitespace(std::string(contents));
+  if (soln.empty()) return Invalid("empty");
+
+  // Otherwise, it's an icfp program.
+  if (!soln.starts_with("solve ")) {
+    Parser parser;
+    std::string error;
+    std::shared_ptr<Exp> exp = parser.ParseProgram(soln, &error);
+    if (exp.get() == nullptr) return Invalid("doesn't parse: " + error);
+
+    Evaluation evaluation;
+    evaluation.max_betas = MAX_BETAS;
+    Value v = evaluation.Eval(exp);
+    if (evaluation.betas > MAX_BETAS) return Invalid("too slow");
+    const String *s = std::get_if<String>(&v);
+    if (s == nullptr) return Invalid("evaluates to " + ValueString(v));
+    soln = Util::NormalizeWhitespace(s->s);
+  }
+
+  const std::string prefix = StringPrintf("solve %s%d ",
+                                          std::string(kind).c_str(), n);
+  if (!soln.starts_with(prefix))
+    return Invalid("doesn't start with \"" + prefix + "\"");
+  // The moves may be wrapped across lines. Like MoveReader (and so
+  // lambdaman.exe), ignore any whitespace in them.
+  std::string moves;
+  moves.reserve(soln.size() - prefix.size());
+  for (char c : std::string_view(soln).substr(prefix.size())) {
+    if (c != ' ' && c != '\n' && c != '\r' && c != '\t') moves.push_back(c);
+  }
+
+  if (kind == "lambdaman") {
+    for (char c : moves) {
+      if (c != 'U' && c != 'D' && c != 'L' && c != 'R')
+        return Invalid(StringPrintf("bad move '%c'", c));
+    }
+    Board board = FromFile(
+        StringPrintf("../puzzles/lambdaman/lambdaman%d.txt", n));
+    board.Play(moves);
+    if (board.dots != 0)
+      return Invalid(StringPrintf("%d dots left", board.dots));
+  } else {
+    const Problem p = Problem::FromFile(
+        StringPrintf("../puzzles/spaceship/spaceship%d.txt", n));
+    const int missed = p.StarsMissed(moves);
+    if (missed < 0) return Invalid("bad move");
+    if (missed > 0) return Invalid(StringPrintf("%d stars missed", missed));
+  }
+
+  return Verdict{.status = Verdict::VALID};
+}
+
+const char *VerdictString(const Verdict &verdict) {
+  switch (verdict.status) {
+  case Verdict::VALID: return "valid";
+  case Verdict::INVALID: return "INVALID";
+  case Verdict::UNCHECKED: return "unchecked";
+  }
+  return "?";
+}
@@ -0,0 +1,27 @@
+
+#ifndef VERIFY_SOLUTION_H_
+#define VERIFY_SOLUTION_H_
+
+#include <string>
+#include <string_view>
+
+// Checks solutions for the problems that we can simulate, so that
+// we don't replace a working solution with a shorter broken one.
+struct Verdict {
+  enum Status { VALID, INVALID, UNCHECKED };
+  Status status = UNCHECKED;
+  // For INVALID, what's wrong.
+  std::string error;
+};
+
+// The contents of a solution file for problem kindN (e.g.
+// "lambdaman", 4), either a plain "solve kindN ..." string or an icfp
+// program that evaluates to one. Lambdaman solutions must eat every
+// dot, and spaceship solutions must visit every star. Other kinds
+// are UNCHECKED. Run from the cc directory.
+Verdict VerifySolution(std::string_view kind, int n,
+                       std::string_view contents);
+
+const char *VerdictString(const Verdict &verdict);
+
+#endif
@@ -0,0 +1,170 @@
+
+// Checks every lambdaman and spaceship solution in the solutions
+// tree (plain solve strings and icfp programs), in parallel, and
+// prints a table of sizes and validity. With a second directory
+// (laid out like solutions/), also reports where its valid solutions
+// would improve on ours. Run from the cc directory.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <pthread.h>
+
+#include "ansi.h"
+#include "base/logging.h"
+#include "base/stringprintf.h"
+#include "timer.h"
+#include "util.h"
+#include "verify-solution.h"
+
+struct Job {
+  std::string dir;
+  std::string kind;
+  int n = 0;
+  std::string file;
+  int64_t size = 0;
+  Verdict verdict;
+  double seconds = 0.0;
+};
+
+// Finds solution files for kind in dir: kindN.txt, kindN.icfp, and
+// variants like kindN-encode.icfp.
+static std::vector<Job> FindJobs(const std::string &dir,
+                                 const std::string &kind) {
+  std::vector<Job> jobs;
+  const std::string path = dir + "/" + kind;
+  if (!std::filesystem::is_directory(path)) return jobs;
+  for (const auto &entry : std::filesystem::directory_iterator(path)) {
+    if (!entry.is_regular_file()) continue;
+    const std::string name = entry.path().filename().string();
+    if (!name.starts_with(kind)) continue;
+    size_t end = kind.size();
+    while (end < name.size() && isdigit(name[end])) end++;
+    if (end == kind.size() || end == name.size() ||
+        (name[end] != '.' && name[end] != '-'))
+      continue;
+    jobs.push_back(Job{.dir = dir, .kind = kind,
+                       .n = atoi(name.substr(kind.size()).c_str()),
+                       .file = entry.path().string()});
+  }
+  return jobs;
+}
+
+// Evaluation recurses deeply, so like the evaluator's own workers,
+// these need big stacks (not the default for std::thread).
+struct Pool {
+  std::vector<Job> *jobs = nullptr;
+  std::atomic<int> next{0};
+
+  static void *Worker(void *arg) {
+    Pool *pool = (Pool *)arg;
+    for (;;) {
+      const int i = pool->next++;
+      if (i >= (int)pool->jobs->size()) return nullptr;
+      Job &job = (*pool->jobs)[i];
+      Timer timer;
+      const std::string contents = Util::ReadFile(job.file);
+      job.size = Util::NormalizeWhitespace(contents).size();
+      job.verdict = VerifySolution(job.kind, job.n, contents);
+      job.seconds = timer.Seconds();
+    }
+  }
+
+  void Run(int threads) {
+    pthread_attr_t attr;
+    CHECK(0 == pthread_attr_init(&attr));
+    CHECK(0 == pthread_attr_setstacksize(&attr, size_t{1} << 30));
+    std::vector<pthread_t> workers;
+    for (int i = 0; i < threads; i++) {
+      pthread_t t;
+      CHECK(0 == pthread_create(&t, &attr, &Pool::Worker, this));
+      workers.push_back(t);
+    }
+    pthread_attr_destroy(&attr);
+    for (pthread_t t : workers) pthread_join(t, nullptr);
+  }
+};
+
+int main(int argc, char **argv) {
+  ANSI::Init();
+  CHECK(argc == 1 || argc == 2) << "./verify-solutions.exe [other_dir]\n"
+    "Checks ../solutions and optionally other_dir (which has the same "
+    "layout).";
+
+  std::vector<std::string> dirs = {"../solutions"};
+  if (argc == 2) dirs.push_back(argv[1]);
+
+  std::vector<Job> jobs;
+  for (const std::string &dir : dirs) {
+    for (const std::string kind : {"lambdaman", "spaceship"}) {
+      for (Job &job : FindJobs(dir, kind)) jobs.push_back(std::move(job));
+    }
+  }
+  // Biggest first, since they're probably the slowest.
+  std::sort(jobs.begin(), jobs.end(), [](const Job &a, const Job &b) {
+      return std::filesystem::file_size(a.file) >
+        std::filesystem::file_size(b.file);
+    });
+
+  Timer timer;
+  Pool pool;
+  pool.jobs = &jobs;
+  pool.Run(std::max(1, (int)std::thread::hardware_concurrency()));
+
+  std::sort(jobs.begin(), jobs.end(), [](const Job &a, const Job &b) {
+      return std::tie(a.kind, a.n, a.dir, a.file) <
+        std::tie(b.kind, b.n, b.dir, b.file);
+    });
+
+  // Smallest valid size for each (dir, kind, n).
+  std::map<std::tuple<std::string, std::string, int>, int64_t> best;
+  int invalid = 0;
+  printf("%-44s %9s  %-9s %8s\n", "file", "size", "status", "time");
+  for (const Job &job : jobs) {
+    const char *color =
+      job.verdict.status == Verdict::VALID ? ANSI_GREEN :
+      job.verdict.status == Verdict::INVALID ? ANSI_RED : ANSI_GREY;
+    printf("%-44s %9lld  %s%-9s" ANSI_RESET " %8s %s\n",
+           job.file.c_str(), (long long)job.size, color,
+           VerdictString(job.verdict),
+           ANSI::Time(job.seconds).c_str(), job.verdict.error.c_str());
+    if (job.verdict.status == Verdict::INVALID) invalid++;
+    if (job.verdict.status == Verdict::VALID) {
+      auto key = std::make_tuple(job.dir, job.kind, job.n);
+      auto it = best.find(key);
+      if (it == best.end() || job.size < it->second) best[key] = job.size;
+    }
+  }
+
+  if (dirs.size() == 2) {
+    printf("\nImprovements from %s:\n", dirs[1].c_str());
+    int improved = 0;
+    for (const auto &[key, size] : best) {
+      const auto &[dir, kind, n] = key;
+      if (dir != dirs[1]) continue;
+      auto it = best.find(std::make_tuple(dirs[0], kind, n));
+      if (it == best.end() || size < it->second) {
+        printf("  %s%d: %s -> " AGREEN("%lld") "\n", kind.c_str(), n,
+               it == best.end() ? "--" :
+               StringPrintf("%lld", (long long)it->second).c_str(),
+               (long long)size);
+        improved++;
+      }
+    }
+    printf("%d improved.\n", improved);
+  }
+
+  printf("\n%d files in %s. " "%s%d invalid" ANSI_RESET ".\n",
+         (int)jobs.size(), ANSI::Time(timer.Seconds()).c_str(),
+         invalid > 0 ? ANSI_RED : ANSI_GREEN, invalid);
+  return invalid > 0 ? 1 : 0;
+}